@@ -1,10 +1,40 @@
 #pragma once
 
 #include <cassert>
+#include <cstdlib>
+#include <new>
 #include <cstdint>
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <utility>
+#include <type_traits>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
 #include <windows.h>
-#include <process.h>
+#else
+// SAL annotations come from the Windows headers, so compile them out elsewhere.
+#define _In_
+#define _In_opt_
+#define _Inout_
+#define _Out_
+#define _In_bytecount_c_(size)
+#define _In_count_(size)
+#define _Out_cap_(size)
+#define _Inout_count_c_(size)
+#endif
 
@@ -10,16 +10,13 @@
 //
 // Define what code we will be using for CAS.
 // Intrinsic only available on Visual C++.
+// Everywhere other than x86, std::atomic gives the cheapest correct ordering.
 //
 #ifndef CAS
 #ifdef _X86_
 #define CAS CAS_assembly
-#elif defined(__GNUC__)
-#define CAS CAS_windows
-#elif defined(_MSC_VER)
-#define CAS CAS_intrinsic
 #else
-#error No CAS implemented for this compiler/architecture combination.
+#define CAS CAS_atomic
 #endif
 #endif
 
@@ -44,7 +41,20 @@ struct node
     node<Ty> * volatile pNext = nullptr;
 
     node() : value() {}
-    node(Ty v) : value(v) {}
+    node(Ty v) : value(std::move(v)) {}
+};
+
+//
+// An intrusive node is just the link.  A type derives from node<void> to be
+// pushed onto a LockFreeStack<void> (or a LockFreeEliminationStack<void>)
+// directly, so the value is not copied into a separate node, and is cast back
+// to the derived type when it is popped.  Retire the derived type through the
+// Reclaim policy, not node<void>, which has no virtual destructor.
+//
+template<>
+struct node<void>
+{
+    node<void> * volatile pNext = nullptr;
 };
 
 // CAS will assume a multi-processor machine (versus multithread on a single processor).
@@ -113,6 +123,7 @@ bool CAS_intrinsic(_Inout_ node<Ty> * volatile * _ptr, node<Ty> * oldVal, node<T
 //
 // Define a version of CAS which uses the Windows API InterlockedCompareExchange.
 //
+#ifdef _WIN32
 template<typename Ty>
 bool CAS_windows(_Inout_ node<Ty> * volatile * _ptr, node<Ty> * oldVal, node<Ty> * newVal)
 {
@@ -126,6 +137,46 @@ bool CAS_windows(_Inout_ node<Ty> * volatile * _ptr, node<Ty> * oldVal, node<Ty>
                                         reinterpret_cast<intptr_t>(oldVal)) == reinterpret_cast<intptr_t>(oldVal);
 #endif
 }
+#endif  // _WIN32
+
+//
+// Define a version of CAS which uses std::atomic.
+// The Interlocked functions are full barriers; a successful CAS only needs to
+// acquire the state published by other threads and release its own writes.
+//
+template<typename Ty>
+bool CAS_atomic(_Inout_ node<Ty> * volatile * _ptr, node<Ty> * oldVal, node<Ty> * newVal)
+{
+    static_assert(sizeof(std::atomic<node<Ty> *>) == sizeof(node<Ty> *), "CAS_atomic requires a lock-free atomic pointer.");
+
+    auto pAtomic = reinterpret_cast<std::atomic<node<Ty> *> *>(const_cast<node<Ty> **>(_ptr));
+    return pAtomic->compare_exchange_strong(oldVal, newVal, std::memory_order_acq_rel, std::memory_order_acquire);
+}
+
+//
+// Read and write the links and tags that other threads CAS.  A plain volatile
+// access to them is a data race under the C++ memory model, even where the
+// hardware makes it atomic, and fences only order atomic accesses.  So access
+// them through std::atomic, the same way CAS_atomic does.
+//
+template<typename Tn>
+Tn * AtomicLoad(Tn * volatile const & source, std::memory_order order = std::memory_order_acquire)
+{
+    static_assert(sizeof(std::atomic<Tn *>) == sizeof(Tn *), "AtomicLoad requires a lock-free atomic pointer.");
+    return reinterpret_cast<const std::atomic<Tn *> *>(const_cast<Tn * const *>(&source))->load(order);
+}
+
+inline uint32_t AtomicLoad(volatile const uint32_t & source, std::memory_order order = std::memory_order_acquire)
+{
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "AtomicLoad requires a lock-free atomic integer.");
+    return reinterpret_cast<const std::atomic<uint32_t> *>(const_cast<const uint32_t *>(&source))->load(order);
+}
+
+template<typename Tn>
+void AtomicStore(Tn * volatile & target, Tn * value, std::memory_order order = std::memory_order_release)
+{
+    reinterpret_cast<std::atomic<Tn *> *>(const_cast<Tn **>(&target))->store(value, order);
+}
 
 //------------------------------------------------------------------------------
 //
@@ -137,22 +188,72 @@ bool CAS_windows(_Inout_ node<Ty> * volatile * _ptr, node<Ty> * oldVal, node<Ty>
 // Define what code we will be using for CAS2.
 // Intrinsic only available on Visual C++.
 // Windows version only available on Windows Vista.
+// The intrinsic and Windows versions only support 32-bit pointers, so everywhere
+// other than x86 use the std::atomic/cmpxchg16b version.
 //
 #ifndef CAS2
 #ifdef _X86_
 #define CAS2 CAS2_assembly
-#elif defined(__GNUC__)
-#define CAS2 CAS2_windows
-#elif defined(_MSC_VER)
-#define CAS2 CAS2_intrinsic
 #else
-#error No CAS2 implemented for this compiler/architecture combination.
+#define CAS2 CAS2_atomic
 #endif
 #endif
 
 // _Inout_count_c_(2) is the best SAL annotation possible, though it will not
 // prevent a single element buffer from being passed.
 
+// CAS2 exchanges a pointer and the tag that follows it as a single unit, so the
+// pair must be aligned to its combined size.  cmpxchg16b faults on a misaligned
+// operand, and cmpxchg8b is only atomic across a cache line with a bus lock.
+const size_t CAS2_ALIGNMENT = 2 * sizeof(void *);
+
+// The size of a cache line on current x86 and ARM CPUs.  Data that different
+// threads write is kept on separate lines, so the writes don't contend.  The
+// library's hardware_destructive_interference_size says the same thing where
+// it is available.  GCC warns that its value changes with -mtune, which would
+// change the layout of the containers between builds, so GCC uses 64 too.
+#if defined(__cpp_lib_hardware_interference_size) && !defined(__GNUC__)
+const size_t CACHE_LINE_SIZE = std::hardware_destructive_interference_size;
+#else
+const size_t CACHE_LINE_SIZE = 64;
+#endif
+
+//
+// Layout policies for containers with a head and a tail that different threads
+// write.  PackedLayout keeps them next to each other, so adding a value
+// invalidates the cache line that threads removing values are reading, and
+// the other way around.  PaddedLayout puts each on its own cache line, at the
+// cost of two cache lines per container.  A padded container is over-aligned,
+// so only allocate one with new from C++17 on.
+//
+struct PackedLayout
+{
+    enum : size_t { ALIGNMENT = CAS2_ALIGNMENT };
+};
+
+struct PaddedLayout
+{
+    enum : size_t { ALIGNMENT = CACHE_LINE_SIZE };
+};
+
+//
+// Wait for another thread to make progress: spin for a short while, and then
+// give the processor to the other thread.  cSpins starts at 0.
+//
+inline void SpinBackoff(_Inout_ uint32_t & cSpins)
+{
+    if(++cSpins < 64)
+    {
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+        _mm_pause();
+#endif
+    }
+    else
+    {
+        std::this_thread::yield();
+    }
+}
+
 //
 // Define a version of CAS2 which uses x86 assembly primitives.
 //
@@ -221,5 +322,112 @@ bool CAS2_windows(_Inout_count_c_(2) node<Ty> * volatile * _ptr, node<Ty> * old1
 }
 #endif  // WINVER >= 0x0600
 
+//
+// Define a version of CAS2 which uses std::atomic when the pointer and tag fit in
+// 64 bits, and a 16-byte compare-exchange (cmpxchg16b on x64) when they do not.
+// Early AMD64 CPUs do not support cmpxchg16b, but every CPU that runs a current
+// 64-bit operating system does.
+//
+template<typename Ty>
+bool CAS2_atomic(_Inout_count_c_(2) node<Ty> * volatile * _ptr, node<Ty> * old1, uint32_t old2, node<Ty> * new1, uint32_t new2)
+{
+    assert(reinterpret_cast<uintptr_t>(_ptr) % CAS2_ALIGNMENT == 0);
+
+#if UINTPTR_MAX == UINT32_MAX
+    static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "CAS2_atomic requires a lock-free 64-bit atomic.");
+
+    uint64_t Comperand = reinterpret_cast<uintptr_t>(old1) | (static_cast<uint64_t>(old2) << 32);
+    uint64_t Exchange  = reinterpret_cast<uintptr_t>(new1) | (static_cast<uint64_t>(new2) << 32);
+
+    auto pAtomic = reinterpret_cast<std::atomic<uint64_t> *>(const_cast<node<Ty> **>(_ptr));
+    return pAtomic->compare_exchange_strong(Comperand, Exchange, std::memory_order_acq_rel, std::memory_order_acquire);
+#else
+    // With 64-bit pointers the 32-bit tag is followed by 32 bits of structure padding,
+    // which is compared along with everything else.  CAS2 never changes the padding,
+    // so carry whatever it holds through both the comparand and the exchange.
+    auto pTag = reinterpret_cast<std::atomic<uint64_t> *>(const_cast<node<Ty> **>(_ptr) + 1);
+    uint64_t Padding = pTag->load(std::memory_order_relaxed) & 0xffffffff00000000;
+
+    uint64_t ComperandLow  = reinterpret_cast<uintptr_t>(old1);
+    uint64_t ComperandHigh = Padding | old2;
+    uint64_t ExchangeLow   = reinterpret_cast<uintptr_t>(new1);
+    uint64_t ExchangeHigh  = Padding | new2;
+
+#if defined(_MSC_VER)
+    __int64 Comperand[2] = { static_cast<__int64>(ComperandLow), static_cast<__int64>(ComperandHigh) };
+    return _InterlockedCompareExchange128(reinterpret_cast<__int64 volatile *>(_ptr),
+                                          static_cast<__int64>(ExchangeHigh),
+                                          static_cast<__int64>(ExchangeLow),
+                                          Comperand) != 0;
+#elif defined(__x86_64__) && !defined(__SANITIZE_THREAD__)
+    // ThreadSanitizer can't see into the assembly, so it uses the builtin below.
+    bool f;
+    __asm__ __volatile__(
+        "lock; cmpxchg16b %1;"
+        "setz %0;"
+            : "=q"(f), "+m"(*reinterpret_cast<volatile uint64_t (*)[2]>(_ptr)), "+a"(ComperandLow), "+d"(ComperandHigh)
+            : "b"(ExchangeLow), "c"(ExchangeHigh)
+            : "memory", "cc");
+    return f;
+#else
+    unsigned __int128 Comperand = (static_cast<unsigned __int128>(ComperandHigh) << 64) | ComperandLow;
+    unsigned __int128 Exchange  = (static_cast<unsigned __int128>(ExchangeHigh) << 64) | ExchangeLow;
+    return __atomic_compare_exchange_n(reinterpret_cast<unsigned __int128 *>(const_cast<node<Ty> **>(_ptr)),
+                                       &Comperand, Exchange, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+#endif
+}
+
+//------------------------------------------------------------------------------
+//
+// Memory reclamation policies.
+//
+//------------------------------------------------------------------------------
+
+//
+// The containers take a reclamation policy, which decides when a node that has
+// been removed can be freed while other threads may still be reading it.  A
+// policy provides a Guard, which is held for the length of one operation and
+// protects the nodes that the operation dereferences, and Retire, which frees
+// a removed node once no guard protects it.
+//
+// ReclaimNone is the original behavior: nothing is protected, so nodes must be
+// preallocated and never freed while the container is in use.  The tags on
+// the head and tail keep reused nodes from causing ABA problems.
+//
+// Collect reclaims what it can without waiting.  A policy may also retire a
+// node with a function to call in place of delete, such as one that returns
+// the node to a freelist.  Policies that support this also provide
+// Synchronize, which waits until everything retired before the call has been
+// reclaimed.
+//
+struct ReclaimNone
+{
+    class Guard
+    {
+    public:
+        template<typename Tn>
+        Tn * Protect(int, Tn * volatile const & pSource)
+        {
+            return AtomicLoad(pSource);
+        }
+    };
+
+    // Only safe once no other thread can be using the container.
+    template<typename Tn>
+    static void Retire(_In_ Tn * pNode)
+    {
+        delete pNode;
+    }
+
+    static void Retire(_In_ void * pNode, void (*pfnReclaim)(void * pNode, void * pContext), void * pContext)
+    {
+        pfnReclaim(pNode, pContext);
+    }
+
+    static void Collect() {}
+    static void Synchronize() {}
+};
+
 #endif
 
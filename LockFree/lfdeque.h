@@ -0,0 +1,185 @@
+#ifndef LFDEQUE_H
+#define LFDEQUE_H
+
+#include "lfcas.h"
+
+//------------------------------------------------------------------------------
+//
+// Parameterized Lock-free Work-stealing Deque
+//
+//------------------------------------------------------------------------------
+//
+// The deque described by David Chase and Yossi Lev in "Dynamic Circular
+// Work-Stealing Deque" (http://dl.acm.org/citation.cfm?id=1073974), with the
+// memory ordering given by Nhat Minh Le et al. in "Correct and Efficient
+// Work-Stealing for Weak Memory Models"
+// (http://www.di.ens.fr/~zappa/readings/ppopp13.pdf).
+//
+// One thread owns the deque, and pushes and pops at the bottom like a stack,
+// so it gets its most recent (and most cache-friendly) work back first.  Any
+// other thread can steal from the top, where the oldest and usually largest
+// pieces of work are.  The owner only needs a CAS when it takes the last
+// value, where it may race with a thief.
+//
+// The values live in a circular array that the owner doubles when it is
+// full.  Thieves may still be reading an old array, so old arrays are kept
+// until the deque is destroyed.  Because each array is twice the size of the
+// one before, they take less memory than the current one.
+//
+// Ty must be small and trivially copyable, such as a pointer.  A thief that
+// loses the race for a value discards its copy without using it.
+//
+template<typename Ty>
+class LockFreeDeque
+{
+    static_assert(std::is_trivially_copyable<Ty>::value, "LockFreeDeque values are copied by thieves that may lose the race for them.");
+
+    struct Array
+    {
+        const int64_t mask;     // capacity - 1
+        Array * const pOlder;   // kept until the deque is destroyed
+        std::atomic<Ty> * const aValues;
+
+        Array(int64_t cCapacity, _In_opt_ Array * pOlderArray) :
+            mask(cCapacity - 1), pOlder(pOlderArray), aValues(new std::atomic<Ty>[static_cast<size_t>(cCapacity)]) {}
+        ~Array() { delete[] aValues; }
+
+        Ty Get(int64_t ix) const { return aValues[ix & mask].load(std::memory_order_relaxed); }
+        void Put(int64_t ix, Ty value) { aValues[ix & mask].store(value, std::memory_order_relaxed); }
+    };
+
+    // Thieves write the top and the owner writes the bottom, so keep them a
+    // cache line apart.  This is padding rather than alignas, so that deques
+    // can be allocated with new before C++17.
+    std::atomic<int64_t> _iTop;
+    char _padding[CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> _iBottom;
+    std::atomic<Array *> _pArray;
+
+    // Not implemented to prevent accidental copying/moving.
+    LockFreeDeque(const LockFreeDeque&) = delete;
+    LockFreeDeque& operator=(const LockFreeDeque&) = delete;
+
+    Array * Grow(_In_ Array * pArray, int64_t iBottom, int64_t iTop);
+
+public:
+    // cCapacity must be a power of two.
+    LockFreeDeque(size_t cCapacity = 256);
+    ~LockFreeDeque() noexcept;
+
+    // Owner only.
+    void Push(Ty value);
+    bool Pop(_Out_ Ty & value);
+
+    // Any thread.  Returns false if the deque is empty, or if another thread
+    // took the value first.
+    bool Steal(_Out_ Ty & value);
+
+    // Only a hint while other threads are using the deque.
+    bool Empty() const
+    {
+        return _iBottom.load(std::memory_order_relaxed) <= _iTop.load(std::memory_order_relaxed);
+    }
+};
+
+template<typename Ty>
+LockFreeDeque<Ty>::LockFreeDeque(size_t cCapacity) : _iTop(0), _iBottom(0), _pArray(new Array(static_cast<int64_t>(cCapacity), nullptr))
+{
+    assert(cCapacity >= 2 && (cCapacity & (cCapacity - 1)) == 0);
+}
+
+template<typename Ty>
+LockFreeDeque<Ty>::~LockFreeDeque() noexcept
+{
+    Array * pArray = _pArray.load(std::memory_order_relaxed);
+    while(nullptr != pArray)
+    {
+        Array * pOlder = pArray->pOlder;
+        delete pArray;
+        pArray = pOlder;
+    }
+}
+
+template<typename Ty>
+typename LockFreeDeque<Ty>::Array * LockFreeDeque<Ty>::Grow(_In_ Array * pArray, int64_t iBottom, int64_t iTop)
+{
+    Array * pNewArray = new Array(2 * (pArray->mask + 1), pArray);
+    for(int64_t ix = iTop; ix < iBottom; ++ix)
+    {
+        pNewArray->Put(ix, pArray->Get(ix));
+    }
+
+    _pArray.store(pNewArray, std::memory_order_release);
+    return pNewArray;
+}
+
+template<typename Ty>
+void LockFreeDeque<Ty>::Push(Ty value)
+{
+    const int64_t iBottom = _iBottom.load(std::memory_order_relaxed);
+    const int64_t iTop = _iTop.load(std::memory_order_acquire);
+    Array * pArray = _pArray.load(std::memory_order_relaxed);
+
+    if(iBottom - iTop > pArray->mask)
+    {
+        pArray = Grow(pArray, iBottom, iTop);
+    }
+
+    pArray->Put(iBottom, value);
+    std::atomic_thread_fence(std::memory_order_release);
+    _iBottom.store(iBottom + 1, std::memory_order_relaxed);
+}
+
+template<typename Ty>
+bool LockFreeDeque<Ty>::Pop(_Out_ Ty & value)
+{
+    //
+    // Claim the bottom value before looking at the top.  The fence orders the
+    // two, so either a thief sees the new bottom and leaves the value alone,
+    // or the owner sees the thief's new top.
+    //
+    const int64_t iBottom = _iBottom.load(std::memory_order_relaxed) - 1;
+    Array * pArray = _pArray.load(std::memory_order_relaxed);
+    _iBottom.store(iBottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t iTop = _iTop.load(std::memory_order_relaxed);
+
+    if(iTop > iBottom)
+    {
+        // The deque was empty.
+        _iBottom.store(iBottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    value = pArray->Get(iBottom);
+    if(iTop == iBottom)
+    {
+        // This is the last value, so race the thieves for it.
+        const bool fWon = _iTop.compare_exchange_strong(iTop, iTop + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        _iBottom.store(iBottom + 1, std::memory_order_relaxed);
+        return fWon;
+    }
+
+    return true;
+}
+
+template<typename Ty>
+bool LockFreeDeque<Ty>::Steal(_Out_ Ty & value)
+{
+    int64_t iTop = _iTop.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t iBottom = _iBottom.load(std::memory_order_acquire);
+
+    if(iTop >= iBottom)
+    {
+        return false;
+    }
+
+    // Read the value before claiming it.  Once the top moves, the owner may
+    // overwrite the slot.
+    Array * pArray = _pArray.load(std::memory_order_acquire);
+    value = pArray->Get(iTop);
+    return _iTop.compare_exchange_strong(iTop, iTop + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+#endif
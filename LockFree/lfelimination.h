@@ -0,0 +1,196 @@
+#ifndef LFELIMINATION_H
+#define LFELIMINATION_H
+
+#include "lfstack.h"
+
+//------------------------------------------------------------------------------
+//
+// Parameterized Lock-free Elimination-backoff Stack
+//
+//------------------------------------------------------------------------------
+//
+// The stack described by Danny Hendler, Nir Shavit and Lena Yerushalmi in "A
+// Scalable Lock-free Stack Algorithm"
+// (http://people.csail.mit.edu/shanir/publications/Lock_Free.pdf).
+//
+// Every push and pop on a LockFreeStack updates the same head, so under heavy
+// contention most of the CASes fail, and the threads just take turns moving
+// the head's cache line around.  But a push followed immediately by a pop
+// leaves the stack as it was, so the two can cancel out without touching the
+// head at all.  When a CAS on the head fails, a push offers its node in a
+// random slot of an elimination array and waits a little while, and a pop
+// looks in a random slot for a node to take.  Only when no partner turns up
+// do they go back to the head.
+//
+// The array is only worth using as far as there are threads to meet in it.
+// Each thread keeps its own width (how many slots it chooses from) and wait.
+// A slot that is already taken means the array is crowded, so the width
+// doubles.  Waiting with no partner means it is too sparse, so the width
+// halves, and the wait doubles so that partners have longer to arrive.
+//
+template<typename Ty, typename Reclaim = ReclaimNone>
+class LockFreeEliminationStack
+{
+    enum : uint32_t
+    {
+        ELIMINATION_SLOTS = 16,     // the largest width
+        MIN_WAIT = 16,              // spins
+        MAX_WAIT = 1024,
+    };
+
+    // A slot holds the node offered by a waiting push, or nullptr.
+    struct alignas(CACHE_LINE_SIZE) Slot
+    {
+        std::atomic<node<Ty> *> pOffer;
+    };
+
+    struct ThreadState
+    {
+        uint32_t width = 1;
+        uint32_t cWaitSpins = MIN_WAIT;
+        uint32_t seed = 0;
+    };
+
+    LockFreeStack<Ty, Reclaim> _stack;
+    Slot _aSlots[ELIMINATION_SLOTS];
+
+    // Not implemented to prevent accidental copying/moving.
+    LockFreeEliminationStack(const LockFreeEliminationStack&) = delete;
+    LockFreeEliminationStack& operator=(const LockFreeEliminationStack&) = delete;
+
+    static ThreadState & ThisThread();
+    Slot & ChooseSlot(_Inout_ ThreadState & state);
+
+    bool TryEliminatePush(_In_ node<Ty> * pNode);
+    bool TryEliminatePop(_Out_ node<Ty> * & pNode);
+
+public:
+    LockFreeEliminationStack();
+
+    void Push(_In_ node<Ty> * pNode);
+    node<Ty> * Pop();
+
+    static void Retire(_In_ node<Ty> * pNode)
+    {
+        static_assert(!std::is_void<Ty>::value, "node<void> has no virtual destructor, so retire an intrusive node through Reclaim as its derived type.");
+        Reclaim::Retire(pNode);
+    }
+};
+
+template<typename Ty, typename Reclaim>
+LockFreeEliminationStack<Ty, Reclaim>::LockFreeEliminationStack()
+{
+    for(Slot & slot : _aSlots)
+    {
+        slot.pOffer.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+template<typename Ty, typename Reclaim>
+typename LockFreeEliminationStack<Ty, Reclaim>::ThreadState & LockFreeEliminationStack<Ty, Reclaim>::ThisThread()
+{
+    static thread_local ThreadState s_state;
+    if(0 == s_state.seed)
+    {
+        // Any odd seed works, so start each thread somewhere different.
+        s_state.seed = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&s_state) >> 4) | 1;
+    }
+    return s_state;
+}
+
+template<typename Ty, typename Reclaim>
+typename LockFreeEliminationStack<Ty, Reclaim>::Slot & LockFreeEliminationStack<Ty, Reclaim>::ChooseSlot(_Inout_ ThreadState & state)
+{
+    state.seed ^= state.seed << 13;
+    state.seed ^= state.seed >> 17;
+    state.seed ^= state.seed << 5;
+    return _aSlots[state.seed % state.width];
+}
+
+template<typename Ty, typename Reclaim>
+bool LockFreeEliminationStack<Ty, Reclaim>::TryEliminatePush(_In_ node<Ty> * pNode)
+{
+    ThreadState & state = ThisThread();
+    Slot & slot = ChooseSlot(state);
+
+    node<Ty> * pExpected = nullptr;
+    if(!slot.pOffer.compare_exchange_strong(pExpected, pNode, std::memory_order_release, std::memory_order_relaxed))
+    {
+        // Another push is already waiting here.
+        state.width = std::min<uint32_t>(2 * state.width, ELIMINATION_SLOTS);
+        return false;
+    }
+
+    //
+    // Wait for a pop to take the node.  No other thread can offer pNode, so
+    // once the slot holds anything else, the node was taken.
+    //
+    for(uint32_t ii = 0; ii < state.cWaitSpins; ++ii)
+    {
+        if(slot.pOffer.load(std::memory_order_relaxed) != pNode)
+        {
+            state.cWaitSpins = std::max<uint32_t>(state.cWaitSpins / 2, MIN_WAIT);
+            return true;
+        }
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+        _mm_pause();
+#endif
+    }
+
+    // Withdraw the offer, unless a pop takes it first.
+    pExpected = pNode;
+    if(slot.pOffer.compare_exchange_strong(pExpected, nullptr, std::memory_order_relaxed))
+    {
+        state.width = std::max<uint32_t>(state.width / 2, 1);
+        state.cWaitSpins = std::min<uint32_t>(2 * state.cWaitSpins, MAX_WAIT);
+        return false;
+    }
+    return true;
+}
+
+template<typename Ty, typename Reclaim>
+bool LockFreeEliminationStack<Ty, Reclaim>::TryEliminatePop(_Out_ node<Ty> * & pNode)
+{
+    ThreadState & state = ThisThread();
+    Slot & slot = ChooseSlot(state);
+
+    for(uint32_t ii = 0; ii < state.cWaitSpins; ++ii)
+    {
+        // The node was offered by a push that has not returned, so it can't
+        // have been freed.  Taking it completes both operations.
+        node<Ty> * pOffer = slot.pOffer.load(std::memory_order_relaxed);
+        if(nullptr != pOffer && slot.pOffer.compare_exchange_strong(pOffer, nullptr, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            state.cWaitSpins = std::max<uint32_t>(state.cWaitSpins / 2, MIN_WAIT);
+            pNode = pOffer;
+            return true;
+        }
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+        _mm_pause();
+#endif
+    }
+
+    state.width = std::max<uint32_t>(state.width / 2, 1);
+    state.cWaitSpins = std::min<uint32_t>(2 * state.cWaitSpins, MAX_WAIT);
+    return false;
+}
+
+template<typename Ty, typename Reclaim>
+void LockFreeEliminationStack<Ty, Reclaim>::Push(_In_bytecount_c_(sizeof node<Ty>) node<Ty> * pNode)
+{
+    while(!_stack.TryPush(pNode) && !TryEliminatePush(pNode))
+    {
+    }
+}
+
+template<typename Ty, typename Reclaim>
+node<Ty> * LockFreeEliminationStack<Ty, Reclaim>::Pop()
+{
+    node<Ty> * pNode;
+    while(!_stack.TryPop(pNode) && !TryEliminatePop(pNode))
+    {
+    }
+    return pNode;
+}
+
+#endif
@@ -0,0 +1,413 @@
+#ifndef LFEPOCH_H
+#define LFEPOCH_H
+
+#include "lfcas.h"
+
+//------------------------------------------------------------------------------
+//
+// Epoch-based Reclamation
+//
+//------------------------------------------------------------------------------
+
+//
+// Epoch-based reclamation is described by Keir Fraser in "Practical Lock-Freedom"
+// (http://www.cl.cam.ac.uk/techreports/UCAM-CL-TR-579.pdf).
+//
+// A thread announces the global epoch when it enters an operation, and
+// withdraws the announcement when it leaves.  The global epoch only advances
+// once every thread inside an operation has announced the current one.  A node
+// retired in epoch e was unlinked before any operation that started in epoch
+// e + 1, so once the epoch reaches e + 2, no operation can still be reading
+// it.  Retired nodes are kept in three buckets by epoch, and a bucket is
+// reclaimed as a whole.
+//
+// Compared to hazard pointers, an operation costs one fence on entry rather
+// than one per node read, and nodes are reclaimed in batches.  The price is
+// that a thread which stalls inside an operation stops the epoch, and with it
+// all reclamation.  A thread that stalls between operations does not.  To keep
+// memory bounded when the epoch is stuck, a thread with EPOCH_LIMBO_LIMIT nodes
+// waiting stops in Retire until it can reclaim some, so a stall slows the
+// retiring threads instead of growing without limit.  Where operations can be
+// preempted for long periods, prefer hazard pointers, which never block.
+//
+const size_t   EPOCH_LIMBO_LIMIT  = 16384;  // retired nodes per thread before Retire waits
+const uint32_t EPOCH_COLLECT_RATE = 64;     // retires between attempts to advance the epoch
+
+class EpochDomain
+{
+    struct Retired
+    {
+        void * pNode;
+        void (*pfnReclaim)(void * pNode, void * pContext);
+        void * pContext;
+    };
+
+    //
+    // A thread's announced epoch and retired nodes.  As with hazard pointers, the
+    // records are never freed while the domain exists, and are adopted by later
+    // threads.  The buckets are owned by the thread, but are locked, so that
+    // Synchronize can reclaim nodes retired by other threads.
+    //
+    struct Record
+    {
+        std::atomic<uint64_t> announced;    // 2 * epoch + 1 inside an operation, 0 outside
+        std::atomic<bool> fInUse;
+        Record * pNext;                     // immutable once the record is published
+        uint32_t cNesting;                  // only touched by the owning thread
+        uint32_t cRetires;                  // only touched by the owning thread
+
+        std::atomic_flag fLocked;
+        std::vector<Retired> aLimbo[3];     // by epoch % 3
+        uint64_t aLimboEpoch[3];
+        std::atomic<size_t> cLimbo;         // read by the owner without the lock
+
+        Record() : announced(0), fInUse(true), pNext(nullptr), cNesting(0), cRetires(0), cLimbo(0)
+        {
+            fLocked.clear();
+            aLimboEpoch[0] = aLimboEpoch[1] = aLimboEpoch[2] = 0;
+        }
+
+        void Lock()
+        {
+            while(fLocked.test_and_set(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        void Unlock()
+        {
+            fLocked.clear(std::memory_order_release);
+        }
+    };
+
+    // Releases the thread's record when the thread exits.
+    struct ThreadRecord
+    {
+        Record * pRecord = nullptr;
+
+        ~ThreadRecord()
+        {
+            if(nullptr != pRecord)
+            {
+                Instance().Release(pRecord);
+            }
+        }
+    };
+
+    std::atomic<uint64_t> _epoch;
+    std::atomic<Record *> _pRecords;
+
+    EpochDomain() : _epoch(1), _pRecords(nullptr) {}
+    ~EpochDomain();
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    Record * Acquire();
+    void Release(_In_ Record * pRecord);
+    bool TryAdvance();
+    void Collect(_In_ Record * pRecord);
+
+    static void ReclaimBucket(std::vector<Retired> & aBucket);
+
+    template<typename Tn>
+    static void DeleteNode(void * pNode, void *)
+    {
+        delete static_cast<Tn *>(pNode);
+    }
+
+public:
+    static EpochDomain & Instance();
+
+    // The calling thread's record, acquired on first use.
+    static Record * ThisThread();
+
+    static void Enter(_In_ Record * pRecord);
+    static void Leave(_In_ Record * pRecord);
+
+    static void Retire(_In_ void * pNode, void (*pfnReclaim)(void * pNode, void * pContext), void * pContext);
+
+    template<typename Tn>
+    static void Retire(_In_ Tn * pNode)
+    {
+        Retire(pNode, DeleteNode<Tn>, nullptr);
+    }
+
+    // Advance the epoch if possible, and reclaim whatever any thread has retired
+    // that is no longer in use.  This never waits, and can also be called
+    // periodically by a background thread.
+    static void Collect();
+
+    // Wait until every node retired by any thread before the call is reclaimed.
+    // Must not be called from inside an operation.
+    static void Synchronize();
+
+    friend struct ReclaimEpoch;
+};
+
+inline EpochDomain & EpochDomain::Instance()
+{
+    static EpochDomain s_domain;
+    return s_domain;
+}
+
+inline EpochDomain::~EpochDomain()
+{
+    //
+    // Every thread that used the domain has exited, so nothing is being read.
+    //
+    Record * pRecord = _pRecords.load(std::memory_order_acquire);
+    while(nullptr != pRecord)
+    {
+        for(auto & aBucket : pRecord->aLimbo)
+        {
+            ReclaimBucket(aBucket);
+        }
+
+        Record * pNext = pRecord->pNext;
+        delete pRecord;
+        pRecord = pNext;
+    }
+}
+
+inline EpochDomain::Record * EpochDomain::Acquire()
+{
+    for(Record * pRecord = _pRecords.load(std::memory_order_acquire); nullptr != pRecord; pRecord = pRecord->pNext)
+    {
+        bool fInUse = false;
+        if(!pRecord->fInUse.load(std::memory_order_relaxed) &&
+           pRecord->fInUse.compare_exchange_strong(fInUse, true, std::memory_order_acquire))
+        {
+            return pRecord;
+        }
+    }
+
+    Record * pRecord = new Record;
+    pRecord->pNext = _pRecords.load(std::memory_order_relaxed);
+    while(!_pRecords.compare_exchange_weak(pRecord->pNext, pRecord, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+
+    return pRecord;
+}
+
+inline void EpochDomain::Release(_In_ Record * pRecord)
+{
+    assert(0 == pRecord->cNesting);
+
+    TryAdvance();
+    Collect(pRecord);
+
+    pRecord->fInUse.store(false, std::memory_order_release);
+}
+
+inline EpochDomain::Record * EpochDomain::ThisThread()
+{
+    static thread_local ThreadRecord s_thread;
+    if(nullptr == s_thread.pRecord)
+    {
+        s_thread.pRecord = Instance().Acquire();
+    }
+    return s_thread.pRecord;
+}
+
+inline void EpochDomain::Enter(_In_ Record * pRecord)
+{
+    if(0 == pRecord->cNesting++)
+    {
+        uint64_t epoch = Instance()._epoch.load(std::memory_order_relaxed);
+        pRecord->announced.store(2 * epoch + 1, std::memory_order_relaxed);
+
+        // Pairs with the fence in TryAdvance.  Either that thread sees this
+        // announcement, or this thread reads nothing that was unlinked before
+        // the epoch advanced.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+inline void EpochDomain::Leave(_In_ Record * pRecord)
+{
+    assert(pRecord->cNesting > 0);
+
+    if(0 == --pRecord->cNesting)
+    {
+        pRecord->announced.store(0, std::memory_order_release);
+    }
+}
+
+inline bool EpochDomain::TryAdvance()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    uint64_t epoch = _epoch.load(std::memory_order_relaxed);
+    for(Record * pRecord = _pRecords.load(std::memory_order_acquire); nullptr != pRecord; pRecord = pRecord->pNext)
+    {
+        uint64_t announced = pRecord->announced.load(std::memory_order_acquire);
+        if(0 != announced && announced != 2 * epoch + 1)
+        {
+            return false;
+        }
+    }
+
+    return _epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+}
+
+inline void EpochDomain::ReclaimBucket(std::vector<Retired> & aBucket)
+{
+    for(const Retired & retired : aBucket)
+    {
+        retired.pfnReclaim(retired.pNode, retired.pContext);
+    }
+    aBucket.clear();
+}
+
+inline void EpochDomain::Collect(_In_ Record * pRecord)
+{
+    uint64_t epoch = _epoch.load(std::memory_order_acquire);
+
+    pRecord->Lock();
+    for(int ii = 0; ii < 3; ++ii)
+    {
+        if(pRecord->aLimboEpoch[ii] + 2 <= epoch)
+        {
+            pRecord->cLimbo.fetch_sub(pRecord->aLimbo[ii].size(), std::memory_order_relaxed);
+            ReclaimBucket(pRecord->aLimbo[ii]);
+        }
+    }
+    pRecord->Unlock();
+}
+
+inline void EpochDomain::Retire(_In_ void * pNode, void (*pfnReclaim)(void * pNode, void * pContext), void * pContext)
+{
+    EpochDomain & domain = Instance();
+    Record * pRecord = ThisThread();
+
+    //
+    // The node has been unlinked, so any operation that starts after this
+    // reads the epoch can't find it.
+    //
+    uint64_t epoch = domain._epoch.load(std::memory_order_acquire);
+    int ixBucket = static_cast<int>(epoch % 3);
+
+    pRecord->Lock();
+    if(pRecord->aLimboEpoch[ixBucket] != epoch)
+    {
+        // The bucket was filled at least three epochs ago.
+        pRecord->cLimbo.fetch_sub(pRecord->aLimbo[ixBucket].size(), std::memory_order_relaxed);
+        ReclaimBucket(pRecord->aLimbo[ixBucket]);
+        pRecord->aLimboEpoch[ixBucket] = epoch;
+    }
+    pRecord->aLimbo[ixBucket].push_back(Retired{ pNode, pfnReclaim, pContext });
+    pRecord->cLimbo.fetch_add(1, std::memory_order_relaxed);
+    pRecord->Unlock();
+
+    if(0 == ++pRecord->cRetires % EPOCH_COLLECT_RATE)
+    {
+        domain.TryAdvance();
+        domain.Collect(pRecord);
+    }
+
+    //
+    // Apply backpressure if the epoch is stuck.  A thread inside an operation
+    // can't wait, as it may be what is holding the epoch back.
+    //
+    while(pRecord->cLimbo.load(std::memory_order_relaxed) >= EPOCH_LIMBO_LIMIT && 0 == pRecord->cNesting)
+    {
+        if(!domain.TryAdvance())
+        {
+            std::this_thread::yield();
+        }
+        domain.Collect(pRecord);
+    }
+}
+
+inline void EpochDomain::Collect()
+{
+    EpochDomain & domain = Instance();
+
+    // Nodes retired in the current epoch need two advances.
+    domain.TryAdvance();
+    domain.TryAdvance();
+
+    for(Record * pRecord = domain._pRecords.load(std::memory_order_acquire); nullptr != pRecord; pRecord = pRecord->pNext)
+    {
+        domain.Collect(pRecord);
+    }
+}
+
+inline void EpochDomain::Synchronize()
+{
+    EpochDomain & domain = Instance();
+    assert(0 == ThisThread()->cNesting);
+
+    uint64_t target = domain._epoch.load(std::memory_order_acquire) + 2;
+    while(domain._epoch.load(std::memory_order_acquire) < target)
+    {
+        if(!domain.TryAdvance())
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    for(Record * pRecord = domain._pRecords.load(std::memory_order_acquire); nullptr != pRecord; pRecord = pRecord->pNext)
+    {
+        domain.Collect(pRecord);
+    }
+}
+
+//
+// Reclamation policy for the containers (see ReclaimNone in lfcas.h).
+//
+struct ReclaimEpoch
+{
+    class Guard
+    {
+        EpochDomain::Record * _pRecord;
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    public:
+        Guard() : _pRecord(EpochDomain::ThisThread())
+        {
+            EpochDomain::Enter(_pRecord);
+        }
+
+        ~Guard()
+        {
+            EpochDomain::Leave(_pRecord);
+        }
+
+        // Everything read while the guard is held is protected.
+        template<typename Tn>
+        Tn * Protect(int, Tn * volatile const & pSource)
+        {
+            return AtomicLoad(pSource);
+        }
+    };
+
+    template<typename Tn>
+    static void Retire(_In_ Tn * pNode)
+    {
+        EpochDomain::Retire(pNode);
+    }
+
+    static void Retire(_In_ void * pNode, void (*pfnReclaim)(void * pNode, void * pContext), void * pContext)
+    {
+        EpochDomain::Retire(pNode, pfnReclaim, pContext);
+    }
+
+    static void Collect()
+    {
+        EpochDomain::Collect();
+    }
+
+    static void Synchronize()
+    {
+        EpochDomain::Synchronize();
+    }
+};
+
+#endif
+
@@ -2,13 +2,52 @@
 #define LFFREELIST_H
 
 #include "lfstack.h"
+#include "lfslab.h"
 
 //------------------------------------------------------------------------------
 //
 // Parameterized Lock-free Freelist
 //
 //------------------------------------------------------------------------------
-template<typename Ty>
+//
+// With a Reclaim policy other than ReclaimNone (such as ReclaimEpoch), a freed
+// instance is only returned to the list once no thread can still be reading
+// it, so other threads may hold pointers to an instance while inside a
+// Reclaim::Guard, even as it is freed.
+//
+// The instances are carved from slabs (see lfslab.h) of cObjects instances
+// each, or more if the slab was rounded up to a whole huge page.  A list
+// created with cMaxObjects larger than cObjects adds another slab when it
+// runs out of instances, until it holds cMaxObjects instances, so the list
+// can start small and grow to what the program turns out to need.  Any
+// thread can add a slab, without a lock: a thread first reserves the slab's
+// instances with a CAS on the count, so the list never passes cMaxObjects,
+// and then keeps one instance of the new slab and pushes the rest onto the
+// list with one CAS.  Slabs are only freed with the list.
+//
+// Each NewInstance and FreeInstance is a CAS on the head of the shared list,
+// so threads that allocate and free at a high rate contend for its cache
+// line, even when each thread only frees what it allocated.  A list created
+// with a magazine size keeps a magazine (a small private stack of free
+// instances) for each thread that uses it.  NewInstance and FreeInstance then
+// work on the calling thread's magazine, and only go to the shared list to
+// refill an empty magazine or to flush a full one, cMagazine instances at a
+// time and with one CAS.  A magazine holds up to twice cMagazine instances,
+// so that a thread that frees and allocates in turn does not flush and
+// refill every time.
+//
+// With a Reclaim policy other than ReclaimNone, FreeInstance only fills the
+// magazines indirectly: an instance is reclaimed by whichever thread happens
+// to collect it, which may be a background thread or a thread that is
+// exiting, so reclaimed instances always go back to the shared list.
+//
+// Instances in one thread's magazine can't be allocated by another thread,
+// so NewInstance may return nullptr while other magazines hold free
+// instances.  A thread can return its magazine to the shared list with
+// Flush.  The magazine of a thread that exits without flushing is kept for
+// the next thread that gets the same std::thread::id.
+//
+template<typename Ty, typename Reclaim = ReclaimNone>
 class LockFreeFreeList
 {
     //
@@ -18,9 +57,36 @@ class LockFreeFreeList
     // object's lifetime.  Any thread synchronization should be done at that
     // point.
     //
+    // The nodes are never freed while the list exists, so the stack needs no
+    // reclamation of its own; its tags are enough.
+    //
     LockFreeStack<Ty> _Freelist;
-    node<Ty> * _pObjects;
-    const uint32_t _cObjects;
+
+    struct Chunk
+    {
+        Slab slab;
+        Chunk * pNext;      // immutable once the chunk is published
+    };
+
+    const uint32_t _cChunk;         // instances per slab
+    const uint32_t _cMaxObjects;
+    const uint32_t _slabFlags;
+    std::atomic<uint32_t> _cObjects;
+    std::atomic<Chunk *> _pChunks;
+
+    // A magazine is only used by the thread whose id it holds.  Magazines are
+    // never freed while the list exists.
+    struct Magazine
+    {
+        std::thread::id owner;
+        Magazine * pNext;       // immutable once the magazine is published
+        uint32_t cNodes;
+        std::unique_ptr<node<Ty> *[]> apNodes;
+    };
+
+    const uint32_t _cMagazine;
+    const uint64_t _id;         // never reused, unlike the list's address
+    std::atomic<Magazine *> _pMagazines;
 
     // Not implemented to prevent accidental copying/moving.
     LockFreeFreeList(const LockFreeFreeList&) = delete;
@@ -28,67 +94,353 @@ class LockFreeFreeList
     LockFreeFreeList& operator=(const LockFreeFreeList&) = delete;
     LockFreeFreeList& operator=(LockFreeFreeList&&) noexcept = delete;
 
+    static void ReturnInstance(void * pNode, void * pContext);
+
+    node<Ty> * Grow();
+    Magazine * ThisMagazine();
+    node<Ty> * Allocate();
+    void Refill(_Inout_ Magazine * pMagazine);
+    void Flush(_Inout_ Magazine * pMagazine, uint32_t cNodes);
+
 public:
-    LockFreeFreeList(uint32_t cObjects);
+    // cMagazine is the number of instances moved between a thread's magazine
+    // and the shared list at a time, or 0 for no magazines.  cMaxObjects is 0
+    // for a list that never grows, or FREELIST_UNBOUNDED for a list that grows
+    // until memory runs out.  slabFlags are the SLAB_ flags.
+    LockFreeFreeList(uint32_t cObjects, uint32_t cMagazine = 0, uint32_t cMaxObjects = 0, uint32_t slabFlags = 0);
     ~LockFreeFreeList() noexcept;
-    void FreeAll();
-    Ty * NewInstance();
+    void FreeAll();         // only when no other thread is using the list
+    Ty * NewInstance();     // returns nullptr if every instance is in use and the list can't grow
     void FreeInstance(_In_ Ty * pInstance);
+
+    // Return the calling thread's magazine to the shared list.
+    void Flush();
+
+    // The number of instances in the list's slabs.
+    uint32_t Capacity() const { return _cObjects.load(std::memory_order_relaxed); }
 };
 
+const uint32_t FREELIST_UNBOUNDED = UINT32_MAX;
+
+// Identifies a freelist for the magazine lookup in each thread.
+inline uint64_t NextFreeListId()
+{
+    static std::atomic<uint64_t> s_id(0);
+    return s_id.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
 //
 // cObjects is passed to the constructor instead of a template parameter
 // to minimize the code bloat of multiple freelists with varying sizes,
 // but each using the same underlying type.
 //
-template<typename Ty>
-LockFreeFreeList<Ty>::LockFreeFreeList(uint32_t cObjects) : _cObjects(cObjects)
+template<typename Ty, typename Reclaim>
+LockFreeFreeList<Ty, Reclaim>::LockFreeFreeList(uint32_t cObjects, uint32_t cMagazine, uint32_t cMaxObjects, uint32_t slabFlags) :
+    _cChunk(cObjects), _cMaxObjects(std::max(cObjects, cMaxObjects)), _slabFlags(slabFlags),
+    _cObjects(0), _pChunks(nullptr), _cMagazine(cMagazine), _id(NextFreeListId()), _pMagazines(nullptr)
 {
+    assert(cObjects > 0);
+
     //
     // The Freelist may live on the stack, so we allocate the
     // actual nodes on the heap to minimize the space hit.
     //
-    _pObjects = new node<Ty>[cObjects];
-    FreeAll();
+    node<Ty> * pNode = Grow();
+    if(nullptr == pNode)
+    {
+        throw std::bad_alloc();
+    }
+    _Freelist.Push(pNode);
 }
 
-template<typename Ty>
-LockFreeFreeList<Ty>::~LockFreeFreeList()
+template<typename Ty, typename Reclaim>
+LockFreeFreeList<Ty, Reclaim>::~LockFreeFreeList() noexcept
 {
+    // Wait for freed instances that are still waiting to be reclaimed.
+    Reclaim::Synchronize();
+
 #ifndef NDEBUG
-    for(uint32_t ix = 0; ix < _cObjects; ++ix)
+    uint32_t cFree = 0;
+    while(_Freelist.Pop() != nullptr)
     {
-        assert(_Freelist.Pop() != nullptr);
+        ++cFree;
     }
+    for(Magazine * pMagazine = _pMagazines.load(std::memory_order_acquire); nullptr != pMagazine; pMagazine = pMagazine->pNext)
+    {
+        cFree += pMagazine->cNodes;
+    }
+    assert(cFree == _cObjects.load());
 #endif
 
-    delete[] _pObjects;
+    Magazine * pMagazine = _pMagazines.load(std::memory_order_acquire);
+    while(nullptr != pMagazine)
+    {
+        Magazine * pNext = pMagazine->pNext;
+        delete pMagazine;
+        pMagazine = pNext;
+    }
+
+    // Every instance was destroyed when it was freed, so only the memory is left.
+    Chunk * pChunk = _pChunks.load(std::memory_order_acquire);
+    while(nullptr != pChunk)
+    {
+        Chunk * pNext = pChunk->pNext;
+        FreeSlab(pChunk->slab);
+        delete pChunk;
+        pChunk = pNext;
+    }
 }
 
-template<typename Ty>
-void LockFreeFreeList<Ty>::FreeAll()
+template<typename Ty, typename Reclaim>
+void LockFreeFreeList<Ty, Reclaim>::FreeAll()
 {
-    for(uint32_t ix = 0; ix < _cObjects; ++ix)
+    //
+    // Every instance is pushed below, so first empty the list, including the
+    // instances that are still waiting to be reclaimed.  Pushing a node that
+    // is already on the list would make the list cyclic.
+    //
+    Reclaim::Synchronize();
+    while(nullptr != _Freelist.Pop())
+    {
+    }
+
+    for(Magazine * pMagazine = _pMagazines.load(std::memory_order_acquire); nullptr != pMagazine; pMagazine = pMagazine->pNext)
+    {
+        pMagazine->cNodes = 0;
+    }
+
+    for(Chunk * pChunk = _pChunks.load(std::memory_order_acquire); nullptr != pChunk; pChunk = pChunk->pNext)
     {
-        _Freelist.Push(&_pObjects[ix]);
+        node<Ty> * aNodes = static_cast<node<Ty> *>(pChunk->slab.pMemory);
+        const uint32_t cNodes = static_cast<uint32_t>(pChunk->slab.cbMemory / sizeof(node<Ty>));
+        for(uint32_t ix = 0; ix < cNodes; ++ix)
+        {
+            _Freelist.Push(&aNodes[ix]);
+        }
     }
 }
 
-template<typename Ty>
-Ty * LockFreeFreeList<Ty>::NewInstance()
+template<typename Ty, typename Reclaim>
+node<Ty> * LockFreeFreeList<Ty, Reclaim>::Grow()
 {
-    node<Ty> * pInstance = _Freelist.Pop();
+    //
+    // Reserve the instances first, so that threads growing the list at the
+    // same time can't take it past its limit.  The last slab is smaller if
+    // that is all the limit leaves room for.
+    //
+    uint32_t cObjects = _cObjects.load(std::memory_order_relaxed);
+    uint32_t cNodes;
+    do
+    {
+        cNodes = std::min(_cChunk, _cMaxObjects - cObjects);
+        if(0 == cNodes)
+        {
+            return nullptr;
+        }
+    } while(!_cObjects.compare_exchange_weak(cObjects, cObjects + cNodes, std::memory_order_relaxed));
+
+    Chunk * pChunk = new(std::nothrow) Chunk;
+    if(nullptr == pChunk || !AllocateSlab(cNodes * sizeof(node<Ty>), _slabFlags, pChunk->slab))
+    {
+        delete pChunk;
+        _cObjects.fetch_sub(cNodes, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    //
+    // A slab of huge pages is rounded up to a whole page, so reserve as many
+    // more instances as fit in the rest of it, as far as the limit allows.
+    //
+    const size_t cbUsable = pChunk->slab.cbBase - (static_cast<char *>(pChunk->slab.pMemory) - static_cast<char *>(pChunk->slab.pBase));
+    const uint32_t cFit = static_cast<uint32_t>(std::min<size_t>(cbUsable / sizeof(node<Ty>), UINT32_MAX));
+    if(cFit > cNodes)
+    {
+        cObjects = _cObjects.load(std::memory_order_relaxed);
+        uint32_t cExtra;
+        do
+        {
+            cExtra = std::min(cFit - cNodes, _cMaxObjects - cObjects);
+        } while(cExtra > 0 && !_cObjects.compare_exchange_weak(cObjects, cObjects + cExtra, std::memory_order_relaxed));
+        cNodes += cExtra;
+        pChunk->slab.cbMemory = cNodes * sizeof(node<Ty>);
+    }
+
+    pChunk->pNext = _pChunks.load(std::memory_order_relaxed);
+    while(!_pChunks.compare_exchange_weak(pChunk->pNext, pChunk, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+
+    //
+    // The values are constructed by NewInstance, so only the links are
+    // written here.  Keep the first node, and push the rest as one chain.
+    //
+    node<Ty> * aNodes = static_cast<node<Ty> *>(pChunk->slab.pMemory);
+    if(cNodes > 1)
+    {
+        for(uint32_t ix = 1; ix + 1 < cNodes; ++ix)
+        {
+            aNodes[ix].pNext = &aNodes[ix + 1];
+        }
+        _Freelist.PushMany(&aNodes[1], &aNodes[cNodes - 1]);
+    }
+    return &aNodes[0];
+}
+
+template<typename Ty, typename Reclaim>
+typename LockFreeFreeList<Ty, Reclaim>::Magazine * LockFreeFreeList<Ty, Reclaim>::ThisMagazine()
+{
+    //
+    // Remember the last magazine that the thread used.  A thread that moves
+    // between lists finds its magazine again by its id.
+    //
+    struct LastMagazine
+    {
+        uint64_t idList;
+        Magazine * pMagazine;
+    };
+    static thread_local LastMagazine s_last = { 0, nullptr };
+    if(s_last.idList == _id)
+    {
+        return s_last.pMagazine;
+    }
+
+    const std::thread::id owner = std::this_thread::get_id();
+    Magazine * pMagazine = _pMagazines.load(std::memory_order_acquire);
+    while(nullptr != pMagazine && pMagazine->owner != owner)
+    {
+        pMagazine = pMagazine->pNext;
+    }
+
+    if(nullptr == pMagazine)
+    {
+        pMagazine = new Magazine;
+        pMagazine->owner = owner;
+        pMagazine->cNodes = 0;
+        pMagazine->apNodes.reset(new node<Ty> *[2 * _cMagazine]);
+        pMagazine->pNext = _pMagazines.load(std::memory_order_relaxed);
+        while(!_pMagazines.compare_exchange_weak(pMagazine->pNext, pMagazine, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    s_last.idList = _id;
+    s_last.pMagazine = pMagazine;
+    return pMagazine;
+}
+
+template<typename Ty, typename Reclaim>
+void LockFreeFreeList<Ty, Reclaim>::Refill(_Inout_ Magazine * pMagazine)
+{
+    assert(0 == pMagazine->cNodes);
+
+    node<Ty> * pNode;
+    const uint32_t cNodes = _Freelist.PopMany(_cMagazine, pNode);
+    for(uint32_t ix = 0; ix < cNodes; ++ix)
+    {
+        pMagazine->apNodes[ix] = pNode;
+        pNode = pNode->pNext;
+    }
+    pMagazine->cNodes = cNodes;
+}
+
+template<typename Ty, typename Reclaim>
+void LockFreeFreeList<Ty, Reclaim>::Flush(_Inout_ Magazine * pMagazine, uint32_t cNodes)
+{
+    assert(cNodes > 0 && cNodes <= pMagazine->cNodes);
+
+    // Link the top cNodes of the magazine, and push them with one CAS.
+    node<Ty> ** apNodes = &pMagazine->apNodes[pMagazine->cNodes - cNodes];
+    for(uint32_t ix = 0; ix + 1 < cNodes; ++ix)
+    {
+        AtomicStore(apNodes[ix]->pNext, apNodes[ix + 1], std::memory_order_relaxed);
+    }
+    _Freelist.PushMany(apNodes[0], apNodes[cNodes - 1]);
+    pMagazine->cNodes -= cNodes;
+}
+
+template<typename Ty, typename Reclaim>
+void LockFreeFreeList<Ty, Reclaim>::Flush()
+{
+    if(_cMagazine > 0)
+    {
+        Magazine * pMagazine = ThisMagazine();
+        if(pMagazine->cNodes > 0)
+        {
+            Flush(pMagazine, pMagazine->cNodes);
+        }
+    }
+}
+
+template<typename Ty, typename Reclaim>
+node<Ty> * LockFreeFreeList<Ty, Reclaim>::Allocate()
+{
+    if(0 == _cMagazine)
+    {
+        return _Freelist.Pop();
+    }
+
+    Magazine * pMagazine = ThisMagazine();
+    if(0 == pMagazine->cNodes)
+    {
+        Refill(pMagazine);
+        if(0 == pMagazine->cNodes)
+        {
+            return nullptr;
+        }
+    }
+    return pMagazine->apNodes[--pMagazine->cNodes];
+}
+
+// The calling thread is not necessarily the one that freed the instance, so
+// the instance goes to the shared list rather than to a magazine.
+template<typename Ty, typename Reclaim>
+void LockFreeFreeList<Ty, Reclaim>::ReturnInstance(void * pNode, void * pContext)
+{
+    static_cast<LockFreeFreeList *>(pContext)->_Freelist.Push(static_cast<node<Ty> *>(pNode));
+}
+
+template<typename Ty, typename Reclaim>
+Ty * LockFreeFreeList<Ty, Reclaim>::NewInstance()
+{
+    node<Ty> * pInstance = Allocate();
+    if(nullptr == pInstance)
+    {
+        // Freed instances may be waiting to be reclaimed.
+        Reclaim::Collect();
+        pInstance = Allocate();
+        if(nullptr == pInstance)
+        {
+            pInstance = Grow();
+            if(nullptr == pInstance)
+            {
+                return nullptr;
+            }
+        }
+    }
     return new(&pInstance->value) Ty;
 }
 
 // This is the best annotation possible given that the code hides
 // that a node structure is actually what is being passed.
 // This will not prevent an unwrapped 'Ty' from being passed.
-template<typename Ty>
-void LockFreeFreeList<Ty>::FreeInstance(_In_bytecount_c_(sizeof node<Ty>) Ty * pInstance)
+template<typename Ty, typename Reclaim>
+void LockFreeFreeList<Ty, Reclaim>::FreeInstance(_In_bytecount_c_(sizeof node<Ty>) Ty * pInstance)
 {
     pInstance->~Ty();
-    _Freelist.Push(reinterpret_cast<node<Ty> *>(pInstance));
+    node<Ty> * pNode = reinterpret_cast<node<Ty> *>(pInstance);
+
+    if(!std::is_same<Reclaim, ReclaimNone>::value || 0 == _cMagazine)
+    {
+        Reclaim::Retire(pNode, ReturnInstance, this);
+        return;
+    }
+
+    Magazine * pMagazine = ThisMagazine();
+    if(2 * _cMagazine == pMagazine->cNodes)
+    {
+        Flush(pMagazine, _cMagazine);
+    }
+    pMagazine->apNodes[pMagazine->cNodes++] = pNode;
 }
 
 #endif
@@ -0,0 +1,387 @@
+#ifndef LFHAZARD_H
+#define LFHAZARD_H
+
+#include "lfcas.h"
+
+//------------------------------------------------------------------------------
+//
+// Hazard Pointers
+//
+//------------------------------------------------------------------------------
+
+//
+// Hazard pointers are described by Maged Michael in "Hazard Pointers: Safe
+// Memory Reclamation for Lock-Free Objects"
+// (http://researchweb.watson.ibm.com/people/m/michael/ieeetpds-2004.pdf).
+//
+// Before a thread dereferences a shared node, it publishes the node's address
+// in one of its hazard pointers, and then checks that the node is still
+// reachable.  A node that has been removed is retired onto a list owned by the
+// retiring thread, and when the list grows long enough, the thread scans every
+// published hazard pointer and frees the retired nodes that none of them name.
+// Scanning only when the list is twice the total number of hazard pointers
+// frees at least half of the list each time, so the cost of a scan is spread
+// over the retires that led to it.
+//
+const int HAZARDS_PER_THREAD = 2;   // the queue protects the head and the node after it
+
+class HazardDomain
+{
+    struct Retired
+    {
+        void * pNode;
+        void (*pfnReclaim)(void * pNode, void * pContext);
+        void * pContext;
+        uint64_t seq;       // the record's count of retires, when this one was retired
+    };
+
+    //
+    // A thread's hazard pointers and retired list.  Records are never freed while
+    // the domain exists.  When a thread exits, its record is marked inactive, and
+    // the next thread to need a record adopts it along with any nodes that were
+    // still protected when the last owner exited.  The retired list is owned by
+    // the thread, but is locked, so that Synchronize can scan the lists of
+    // threads that are still running.
+    //
+    struct Record
+    {
+        std::atomic<void *> apHazards[HAZARDS_PER_THREAD];
+        std::atomic<bool> fActive;
+        Record * pNext;                 // immutable once the record is published
+
+        std::atomic_flag fLocked;
+        std::vector<Retired> aRetired;
+        uint64_t cRetires;
+
+        Record() : fActive(true), pNext(nullptr), cRetires(0)
+        {
+            fLocked.clear();
+            for(auto & pHazard : apHazards)
+            {
+                pHazard.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        void Lock()
+        {
+            while(fLocked.test_and_set(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        void Unlock()
+        {
+            fLocked.clear(std::memory_order_release);
+        }
+    };
+
+    // Releases the thread's record when the thread exits.
+    struct ThreadRecord
+    {
+        Record * pRecord = nullptr;
+
+        ~ThreadRecord()
+        {
+            if(nullptr != pRecord)
+            {
+                Instance().Release(pRecord);
+            }
+        }
+    };
+
+    std::atomic<Record *> _pRecords;
+    std::atomic<uint32_t> _cRecords;
+
+    HazardDomain() : _pRecords(nullptr), _cRecords(0) {}
+    ~HazardDomain();
+
+    HazardDomain(const HazardDomain&) = delete;
+    HazardDomain& operator=(const HazardDomain&) = delete;
+
+    Record * Acquire();
+    void Release(_In_ Record * pRecord);
+    bool Scan(_In_ Record * pRecord, uint64_t seqWait = 0);
+
+    template<typename Tn>
+    static void DeleteNode(void * pNode, void *)
+    {
+        delete static_cast<Tn *>(pNode);
+    }
+
+public:
+    static HazardDomain & Instance();
+
+    // The calling thread's record, acquired on first use.
+    static Record * ThisThread();
+
+    static void Retire(_In_ void * pNode, void (*pfnReclaim)(void * pNode, void * pContext), void * pContext);
+
+    template<typename Tn>
+    static void Retire(_In_ Tn * pNode)
+    {
+        Retire(pNode, DeleteNode<Tn>, nullptr);
+    }
+
+    // Free whatever the calling thread has retired that is no longer protected.
+    static void Collect();
+
+    // Wait until everything that any thread retired before the call has been
+    // freed.  Not for use inside a guard, whose own hazard pointers would keep
+    // it waiting.
+    static void Synchronize();
+
+    friend struct ReclaimHazard;
+};
+
+inline HazardDomain & HazardDomain::Instance()
+{
+    static HazardDomain s_domain;
+    return s_domain;
+}
+
+inline HazardDomain::~HazardDomain()
+{
+    //
+    // Every thread that used the domain has exited, so nothing is protected.
+    //
+    Record * pRecord = _pRecords.load(std::memory_order_acquire);
+    while(nullptr != pRecord)
+    {
+        for(const Retired & retired : pRecord->aRetired)
+        {
+            retired.pfnReclaim(retired.pNode, retired.pContext);
+        }
+
+        Record * pNext = pRecord->pNext;
+        delete pRecord;
+        pRecord = pNext;
+    }
+}
+
+inline HazardDomain::Record * HazardDomain::Acquire()
+{
+    for(Record * pRecord = _pRecords.load(std::memory_order_acquire); nullptr != pRecord; pRecord = pRecord->pNext)
+    {
+        bool fActive = false;
+        if(!pRecord->fActive.load(std::memory_order_relaxed) &&
+           pRecord->fActive.compare_exchange_strong(fActive, true, std::memory_order_acquire))
+        {
+            return pRecord;
+        }
+    }
+
+    Record * pRecord = new Record;
+    pRecord->pNext = _pRecords.load(std::memory_order_relaxed);
+    while(!_pRecords.compare_exchange_weak(pRecord->pNext, pRecord, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    _cRecords.fetch_add(1, std::memory_order_relaxed);
+
+    return pRecord;
+}
+
+inline void HazardDomain::Release(_In_ Record * pRecord)
+{
+    for(auto & pHazard : pRecord->apHazards)
+    {
+        pHazard.store(nullptr, std::memory_order_release);
+    }
+    Scan(pRecord);
+
+    pRecord->fActive.store(false, std::memory_order_release);
+}
+
+inline HazardDomain::Record * HazardDomain::ThisThread()
+{
+    static thread_local ThreadRecord s_thread;
+    if(nullptr == s_thread.pRecord)
+    {
+        s_thread.pRecord = Instance().Acquire();
+    }
+    return s_thread.pRecord;
+}
+
+// Returns true if a node retired at or before seqWait is still protected.
+inline bool HazardDomain::Scan(_In_ Record * pRecord, uint64_t seqWait)
+{
+    //
+    // When this thread is not the record's owner, the owner may retire more
+    // nodes during the scan.  Only the nodes retired before the fence were
+    // already unlinked when the hazard pointers were read.
+    //
+    pRecord->Lock();
+    const uint64_t seqScan = pRecord->cRetires;
+    pRecord->Unlock();
+
+    //
+    // Pairs with the fence in Protect.  Either the protecting thread sees that the
+    // node was removed and tries again, or this thread sees its hazard pointer.
+    //
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    std::vector<void *> apHazards;
+    apHazards.reserve(_cRecords.load(std::memory_order_relaxed) * HAZARDS_PER_THREAD);
+    for(Record * pOther = _pRecords.load(std::memory_order_acquire); nullptr != pOther; pOther = pOther->pNext)
+    {
+        for(auto & pHazard : pOther->apHazards)
+        {
+            void * pNode = pHazard.load(std::memory_order_acquire);
+            if(nullptr != pNode)
+            {
+                apHazards.push_back(pNode);
+            }
+        }
+    }
+    std::sort(std::begin(apHazards), std::end(apHazards));
+
+    //
+    // Free the unprotected nodes, and keep the rest for the next scan.
+    //
+    bool fWaiting = false;
+    pRecord->Lock();
+    std::vector<Retired> & aRetired = pRecord->aRetired;
+    auto itKeep = std::begin(aRetired);
+    for(const Retired & retired : aRetired)
+    {
+        if(retired.seq > seqScan)
+        {
+            *itKeep++ = retired;
+        }
+        else if(std::binary_search(std::begin(apHazards), std::end(apHazards), retired.pNode))
+        {
+            *itKeep++ = retired;
+            fWaiting = fWaiting || retired.seq <= seqWait;
+        }
+        else
+        {
+            retired.pfnReclaim(retired.pNode, retired.pContext);
+        }
+    }
+    aRetired.erase(itKeep, std::end(aRetired));
+    pRecord->Unlock();
+
+    return fWaiting;
+}
+
+inline void HazardDomain::Retire(_In_ void * pNode, void (*pfnReclaim)(void * pNode, void * pContext), void * pContext)
+{
+    HazardDomain & domain = Instance();
+    Record * pRecord = ThisThread();
+
+    pRecord->Lock();
+    pRecord->aRetired.push_back(Retired{ pNode, pfnReclaim, pContext, ++pRecord->cRetires });
+    const size_t cRetired = pRecord->aRetired.size();
+    pRecord->Unlock();
+
+    const size_t cScan = 2 * HAZARDS_PER_THREAD * domain._cRecords.load(std::memory_order_relaxed);
+    if(cRetired >= std::max<size_t>(cScan, 64))
+    {
+        domain.Scan(pRecord);
+    }
+}
+
+inline void HazardDomain::Collect()
+{
+    Instance().Scan(ThisThread());
+}
+
+inline void HazardDomain::Synchronize()
+{
+    HazardDomain & domain = Instance();
+
+    //
+    // Scan every record, whether or not its thread is running, until none of
+    // them holds a node that was retired before the call.  Nodes retired after
+    // the call don't hold this up, so threads that keep retiring can't keep
+    // Synchronize waiting.  A record published after the call holds none.
+    //
+    for(Record * pRecord = domain._pRecords.load(std::memory_order_acquire); nullptr != pRecord; pRecord = pRecord->pNext)
+    {
+        pRecord->Lock();
+        const uint64_t seqWait = pRecord->cRetires;
+        pRecord->Unlock();
+
+        while(domain.Scan(pRecord, seqWait))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+//
+// Reclamation policy for the containers (see ReclaimNone in lfcas.h).
+//
+struct ReclaimHazard
+{
+    class Guard
+    {
+        HazardDomain::Record * _pRecord;
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    public:
+        Guard() : _pRecord(HazardDomain::ThisThread()) {}
+
+        ~Guard()
+        {
+            for(auto & pHazard : _pRecord->apHazards)
+            {
+                pHazard.store(nullptr, std::memory_order_release);
+            }
+        }
+
+        //
+        // Read a shared pointer and protect the node it points to with hazard
+        // pointer ixHazard.  The pointer is read again after the hazard pointer is
+        // published, and if it has not changed, the node was still reachable when
+        // any later scan began, so it will not be freed until the guard moves on.
+        //
+        template<typename Tn>
+        Tn * Protect(int ixHazard, Tn * volatile const & pSource)
+        {
+            assert(ixHazard >= 0 && ixHazard < HAZARDS_PER_THREAD);
+
+            Tn * pNode = AtomicLoad(pSource, std::memory_order_relaxed);
+            for(;;)
+            {
+                // Release, so that a scan that reads this hazard pointer also
+                // sees everything this thread read under the one before it.
+                _pRecord->apHazards[ixHazard].store(pNode, std::memory_order_release);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                Tn * pCheck = AtomicLoad(pSource);
+                if(pCheck == pNode)
+                {
+                    return pNode;
+                }
+                pNode = pCheck;
+            }
+        }
+    };
+
+    template<typename Tn>
+    static void Retire(_In_ Tn * pNode)
+    {
+        HazardDomain::Retire(pNode);
+    }
+
+    static void Retire(_In_ void * pNode, void (*pfnReclaim)(void * pNode, void * pContext), void * pContext)
+    {
+        HazardDomain::Retire(pNode, pfnReclaim, pContext);
+    }
+
+    static void Collect()
+    {
+        HazardDomain::Collect();
+    }
+
+    static void Synchronize()
+    {
+        HazardDomain::Synchronize();
+    }
+};
+
+#endif
+
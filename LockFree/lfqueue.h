@@ -8,54 +8,95 @@
 // Parameterized Lock-free Queue
 //
 //------------------------------------------------------------------------------
-template<typename Ty>
+// This is the queue described by Maged Michael and Michael Scott in "Simple,
+// Fast, and Practical Non-Blocking and Blocking Concurrent Queue Algorithms"
+// (http://www.cs.rochester.edu/u/scott/papers/1996_PODC_queue.pdf).  The head
+// always points at a dummy node, and the first value is in the node after it.
+//
+// Remove moves the value out of the node after the head once it has made that
+// node the new dummy, so Ty only needs to be movable.  The node returned by
+// Remove is the old dummy, which holds no value.  Other threads may still be
+// reading it, or moving the value out of it, so it must be freed with Retire
+// rather than delete or reused (see the reclamation policies in lfcas.h).
+// With ReclaimNone, removed nodes can't be reused until the queue is no longer
+// in use.
+//
+// Threads that add values write the tail, and threads that remove values write
+// the head, so with PaddedLayout they are kept on separate cache lines (see
+// the layout policies in lfcas.h).
+//
+// The queue can't hold intrusive nodes (node<void>).  A removed value's node
+// stays in the queue as the new dummy, so the value has to be moved out of it.
+template<typename Ty, typename Reclaim = ReclaimNone, typename Layout = PackedLayout>
 class LockFreeQueue {
+    static_assert(!std::is_void<Ty>::value, "The queue keeps each removed value's node as its dummy, so it can't hold intrusive nodes.");
+    static_assert(Layout::ALIGNMENT >= CAS2_ALIGNMENT, "The head and tail must be aligned for CAS2.");
+
     // NOTE: the order of these members is assumed by CAS2.
-    node<Ty> * volatile _pHead;
+    alignas(Layout::ALIGNMENT) node<Ty> * volatile _pHead;
     volatile uint32_t  _cPops = 0;
-    node<Ty> * volatile _pTail;
+    alignas(Layout::ALIGNMENT) node<Ty> * volatile _pTail;
     volatile uint32_t  _cPushes = 0;
 
 public:
     LockFreeQueue(_In_ node<Ty> * pDummy);
 
     void Add(_In_ node<Ty> * pNode);
-    node<Ty> * Remove();
+
+    // Returns nullptr if the queue is empty.
+    node<Ty> * Remove(_Out_ Ty & value);
+
+    static void Retire(_In_ node<Ty> * pNode) { Reclaim::Retire(pNode); }
 };
 
-template<typename Ty>
-LockFreeQueue<Ty>::LockFreeQueue(_In_ node<Ty> * pDummy)
+template<typename Ty, typename Reclaim, typename Layout>
+LockFreeQueue<Ty, Reclaim, Layout>::LockFreeQueue(_In_ node<Ty> * pDummy)
 {
+    pDummy->pNext = nullptr;
     _pHead = _pTail = pDummy;
 }
 
-template<typename Ty>
-void LockFreeQueue<Ty>::Add(_In_bytecount_c_(sizeof node<Ty>) node<Ty> * pNode)
+template<typename Ty, typename Reclaim, typename Layout>
+void LockFreeQueue<Ty, Reclaim, Layout>::Add(_In_bytecount_c_(sizeof node<Ty>) node<Ty> * pNode)
 {
-    pNode->pNext = nullptr;
+    typename Reclaim::Guard guard;
+
+    // A thread that read this node before it was last removed may still be
+    // reading its link.
+    AtomicStore(pNode->pNext, static_cast<node<Ty> *>(nullptr), std::memory_order_relaxed);
 
     uint32_t cPushes;
     node<Ty> * pTail;
 
     for(;;)
     {
-        cPushes = _cPushes;
-        pTail = _pTail;
-
-        // NOTE: The Queue has the same consideration as the Stack.  If _pTail is
-        // freed on a different thread, then this code can cause an access violation.
+        cPushes = AtomicLoad(_cPushes);
+        pTail = guard.Protect(0, _pTail);
+        node<Ty> * pNext = AtomicLoad(pTail->pNext);
+
+        // The original version of this code linked the new node to whatever
+        // node the tail pointed at, which may have left the queue by then.
+        // Only link to pTail if it was still the tail, with the same tag, when
+        // pNext was read.  The guard keeps pTail from being reused until this
+        // operation is done with it, so if pTail->pNext is still nullptr when
+        // the CAS runs, pTail is still the last node in the queue.
+        if(pTail != AtomicLoad(_pTail) || cPushes != AtomicLoad(_cPushes))
+        {
+            continue;
+        }
 
-        // If the node that the tail points to is the last node
-        // then update the last node to point at the new node.
-        if(CAS(&(_pTail->pNext), reinterpret_cast<node<Ty> *>(nullptr), pNode))
+        if(nullptr == pNext)
         {
-            break;
+            // The tail points at the last node, so link the new node after it.
+            if(CAS(&(pTail->pNext), static_cast<node<Ty> *>(nullptr), pNode))
+            {
+                break;
+            }
         }
         else
         {
-            // Since the tail does not point at the last node,
-            // need to keep updating the tail until it does.
-            CAS2(&_pTail, pTail, cPushes, _pTail->pNext, cPushes + 1);
+            // The tail is behind the last node, so help move it forward.
+            CAS2(&_pTail, pTail, cPushes, pNext, cPushes + 1);
         }
     }
 
@@ -64,32 +105,31 @@ void LockFreeQueue<Ty>::Add(_In_bytecount_c_(sizeof node<Ty>) node<Ty> * pNode)
     CAS2(&_pTail, pTail, cPushes, pNode, cPushes + 1);
 }
 
-template<typename Ty>
-node<Ty> * LockFreeQueue<Ty>::Remove()
+template<typename Ty, typename Reclaim, typename Layout>
+node<Ty> * LockFreeQueue<Ty, Reclaim, Layout>::Remove(_Out_ Ty & value)
 {
-    Ty value = Ty();
-    node<Ty> * pHead;
+    typename Reclaim::Guard guard;
 
     for(;;)
     {
-        uint32_t cPops = _cPops;
-        uint32_t cPushes = _cPushes;
-        pHead = _pHead;
-        node<Ty> * pNext = pHead->pNext;
+        uint32_t cPops = AtomicLoad(_cPops);
+        uint32_t cPushes = AtomicLoad(_cPushes);
+        node<Ty> * pHead = guard.Protect(0, _pHead);
+        node<Ty> * pNext = guard.Protect(1, pHead->pNext);
 
         // Verify that we did not get the pointers in the middle
-        // of another update.
-        if(cPops != _cPops)
+        // of another update.  This also verifies that pHead was still
+        // in the queue when pNext was protected, so pNext was too.
+        if(cPops != AtomicLoad(_cPops))
         {
             continue;
         }
         // Check if the queue is empty.
-        if(pHead == _pTail)
+        if(pHead == AtomicLoad(_pTail))
         {
             if(nullptr == pNext)
             {
-                pHead = nullptr;    // queue is empty
-                break;
+                return nullptr;     // queue is empty
             }
             // Special case if the queue has nodes but the tail
             // is just behind. Move the tail off of the head.
@@ -97,20 +137,17 @@ node<Ty> * LockFreeQueue<Ty>::Remove()
         }
         else if(nullptr != pNext)
         {
-            value = pNext->value;
             // Move the head pointer, effectively removing the node
             if(CAS2(&_pHead, pHead, cPops, pNext, cPops + 1))
             {
-                break;
+                // pNext is now the dummy, so no other thread will read its
+                // value, and the guard keeps it from being reused until the
+                // value has been moved out.
+                value = std::move(pNext->value);
+                return pHead;
             }
         }
     }
-    if(nullptr != pHead)
-    {
-        pHead->value = value;
-    }
-    return pHead;
 }
 
 #endif
-
@@ -0,0 +1,214 @@
+#ifndef LFRING_H
+#define LFRING_H
+
+#include "lfcas.h"
+
+//------------------------------------------------------------------------------
+//
+// Parameterized Bounded Lock-free Ring
+//
+//------------------------------------------------------------------------------
+//
+// A bounded queue for any number of producers and consumers, as described by
+// Dmitry Vyukov (http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue).
+// Unlike LockFreeQueue, it needs no nodes: the values live in an array of
+// cells, and a value is added or removed with a single CAS on an index.
+//
+// Each cell holds a sequence number that says whose turn it is.  A cell at
+// position pos is ready for the producer that claims pos when its sequence is
+// pos, and ready for the consumer that claims pos when its sequence is pos + 1.
+// After the consumer is done with the cell, it sets the sequence to
+// pos + capacity, ready for the producer on the next lap.
+//
+// The indices are never reused within a lap, so there is no ABA problem, and
+// cells are never freed while the ring exists, so there is nothing to reclaim.
+// Ty must be default constructible and movable.
+//
+template<typename Ty>
+class LockFreeRing
+{
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        Ty value;
+    };
+
+    Cell * const _aCells;
+    const size_t _mask;     // capacity - 1
+
+    // The producers and consumers each write their own index, so keep them off
+    // each other's cache line, and off the line holding _aCells and _mask.  The
+    // alignment also pads the end of the ring to a whole line.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _iAdd;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _iRemove;
+
+    // Not implemented to prevent accidental copying/moving.
+    LockFreeRing(const LockFreeRing&) = delete;
+    LockFreeRing& operator=(const LockFreeRing&) = delete;
+
+    size_t Claim(std::atomic<size_t> & iClaim, size_t lag, size_t cMax, _Out_ size_t & posFirst);
+
+public:
+    // cCapacity must be a power of two.
+    LockFreeRing(size_t cCapacity);
+    ~LockFreeRing() noexcept;
+
+    // Return false if the ring is full or empty, rather than waiting.
+    template<typename Tv>
+    bool TryAdd(Tv && value);
+    bool TryRemove(_Out_ Ty & value);
+
+    // Wait until there is room or a value.
+    template<typename Tv>
+    void Add(Tv && value);
+    void Remove(_Out_ Ty & value);
+
+    // Move up to cValues values in or out with a single CAS, and return the
+    // number moved, which is 0 if the ring is full or empty.
+    size_t TryAddMany(_In_count_(cValues) Ty * aValues, size_t cValues);
+    size_t TryRemoveMany(_Out_cap_(cValues) Ty * aValues, size_t cValues);
+
+    size_t Capacity() const { return _mask + 1; }
+};
+
+template<typename Ty>
+LockFreeRing<Ty>::LockFreeRing(size_t cCapacity) : _aCells(new Cell[cCapacity]), _mask(cCapacity - 1), _iAdd(0), _iRemove(0)
+{
+    assert(cCapacity >= 2 && (cCapacity & (cCapacity - 1)) == 0);
+
+    for(size_t ii = 0; ii < cCapacity; ++ii)
+    {
+        _aCells[ii].sequence.store(ii, std::memory_order_relaxed);
+    }
+}
+
+template<typename Ty>
+LockFreeRing<Ty>::~LockFreeRing() noexcept
+{
+    delete[] _aCells;
+}
+
+//
+// Claim up to cMax consecutive cells by advancing iClaim, and return the number
+// claimed and the position of the first.  A cell at position pos is ready when
+// its sequence is pos + lag, which is 0 for producers and 1 for consumers.
+// Only cells that are already ready are claimed, so a thread never waits on a
+// cell that a slower thread has not finished with.
+//
+template<typename Ty>
+size_t LockFreeRing<Ty>::Claim(std::atomic<size_t> & iClaim, size_t lag, size_t cMax, _Out_ size_t & posFirst)
+{
+    size_t pos = iClaim.load(std::memory_order_relaxed);
+    for(;;)
+    {
+        size_t cReady = 0;
+        while(cReady < cMax)
+        {
+            const size_t sequence = _aCells[(pos + cReady) & _mask].sequence.load(std::memory_order_acquire);
+            if(sequence != pos + cReady + lag)
+            {
+                break;
+            }
+            ++cReady;
+        }
+
+        if(cReady == 0)
+        {
+            // If the first cell is behind, the ring is full (or empty).
+            // Otherwise another thread has claimed it, and pos is out of date.
+            const size_t sequence = _aCells[pos & _mask].sequence.load(std::memory_order_acquire);
+            if(static_cast<intptr_t>(sequence - (pos + lag)) < 0)
+            {
+                return 0;
+            }
+            pos = iClaim.load(std::memory_order_relaxed);
+        }
+        else if(iClaim.compare_exchange_weak(pos, pos + cReady, std::memory_order_relaxed))
+        {
+            posFirst = pos;
+            return cReady;
+        }
+    }
+}
+
+template<typename Ty>
+template<typename Tv>
+bool LockFreeRing<Ty>::TryAdd(Tv && value)
+{
+    size_t pos;
+    if(Claim(_iAdd, 0, 1, pos) == 0)
+    {
+        return false;
+    }
+
+    Cell & cell = _aCells[pos & _mask];
+    cell.value = std::forward<Tv>(value);
+    cell.sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename Ty>
+bool LockFreeRing<Ty>::TryRemove(_Out_ Ty & value)
+{
+    size_t pos;
+    if(Claim(_iRemove, 1, 1, pos) == 0)
+    {
+        return false;
+    }
+
+    Cell & cell = _aCells[pos & _mask];
+    value = std::move(cell.value);
+    cell.sequence.store(pos + _mask + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename Ty>
+template<typename Tv>
+void LockFreeRing<Ty>::Add(Tv && value)
+{
+    uint32_t cSpins = 0;
+    while(!TryAdd(std::forward<Tv>(value)))
+    {
+        SpinBackoff(cSpins);
+    }
+}
+
+template<typename Ty>
+void LockFreeRing<Ty>::Remove(_Out_ Ty & value)
+{
+    uint32_t cSpins = 0;
+    while(!TryRemove(value))
+    {
+        SpinBackoff(cSpins);
+    }
+}
+
+template<typename Ty>
+size_t LockFreeRing<Ty>::TryAddMany(_In_count_(cValues) Ty * aValues, size_t cValues)
+{
+    size_t pos;
+    const size_t cClaimed = Claim(_iAdd, 0, cValues, pos);
+    for(size_t ii = 0; ii < cClaimed; ++ii)
+    {
+        Cell & cell = _aCells[(pos + ii) & _mask];
+        cell.value = std::move(aValues[ii]);
+        cell.sequence.store(pos + ii + 1, std::memory_order_release);
+    }
+    return cClaimed;
+}
+
+template<typename Ty>
+size_t LockFreeRing<Ty>::TryRemoveMany(_Out_cap_(cValues) Ty * aValues, size_t cValues)
+{
+    size_t pos;
+    const size_t cClaimed = Claim(_iRemove, 1, cValues, pos);
+    for(size_t ii = 0; ii < cClaimed; ++ii)
+    {
+        Cell & cell = _aCells[(pos + ii) & _mask];
+        aValues[ii] = std::move(cell.value);
+        cell.sequence.store(pos + ii + _mask + 1, std::memory_order_release);
+    }
+    return cClaimed;
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef LFSLAB_H
+#define LFSLAB_H
+
+#include "lfcas.h"
+
+//------------------------------------------------------------------------------
+//
+// Slab Allocation
+//
+//------------------------------------------------------------------------------
+//
+// Slabs are large blocks of memory that a container carves into nodes.  A slab
+// starts on a cache line boundary, so that nodes that are a multiple of a
+// cache line in size never straddle two lines.
+//
+// With SLAB_HUGE_PAGES, the slab is backed by huge pages where the system
+// allows it (2MB pages with MAP_HUGETLB on Linux, or large pages on Windows,
+// which need the SeLockMemoryPrivilege), so a large pool costs one TLB entry
+// per huge page rather than one per page.  When huge pages can't be had, the
+// slab uses normal pages instead.
+//
+// With SLAB_LOCAL_NODE, the slab is placed on the NUMA node of the processor
+// that allocates it.  The thread that runs out of nodes is the one that
+// allocates the next slab, so its nodes start out close to the thread that is
+// using them.
+//
+const uint32_t SLAB_HUGE_PAGES = 0x1;
+const uint32_t SLAB_LOCAL_NODE = 0x2;
+
+struct Slab
+{
+    void * pMemory;     // the start of the slab, on a cache line boundary
+    size_t cbMemory;    // the size that was asked for, or more, up to the end of cbBase
+    void * pBase;       // what was allocated, to free
+    size_t cbBase;
+    uint32_t flags;
+};
+
+// Returns false if there is not enough memory.
+inline bool AllocateSlab(size_t cbMemory, uint32_t flags, _Out_ Slab & slab)
+{
+    slab.pMemory = nullptr;
+    slab.cbMemory = cbMemory;
+    slab.pBase = nullptr;
+    slab.cbBase = 0;
+    slab.flags = flags;
+
+#if defined(_WIN32)
+    if(0 == flags)
+    {
+        slab.cbBase = cbMemory;
+        slab.pBase = _aligned_malloc(cbMemory, CACHE_LINE_SIZE);
+        slab.pMemory = slab.pBase;
+        return nullptr != slab.pMemory;
+    }
+
+    ULONG node = NUMA_NO_PREFERRED_NODE;
+    if(flags & SLAB_LOCAL_NODE)
+    {
+        PROCESSOR_NUMBER processor;
+        GetCurrentProcessorNumberEx(&processor);
+        USHORT currentNode;
+        if(GetNumaProcessorNodeEx(&processor, &currentNode))
+        {
+            node = currentNode;
+        }
+    }
+
+    const SIZE_T cbLargePage = GetLargePageMinimum();
+    if((flags & SLAB_HUGE_PAGES) && cbLargePage > 0)
+    {
+        slab.cbBase = (cbMemory + cbLargePage - 1) & ~(cbLargePage - 1);
+        slab.pBase = VirtualAllocExNuma(GetCurrentProcess(), nullptr, slab.cbBase, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE, node);
+    }
+    if(nullptr == slab.pBase)
+    {
+        slab.cbBase = cbMemory;
+        slab.pBase = VirtualAllocExNuma(GetCurrentProcess(), nullptr, slab.cbBase, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node);
+    }
+    slab.pMemory = slab.pBase;
+    return nullptr != slab.pMemory;
+
+#elif defined(__linux__)
+    if(0 == flags)
+    {
+        slab.cbBase = cbMemory;
+        if(0 != posix_memalign(&slab.pBase, CACHE_LINE_SIZE, cbMemory))
+        {
+            slab.pBase = nullptr;
+        }
+        slab.pMemory = slab.pBase;
+        return nullptr != slab.pMemory;
+    }
+
+    const size_t cbHugePage = 2 * 1024 * 1024;
+    const size_t cbPage = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    if(flags & SLAB_HUGE_PAGES)
+    {
+        slab.cbBase = (cbMemory + cbHugePage - 1) & ~(cbHugePage - 1);
+        slab.pBase = mmap(nullptr, slab.cbBase, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(MAP_FAILED == slab.pBase)
+        {
+            slab.pBase = nullptr;
+        }
+    }
+    if(nullptr == slab.pBase)
+    {
+        slab.cbBase = (cbMemory + cbPage - 1) & ~(cbPage - 1);
+        slab.pBase = mmap(nullptr, slab.cbBase, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(MAP_FAILED == slab.pBase)
+        {
+            slab.pBase = nullptr;
+            return false;
+        }
+        if(flags & SLAB_HUGE_PAGES)
+        {
+            // Transparent huge pages are the next best thing.
+            madvise(slab.pBase, slab.cbBase, MADV_HUGEPAGE);
+        }
+    }
+
+    //
+    // The pages are not backed until they are touched, so bind them to this
+    // processor's node before anything touches them.  This is the mbind
+    // system call, to avoid a dependency on libnuma.
+    //
+    unsigned int cpu;
+    unsigned int node;
+    if((flags & SLAB_LOCAL_NODE) && 0 == syscall(SYS_getcpu, &cpu, &node, nullptr) && node < 8 * sizeof(unsigned long))
+    {
+        const int MPOL_PREFERRED_MODE = 1;
+        const unsigned long nodemask = 1UL << node;
+        syscall(SYS_mbind, slab.pBase, slab.cbBase, MPOL_PREFERRED_MODE, &nodemask, 8 * sizeof(nodemask) + 1, 0);
+    }
+
+    slab.pMemory = slab.pBase;
+    return true;
+
+#else
+    //
+    // No huge pages or NUMA placement, so just align the heap.
+    //
+    slab.cbBase = cbMemory + CACHE_LINE_SIZE;
+    slab.pBase = std::malloc(slab.cbBase);
+    if(nullptr == slab.pBase)
+    {
+        return false;
+    }
+    slab.pMemory = reinterpret_cast<void *>((reinterpret_cast<uintptr_t>(slab.pBase) + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1));
+    return true;
+#endif
+}
+
+inline void FreeSlab(_In_ const Slab & slab)
+{
+#if defined(_WIN32)
+    if(0 == slab.flags)
+    {
+        _aligned_free(slab.pBase);
+    }
+    else
+    {
+        VirtualFree(slab.pBase, 0, MEM_RELEASE);
+    }
+#elif defined(__linux__)
+    if(0 == slab.flags)
+    {
+        std::free(slab.pBase);
+    }
+    else
+    {
+        munmap(slab.pBase, slab.cbBase);
+    }
+#else
+    std::free(slab.pBase);
+#endif
+}
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef LFSPSC_H
+#define LFSPSC_H
+
+#include "lfcas.h"
+
+//------------------------------------------------------------------------------
+//
+// Parameterized Single Producer, Single Consumer Ring
+//
+//------------------------------------------------------------------------------
+//
+// A bounded queue for exactly one producer thread and one consumer thread.
+// Each index is only written by one thread, so no operation needs a CAS or
+// any other atomic read-modify-write, and every operation finishes in a
+// bounded number of steps (it is wait-free).
+//
+// The producer owns the tail and the consumer owns the head.  Each thread
+// keeps a copy of the other's index on its own cache line, and only reads the
+// other's line when the copy says that the ring is full (or empty).  So while
+// the ring is neither full nor empty, the only line that moves between the
+// processors is the one holding the values.
+//
+// Reserve/Commit and Peek/Release give direct access to the values in the
+// ring, so values can be built or read in place without copying.
+// Ty must be default constructible and movable.
+//
+template<typename Ty>
+class LockFreeSpscRing
+{
+    Ty * const _aValues;
+    const size_t _mask;     // capacity - 1
+
+    // Written by the producer.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _iTail;
+    size_t _iHeadCache;
+
+    // Written by the consumer.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _iHead;
+    size_t _iTailCache;
+
+    // Not implemented to prevent accidental copying/moving.
+    LockFreeSpscRing(const LockFreeSpscRing&) = delete;
+    LockFreeSpscRing& operator=(const LockFreeSpscRing&) = delete;
+
+public:
+    // cCapacity must be a power of two.
+    LockFreeSpscRing(size_t cCapacity);
+    ~LockFreeSpscRing() noexcept;
+
+    //
+    // Producer only.
+    //
+    template<typename Tv>
+    bool TryAdd(Tv && value);
+
+    // Return up to cMax free slots that are contiguous in memory in pValues.
+    // The values become visible to the consumer with Commit(cAdded), where
+    // cAdded is no more than the number of slots returned.
+    size_t Reserve(_Out_ Ty * & pValues, size_t cMax);
+    void Commit(size_t cAdded);
+
+    //
+    // Consumer only.
+    //
+    bool TryRemove(_Out_ Ty & value);
+
+    // Return up to cMax values that are contiguous in memory in pValues.
+    // The slots are handed back to the producer with Release(cRemoved), where
+    // cRemoved is no more than the number of values returned.
+    size_t Peek(_Out_ Ty * & pValues, size_t cMax);
+    void Release(size_t cRemoved);
+
+    size_t Capacity() const { return _mask + 1; }
+};
+
+template<typename Ty>
+LockFreeSpscRing<Ty>::LockFreeSpscRing(size_t cCapacity) :
+    _aValues(new Ty[cCapacity]), _mask(cCapacity - 1), _iTail(0), _iHeadCache(0), _iHead(0), _iTailCache(0)
+{
+    assert(cCapacity >= 2 && (cCapacity & (cCapacity - 1)) == 0);
+}
+
+template<typename Ty>
+LockFreeSpscRing<Ty>::~LockFreeSpscRing() noexcept
+{
+    delete[] _aValues;
+}
+
+template<typename Ty>
+template<typename Tv>
+bool LockFreeSpscRing<Ty>::TryAdd(Tv && value)
+{
+    const size_t iTail = _iTail.load(std::memory_order_relaxed);
+    if(iTail - _iHeadCache > _mask)
+    {
+        // Full as far as the producer knows, so see how far the consumer got.
+        _iHeadCache = _iHead.load(std::memory_order_acquire);
+        if(iTail - _iHeadCache > _mask)
+        {
+            return false;
+        }
+    }
+
+    _aValues[iTail & _mask] = std::forward<Tv>(value);
+    _iTail.store(iTail + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename Ty>
+size_t LockFreeSpscRing<Ty>::Reserve(_Out_ Ty * & pValues, size_t cMax)
+{
+    const size_t iTail = _iTail.load(std::memory_order_relaxed);
+    if(iTail - _iHeadCache + cMax > Capacity())
+    {
+        _iHeadCache = _iHead.load(std::memory_order_acquire);
+    }
+
+    // Stop at the end of the array, so that the slots are contiguous.
+    const size_t cFree = Capacity() - (iTail - _iHeadCache);
+    const size_t cToEnd = Capacity() - (iTail & _mask);
+    pValues = &_aValues[iTail & _mask];
+    return std::min(std::min(cFree, cToEnd), cMax);
+}
+
+template<typename Ty>
+void LockFreeSpscRing<Ty>::Commit(size_t cAdded)
+{
+    _iTail.store(_iTail.load(std::memory_order_relaxed) + cAdded, std::memory_order_release);
+}
+
+template<typename Ty>
+bool LockFreeSpscRing<Ty>::TryRemove(_Out_ Ty & value)
+{
+    const size_t iHead = _iHead.load(std::memory_order_relaxed);
+    if(iHead == _iTailCache)
+    {
+        // Empty as far as the consumer knows, so see how far the producer got.
+        _iTailCache = _iTail.load(std::memory_order_acquire);
+        if(iHead == _iTailCache)
+        {
+            return false;
+        }
+    }
+
+    value = std::move(_aValues[iHead & _mask]);
+    _iHead.store(iHead + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename Ty>
+size_t LockFreeSpscRing<Ty>::Peek(_Out_ Ty * & pValues, size_t cMax)
+{
+    const size_t iHead = _iHead.load(std::memory_order_relaxed);
+    if(_iTailCache - iHead < cMax)
+    {
+        _iTailCache = _iTail.load(std::memory_order_acquire);
+    }
+
+    const size_t cValues = _iTailCache - iHead;
+    const size_t cToEnd = Capacity() - (iHead & _mask);
+    pValues = &_aValues[iHead & _mask];
+    return std::min(std::min(cValues, cToEnd), cMax);
+}
+
+template<typename Ty>
+void LockFreeSpscRing<Ty>::Release(size_t cRemoved)
+{
+    _iHead.store(_iHead.load(std::memory_order_relaxed) + cRemoved, std::memory_order_release);
+}
+
+#endif
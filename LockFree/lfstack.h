@@ -8,54 +8,158 @@
 // Parameterized Lock-free Stack
 //
 //------------------------------------------------------------------------------
-template<typename Ty>
+// Nodes popped from the stack are owned by the caller, but other threads may
+// still be reading them, so they must be freed with Retire rather than delete
+// (see the reclamation policies in lfcas.h).
+//
+// A LockFreeStack<void> holds intrusive nodes: objects of any type derived
+// from node<void>, pushed without copying them into a node.
+template<typename Ty, typename Reclaim = ReclaimNone>
 class LockFreeStack
 {
     // NOTE: the order of these members is assumed by CAS2.
-    node<Ty> * volatile _pHead = nullptr;
+    alignas(CAS2_ALIGNMENT) node<Ty> * volatile _pHead = nullptr;
     volatile uint32_t  _cPops = 0;
 
+    bool TryPop(typename Reclaim::Guard & guard, _Out_ node<Ty> * & pNode);
+
 public:
     void Push(_In_ node<Ty> * pNode);
     node<Ty> * Pop();
+
+    // Make one attempt, and return false if another thread changed the head
+    // first.  TryPop sets pNode to nullptr if the stack is empty.
+    bool TryPush(_In_ node<Ty> * pNode);
+    bool TryPop(_Out_ node<Ty> * & pNode);
+
+    // Push a chain of nodes, already linked from pFirst to pLast, with one CAS.
+    void PushMany(_In_ node<Ty> * pFirst, _In_ node<Ty> * pLast);
+
+    // Pop up to cMax nodes with one CAS, and return the number popped.  They
+    // stay linked from pFirst.  This walks nodes that it has not protected,
+    // so it is only available with ReclaimNone, where nodes are never freed.
+    uint32_t PopMany(uint32_t cMax, _Out_ node<Ty> * & pFirst);
+
+    static void Retire(_In_ node<Ty> * pNode)
+    {
+        static_assert(!std::is_void<Ty>::value, "node<void> has no virtual destructor, so retire an intrusive node through Reclaim as its derived type.");
+        Reclaim::Retire(pNode);
+    }
 };
 
-template<typename Ty>
-void LockFreeStack<Ty>::Push(_In_bytecount_c_(sizeof node<Ty>) node<Ty> * pNode)
+template<typename Ty, typename Reclaim>
+bool LockFreeStack<Ty, Reclaim>::TryPush(_In_bytecount_c_(sizeof node<Ty>) node<Ty> * pNode)
+{
+    // A thread that read this node before it was last popped may still be
+    // reading its link.
+    node<Ty> * pHead = AtomicLoad(_pHead, std::memory_order_relaxed);
+    AtomicStore(pNode->pNext, pHead, std::memory_order_relaxed);
+    return CAS(&_pHead, pHead, pNode);
+}
+
+template<typename Ty, typename Reclaim>
+void LockFreeStack<Ty, Reclaim>::Push(_In_bytecount_c_(sizeof node<Ty>) node<Ty> * pNode)
+{
+    while(!TryPush(pNode))
+    {
+    }
+}
+
+template<typename Ty, typename Reclaim>
+void LockFreeStack<Ty, Reclaim>::PushMany(_In_ node<Ty> * pFirst, _In_ node<Ty> * pLast)
 {
     for(;;)
     {
-        pNode->pNext = _pHead;
-        if(CAS(&_pHead, pNode->pNext, pNode))
+        node<Ty> * pHead = AtomicLoad(_pHead, std::memory_order_relaxed);
+        AtomicStore(pLast->pNext, pHead, std::memory_order_relaxed);
+        if(CAS(&_pHead, pHead, pFirst))
         {
             break;
         }
     }
 }
 
-template<typename Ty>
-node<Ty> * LockFreeStack<Ty>::Pop()
+template<typename Ty, typename Reclaim>
+uint32_t LockFreeStack<Ty, Reclaim>::PopMany(uint32_t cMax, _Out_ node<Ty> * & pFirst)
 {
+    static_assert(std::is_same<Reclaim, ReclaimNone>::value, "PopMany reads nodes that it has not protected.");
+    assert(cMax > 0);
+
     for(;;)
     {
-        node<Ty> * pHead = _pHead;
-        uint32_t  cPops = _cPops;
+        node<Ty> * pHead = AtomicLoad(_pHead);
+        uint32_t  cPops = AtomicLoad(_cPops);
         if(nullptr == pHead)
         {
-            return nullptr;
+            pFirst = nullptr;
+            return 0;
         }
 
-        // NOTE: Memory reclaimation is difficult in this context.  If another thread breaks in here
-        // and pops the head, and then frees it, then pHead->pNext is an invalid operation.  One solution
-        // would be to use hazard pointers (http://researchweb.watson.ibm.com/people/m/michael/ieeetpds-2004.pdf).
+        //
+        // The chain may change under the walk, but only by popping, and every
+        // pop changes the tag.  If the head and the tag are unchanged, then so
+        // is everything that the walk read.
+        //
+        uint32_t cNodes = 1;
+        node<Ty> * pLast = pHead;
+        node<Ty> * pNext = AtomicLoad(pLast->pNext);
+        while(cNodes < cMax && nullptr != pNext)
+        {
+            pLast = pNext;
+            pNext = AtomicLoad(pLast->pNext);
+            ++cNodes;
+        }
 
-        node<Ty> * pNext = pHead->pNext;
         if(CAS2(&_pHead, pHead, cPops, pNext, cPops + 1))
         {
-            return pHead;
+            pFirst = pHead;
+            return cNodes;
         }
     }
 }
 
-#endif
+template<typename Ty, typename Reclaim>
+bool LockFreeStack<Ty, Reclaim>::TryPop(typename Reclaim::Guard & guard, _Out_ node<Ty> * & pNode)
+{
+    node<Ty> * pHead = guard.Protect(0, _pHead);
+    uint32_t  cPops = AtomicLoad(_cPops);
+    if(nullptr == pHead)
+    {
+        pNode = nullptr;
+        return true;
+    }
+
+    // NOTE: Memory reclaimation is difficult in this context.  If another thread breaks in here
+    // and pops the head, and then frees it, then pHead->pNext is an invalid operation.  The
+    // Reclaim policy prevents this: with hazard pointers (lfhazard.h), the guard keeps
+    // pHead from being freed until this operation is done with it.
 
+    node<Ty> * pNext = AtomicLoad(pHead->pNext);
+    if(CAS2(&_pHead, pHead, cPops, pNext, cPops + 1))
+    {
+        pNode = pHead;
+        return true;
+    }
+    return false;
+}
+
+template<typename Ty, typename Reclaim>
+bool LockFreeStack<Ty, Reclaim>::TryPop(_Out_ node<Ty> * & pNode)
+{
+    typename Reclaim::Guard guard;
+    return TryPop(guard, pNode);
+}
+
+template<typename Ty, typename Reclaim>
+node<Ty> * LockFreeStack<Ty, Reclaim>::Pop()
+{
+    typename Reclaim::Guard guard;
+
+    node<Ty> * pNode;
+    while(!TryPop(guard, pNode))
+    {
+    }
+    return pNode;
+}
+
+#endif
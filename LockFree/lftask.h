@@ -0,0 +1,358 @@
+#ifndef LFTASK_H
+#define LFTASK_H
+
+#include "lfdeque.h"
+#include "lfqueue.h"
+#include "lffreelist.h"
+#include "lfepoch.h"
+
+//------------------------------------------------------------------------------
+//
+// Fork/Join Task Scheduler
+//
+//------------------------------------------------------------------------------
+//
+// A task spawns child tasks with Spawn, and then waits for them with Wait.
+// Each child counts itself in a TaskCounter until it finishes, so a task can
+// spawn any number of children and wait for all of them at once.  A thread
+// that is waiting runs other tasks until its counter reaches zero, so waiting
+// never blocks a worker, and the tasks can be nested as deeply as the
+// recursion needs.
+//
+// Each worker thread owns a LockFreeDeque.  A worker spawns onto and runs from
+// the bottom of its own deque, so it works depth first, like the serial
+// recursion would.  A worker that runs out of tasks steals from the top of
+// another worker's deque, which is where the largest pieces of work are.
+//
+// For comparison, the scheduler can instead share one LockFreeQueue between
+// all of the workers.  Every spawn and every run then contends for the same
+// head and tail, and the work runs breadth first.
+//
+// Tasks are allocated from a LockFreeFreeList.  When every task is in use,
+// Spawn runs the child immediately instead.  The global queue's nodes also
+// come from a LockFreeFreeList, which grows as needed, so that the comparison
+// is between the scheduling policies rather than the heap.
+//
+// A waiting thread runs other tasks on top of its own stack, and those tasks
+// may wait in turn.  With work stealing, once a thread is TASK_MAX_NESTING
+// tasks deep, Spawn runs children immediately, so the stack only grows by the
+// depth of the recursion.  With the global queue, the next task is seldom a
+// child of the waiting task, so a waiting thread would reach that depth
+// almost at once, and from then on nearly every task would run immediately,
+// without going through the queue at all.  So with the global queue, Spawn
+// always queues the child, and a waiting thread only runs tasks descended
+// from the one it is waiting in, so it nests no deeper than the recursion.
+// It puts any other task back at the tail of the queue, for another thread or
+// for itself once it has returned from the tasks above it.  The extra trips
+// through the queue are part of what the global queue costs.
+//
+typedef std::atomic<uint32_t> TaskCounter;
+
+const uint32_t TASK_MAX_NESTING = 32;
+
+class TaskScheduler
+{
+public:
+    typedef void (*PFN_TASK)(TaskScheduler & scheduler, void * pContext);
+
+private:
+    struct Task
+    {
+        PFN_TASK pfnTask;
+        void * pContext;
+        TaskCounter * pcPending;
+        Task * pParent;     // the task that spawned this one, or nullptr for Run's
+    };
+
+    struct Worker
+    {
+        TaskScheduler * pScheduler;
+        LockFreeDeque<Task *> deque;
+        uint32_t seed;      // for choosing a worker to steal from
+        uint32_t cNesting;  // tasks running on this thread's stack
+        Task * pRunning;    // the innermost of them, or nullptr
+        uint64_t cSpawned;
+        uint64_t cInline;   // spawns that ran the child immediately
+    };
+
+    typedef LockFreeQueue<Task *, ReclaimEpoch> TaskQueue;
+
+    const bool _fWorkStealing;
+    std::vector<std::unique_ptr<Worker>> _apWorkers;
+    std::vector<std::thread> _aThreads;
+    LockFreeFreeList<Task> _tasks;
+    LockFreeFreeList<node<Task *>, ReclaimEpoch> _nodes;   // for the global queue
+    TaskQueue _queue;
+    std::atomic<bool> _fStop;
+
+    // Not implemented to prevent accidental copying/moving.
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // The worker run by the calling thread.
+    static Worker *& ThisWorker()
+    {
+        static thread_local Worker * s_pWorker = nullptr;
+        return s_pWorker;
+    }
+
+    static bool IsDescendant(_In_ const Task * pTask, _In_opt_ const Task * pAncestor);
+    Task * FindTask(_In_ Worker * pWorker);
+    void Execute(_In_ Worker * pWorker, _In_ Task * pTask);
+    void WorkerThread(_In_ Worker * pWorker);
+
+public:
+    // The thread that calls Run is one of the cThreads workers.
+    TaskScheduler(uint32_t cThreads, uint32_t cTasks, bool fWorkStealing = true);
+    ~TaskScheduler() noexcept;
+
+    // Run a task and everything it spawns, and return when they are done.
+    void Run(PFN_TASK pfnTask, _In_opt_ void * pContext);
+
+    // Only call these from a running task.
+    void Spawn(_Inout_ TaskCounter & cPending, PFN_TASK pfnTask, _In_opt_ void * pContext);
+    void Wait(_Inout_ TaskCounter & cPending);
+
+    uint32_t ThreadCount() const { return static_cast<uint32_t>(_apWorkers.size()); }
+
+    // The fraction of spawns that ran the child immediately.  Only call this
+    // when Run is not running.
+    double InlineFraction() const;
+};
+
+inline TaskScheduler::TaskScheduler(uint32_t cThreads, uint32_t cTasks, bool fWorkStealing) :
+    _fWorkStealing(fWorkStealing), _tasks(cTasks), _nodes(fWorkStealing ? 1 : cTasks + 1, 0, FREELIST_UNBOUNDED),
+    _queue(_nodes.NewInstance()), _fStop(false)
+{
+    assert(cThreads >= 1);
+
+    for(uint32_t ii = 0; ii < cThreads; ++ii)
+    {
+        _apWorkers.emplace_back(new Worker);
+        _apWorkers[ii]->pScheduler = this;
+        _apWorkers[ii]->seed = 2 * ii + 1;
+        _apWorkers[ii]->cNesting = 0;
+        _apWorkers[ii]->pRunning = nullptr;
+        _apWorkers[ii]->cSpawned = 0;
+        _apWorkers[ii]->cInline = 0;
+    }
+
+    // The thread that calls Run is worker 0.
+    for(uint32_t ii = 1; ii < cThreads; ++ii)
+    {
+        _aThreads.emplace_back(&TaskScheduler::WorkerThread, this, _apWorkers[ii].get());
+    }
+}
+
+inline TaskScheduler::~TaskScheduler() noexcept
+{
+    _fStop.store(true, std::memory_order_relaxed);
+    std::for_each(std::begin(_aThreads), std::end(_aThreads), [](std::thread & thread) { thread.join(); });
+
+    //
+    // The queue's dummy node is whichever node was added last, so add one
+    // more node, and remove the old dummy.  The new node is then the dummy.
+    //
+    node<Task *> * pDummy = _nodes.NewInstance();
+    assert(nullptr != pDummy);
+    _queue.Add(pDummy);
+    Task * pTask;
+    _nodes.FreeInstance(_queue.Remove(pTask));
+    _nodes.FreeInstance(pDummy);
+}
+
+inline void TaskScheduler::Run(PFN_TASK pfnTask, _In_opt_ void * pContext)
+{
+    Worker * pPrevious = ThisWorker();
+    ThisWorker() = _apWorkers[0].get();
+
+    TaskCounter cPending(0);
+    Spawn(cPending, pfnTask, pContext);
+    Wait(cPending);
+
+    ThisWorker() = pPrevious;
+}
+
+inline void TaskScheduler::Spawn(_Inout_ TaskCounter & cPending, PFN_TASK pfnTask, _In_opt_ void * pContext)
+{
+    Worker * pWorker = ThisWorker();
+    assert(nullptr != pWorker && pWorker->pScheduler == this);
+
+    ++pWorker->cSpawned;
+    Task * pTask = (!_fWorkStealing || pWorker->cNesting < TASK_MAX_NESTING) ? _tasks.NewInstance() : nullptr;
+    if(nullptr == pTask)
+    {
+        ++pWorker->cInline;
+        pfnTask(*this, pContext);
+        return;
+    }
+
+    pTask->pfnTask = pfnTask;
+    pTask->pContext = pContext;
+    pTask->pcPending = &cPending;
+    pTask->pParent = pWorker->pRunning;
+    cPending.fetch_add(1, std::memory_order_relaxed);
+
+    if(_fWorkStealing)
+    {
+        pWorker->deque.Push(pTask);
+    }
+    else
+    {
+        node<Task *> * pNode = _nodes.NewInstance();
+        if(nullptr == pNode)
+        {
+            cPending.fetch_sub(1, std::memory_order_relaxed);
+            _tasks.FreeInstance(pTask);
+            ++pWorker->cInline;
+            pfnTask(*this, pContext);
+            return;
+        }
+        pNode->value = pTask;
+        _queue.Add(pNode);
+    }
+}
+
+inline void TaskScheduler::Wait(_Inout_ TaskCounter & cPending)
+{
+    Worker * pWorker = ThisWorker();
+    assert(nullptr != pWorker && pWorker->pScheduler == this);
+
+    uint32_t cSpins = 0;
+    while(cPending.load(std::memory_order_acquire) != 0)
+    {
+        Task * pTask = FindTask(pWorker);
+        if(nullptr != pTask)
+        {
+            Execute(pWorker, pTask);
+            cSpins = 0;
+        }
+        else
+        {
+            SpinBackoff(cSpins);
+        }
+    }
+}
+
+inline double TaskScheduler::InlineFraction() const
+{
+    uint64_t cSpawned = 0;
+    uint64_t cInline = 0;
+    for(const auto & pWorker : _apWorkers)
+    {
+        cSpawned += pWorker->cSpawned;
+        cInline += pWorker->cInline;
+    }
+    return (cSpawned == 0) ? 0.0 : static_cast<double>(cInline) / cSpawned;
+}
+
+// A queued task's ancestors are all waiting for it, so none of them has been
+// freed.
+inline bool TaskScheduler::IsDescendant(_In_ const Task * pTask, _In_opt_ const Task * pAncestor)
+{
+    if(nullptr == pAncestor)
+    {
+        return true;
+    }
+    for(const Task * pParent = pTask->pParent; nullptr != pParent; pParent = pParent->pParent)
+    {
+        if(pParent == pAncestor)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline TaskScheduler::Task * TaskScheduler::FindTask(_In_ Worker * pWorker)
+{
+    Task * pTask = nullptr;
+
+    if(!_fWorkStealing)
+    {
+        node<Task *> * pNode = _queue.Remove(pTask);
+        if(nullptr == pNode)
+        {
+            return nullptr;
+        }
+        _nodes.FreeInstance(pNode);
+
+        if(!IsDescendant(pTask, pWorker->pRunning))
+        {
+            // The list grows as needed, so it only runs out with the heap.
+            pNode = _nodes.NewInstance();
+            if(nullptr != pNode)
+            {
+                pNode->value = pTask;
+                _queue.Add(pNode);
+                return nullptr;
+            }
+        }
+        return pTask;
+    }
+
+    if(pWorker->deque.Pop(pTask))
+    {
+        return pTask;
+    }
+
+    //
+    // Try every other worker once, starting from a random one, so that the
+    // thieves spread out.
+    //
+    const uint32_t cWorkers = ThreadCount();
+    pWorker->seed ^= pWorker->seed << 13;
+    pWorker->seed ^= pWorker->seed >> 17;
+    pWorker->seed ^= pWorker->seed << 5;
+    const uint32_t iFirst = pWorker->seed % cWorkers;
+    for(uint32_t ii = 0; ii < cWorkers; ++ii)
+    {
+        Worker * pVictim = _apWorkers[(iFirst + ii) % cWorkers].get();
+        if(pVictim != pWorker && pVictim->deque.Steal(pTask))
+        {
+            return pTask;
+        }
+    }
+
+    return nullptr;
+}
+
+inline void TaskScheduler::Execute(_In_ Worker * pWorker, _In_ Task * pTask)
+{
+    Task * pOuter = pWorker->pRunning;
+    pWorker->pRunning = pTask;
+    ++pWorker->cNesting;
+    pTask->pfnTask(*this, pTask->pContext);
+    --pWorker->cNesting;
+    pWorker->pRunning = pOuter;
+
+    // Free the task before the count reaches zero, so that every task has been
+    // freed by the time Run returns.
+    TaskCounter * pcPending = pTask->pcPending;
+    _tasks.FreeInstance(pTask);
+    pcPending->fetch_sub(1, std::memory_order_release);
+}
+
+inline void TaskScheduler::WorkerThread(_In_ Worker * pWorker)
+{
+    ThisWorker() = pWorker;
+
+    uint32_t cSpins = 0;
+    while(!_fStop.load(std::memory_order_relaxed))
+    {
+        Task * pTask = FindTask(pWorker);
+        if(nullptr != pTask)
+        {
+            Execute(pWorker, pTask);
+            cSpins = 0;
+        }
+        else
+        {
+            SpinBackoff(cSpins);
+        }
+    }
+
+    ThisWorker() = nullptr;
+}
+
+#endif
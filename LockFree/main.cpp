@@ -7,7 +7,13 @@
 
 #include "PreCompile.h"
 #include "lfqueue.h"
+#include "lfelimination.h"
+#include "lfring.h"
+#include "lfspsc.h"
+#include "lftask.h"
 #include "lffreelist.h"
+#include "lfhazard.h"
+#include "lfepoch.h"
 
 //------------------------------------------------------------------------------
 //
@@ -108,6 +114,7 @@ void Test_CAS_windows()
 {
     std::cout << "Testing CAS_windows...";
 
+#ifdef _WIN32
     node<MyStruct> oldVal;
     node<MyStruct> newVal;
     node<MyStruct> * pNode = &newVal;
@@ -131,12 +138,47 @@ void Test_CAS_windows()
             std::cout << "CAS is correct." << std::endl;
         }
     }
+#else
+    std::cout << "CAS_windows is not implemented on this platform." << std::endl;
+#endif
+}
+
+//
+// Verify std::atomic version of CAS.
+//
+void Test_CAS_atomic()
+{
+    std::cout << "Testing CAS_atomic...";
+
+    node<MyStruct> oldVal;
+    node<MyStruct> newVal;
+    node<MyStruct> * pNode = &newVal;
+    if(CAS_atomic(&pNode, &oldVal, &newVal))
+    {
+        std::cout << "CAS is INCORRECT." << std::endl;
+    }
+    else
+    {
+        pNode = &oldVal;
+        if(!CAS_atomic(&pNode, &oldVal, &newVal))
+        {
+            std::cout << "CAS is INCORRECT." << std::endl;
+        }
+        else if(pNode != &newVal)
+        {
+            std::cout << "CAS is INCORRECT." << std::endl;
+        }
+        else
+        {
+            std::cout << "CAS is correct." << std::endl;
+        }
+    }
 }
 
 template<typename Ty>
 struct CAS2Test
 {
-    node<Ty> * pNode;
+    alignas(CAS2_ALIGNMENT) node<Ty> * pNode;
     uint32_t tag;
     CAS2Test(_In_ node<Ty> * pnewNode, uint32_t newTag) : pNode(pnewNode), tag(newTag) {}
 };
@@ -285,10 +327,53 @@ void Test_CAS2_windows()
 #endif
 }
 
-void HandleWait(HANDLE & hThread)
+//
+// Verify std::atomic version of CAS2.
+//
+void Test_CAS2_atomic()
 {
-    WaitForSingleObject(hThread, INFINITE);
-    CloseHandle(hThread);
+    std::cout << "Testing CAS2_atomic...";
+
+    node<MyStruct> oldVal;
+    node<MyStruct> newVal;
+
+    CAS2Test<MyStruct> myStruct(&newVal, 0xABCD);
+
+    if(CAS2_atomic(&myStruct.pNode, &oldVal, 0xABCD, &newVal, 0xAAAA))
+    {
+        // should not succeed if pointers don't match
+        std::cout << "CAS2 is INCORRECT." << std::endl;
+    }
+    else if(CAS2_atomic(&myStruct.pNode, &newVal, 0xAAAA, &oldVal, 0xABCD))
+    {
+        // should not succeed if tags don't match
+        std::cout << "CAS2 is INCORRECT." << std::endl;
+    }
+    else
+    {
+        myStruct.pNode = &oldVal;
+        if(!CAS2_atomic(&myStruct.pNode, &oldVal, 0xABCD, &newVal, 0xAAAA))
+        {
+            std::cout << "CAS2 is INCORRECT." << std::endl;
+        }
+        else if(myStruct.pNode != &newVal)
+        {
+            std::cout << "CAS2 is INCORRECT." << std::endl;
+        }
+        else if(myStruct.tag != 0xAAAA)
+        {
+            std::cout << "CAS2 is INCORRECT." << std::endl;
+        }
+        else
+        {
+            std::cout << "CAS2 is correct." << std::endl;
+        }
+    }
+}
+
+void ThreadJoin(std::thread & thread)
+{
+    thread.join();
 }
 
 template<typename Ty>
@@ -306,17 +391,17 @@ void DeleteNode(node<Ty> * & pNode)
 //
 // Stress the multithreaded stack code.
 //
-template<typename Ty, int NUMTHREADS>
+template<typename Ty, int NUMTHREADS, typename Stack = LockFreeStack<Ty>>
 class StressStack
 {
-    LockFreeStack<Ty> _stack;
+    Stack _stack;
 
     static const unsigned int cNodes = 100;    // nodes per thread
 
     struct ThreadData
     {
-        StressStack<Ty, NUMTHREADS> * pStress;
-        DWORD thread_num;
+        StressStack<Ty, NUMTHREADS, Stack> * pStress;
+        uint32_t thread_num;
     };
 
     std::vector<ThreadData> _aThreadData;
@@ -327,17 +412,19 @@ public:
 
     //
     // The stack stress will spawn a number of threads (4096 in our tests), each of which will
-    // push and pop nodes onto a single stack.  We expect that no access violations will occur
-    // and that the stack is empty upon completion.
+    // push and pop nodes onto a single stack.  We expect that no access violations will occur,
+    // that every node pushed is popped exactly once, and that the stack is empty upon
+    // completion.
     //
-    void operator()()
+    void operator()(const char * pszName = "Stack")
     {
-        std::cout << "Running Stack Stress..." << std::endl;
+        std::cout << "Running " << pszName << " Stress...";
 
         //
         // Create all of the nodes.
         //
         std::for_each(std::begin(_apNodes), std::end(_apNodes), CreateNode<Ty>);
+        std::vector<node<Ty> *> apCreated(_apNodes);
 
         unsigned int ii;
         for(ii = 0; ii < _aThreadData.size(); ++ii)
@@ -346,34 +433,43 @@ public:
             _aThreadData[ii].thread_num = ii;
         }
 
-        std::vector<HANDLE> aHandles(NUMTHREADS);
-        for(ii = 0; ii < aHandles.size(); ++ii)
+        std::vector<std::thread> aThreads;
+        aThreads.reserve(NUMTHREADS);
+        for(ii = 0; ii < _aThreadData.size(); ++ii)
         {
-            unsigned int tid;
-            aHandles[ii] = reinterpret_cast<HANDLE>(_beginthreadex(nullptr, 0, StackThreadFunc, &_aThreadData[ii], 0, &tid));
+            aThreads.emplace_back(StackThreadFunc, &_aThreadData[ii]);
         }
 
         //
         // Wait for the threads to exit.
         //
-        std::for_each(std::begin(aHandles), std::end(aHandles), HandleWait);
+        std::for_each(std::begin(aThreads), std::end(aThreads), ThreadJoin);
 
         //
-        // Delete all of the nodes.
+        // Each thread pops only after its own pushes are done, so no pop finds the stack
+        // empty, and the nodes popped are the nodes pushed, each exactly once.
         //
-        std::for_each(std::begin(_apNodes), std::end(_apNodes), DeleteNode<Ty>);
+        std::vector<node<Ty> *> apPopped(_apNodes);
+        std::sort(std::begin(apCreated), std::end(apCreated));
+        std::sort(std::begin(apPopped), std::end(apPopped));
+        if(apPopped == apCreated && nullptr == _stack.Pop())
+        {
+            std::cout << "every node was popped once." << std::endl;
+        }
+        else
+        {
+            std::cout << "nodes were lost or popped twice." << std::endl;
+        }
 
         //
-        // Ideas for improvement:
-        //  We could verify that there is a 1-1 mapping between values pushed and values popped.
-        //  Verify the count of pops in the stack matches the number of pops for each thread.
+        // Delete all of the nodes.
         //
+        std::for_each(std::begin(apCreated), std::end(apCreated), DeleteNode<Ty>);
     } // void operator()()
 
-    static unsigned int __stdcall StackThreadFunc(_In_ void * pv)
+    static void StackThreadFunc(_In_ ThreadData * ptd)
     {
-        unsigned int tid = GetCurrentThreadId();
-        ThreadData * ptd = reinterpret_cast<ThreadData *>(pv);
+        std::thread::id tid = std::this_thread::get_id();
         if(Is_Full_Trace())
         {
             std::cout << tid << " adding" << std::endl;
@@ -394,8 +490,6 @@ public:
         {
             ptd->pStress->_apNodes[ptd->thread_num * cNodes + ii] = ptd->pStress->_stack.Pop();
         }
-
-        return 0;
     }
 };  // class StressStack
 
@@ -410,7 +504,9 @@ class StressQueue
     struct ThreadData
     {
         StressQueue<Ty, NUMTHREADS> * pStress;
-        DWORD thread_num;
+        uint32_t thread_num;
+        std::vector<uint32_t> aRemoved;     // values removed by this thread
+        uint32_t cEmpty;                    // removes that found the queue empty
     };
 
     std::vector<ThreadData> _aThreadData;
@@ -427,43 +523,66 @@ public:
 
     //
     // The queue stress will spawn a number of threads (4096 in our tests), each of which will
-    // add and remove nodes on a single queue.  We expect that no access violations will occur
-    // and that the queue is empty (except for the dummy node) upon completion.
+    // add and remove nodes on a single queue.  We expect that no access violations will occur,
+    // that every value added is removed exactly once, and that the queue is empty (except for
+    // the dummy node) upon completion.
     //
     void operator()()
     {
-        std::cout << "Running Queue Stress..." << std::endl;
+        std::cout << "Running Queue Stress...";
 
         unsigned int ii;
         for(ii = 0; ii < _aThreadData.size(); ++ii)
         {
             _aThreadData[ii].pStress = this;
             _aThreadData[ii].thread_num = ii;
+            _aThreadData[ii].cEmpty = 0;
         }
 
-        std::vector<HANDLE> aHandles(NUMTHREADS);
-        for(ii = 0; ii < aHandles.size(); ++ii)
+        std::vector<std::thread> aThreads;
+        aThreads.reserve(NUMTHREADS);
+        for(ii = 0; ii < _aThreadData.size(); ++ii)
         {
-            unsigned int tid;
-            aHandles[ii] = reinterpret_cast<HANDLE>(_beginthreadex(nullptr, 0, QueueThreadFunc, &_aThreadData[ii], 0, &tid));
+            aThreads.emplace_back(QueueThreadFunc, &_aThreadData[ii]);
         }
 
         //
         // Wait for the threads to exit.
         //
-        std::for_each(std::begin(aHandles), std::end(aHandles), HandleWait);
+        std::for_each(std::begin(aThreads), std::end(aThreads), ThreadJoin);
 
         //
-        // Ideas for improvement:
-        //  We could verify that there is a 1-1 mapping between values added and values removed.
-        //  Verify the count of pops in the queue matches the number of pops for each thread.
+        // Each thread removes only after its own adds are done, so the queue is
+        // never empty when a thread removes, and every value is removed once.
         //
+        std::vector<uint32_t> acRemoved(cNodes * NUMTHREADS);
+        uint32_t cEmpty = 0;
+        for(const ThreadData & td : _aThreadData)
+        {
+            for(uint32_t value : td.aRemoved)
+            {
+                ++acRemoved[value];
+            }
+            cEmpty += td.cEmpty;
+        }
+
+        Ty value;
+        const bool fEmpty = (nullptr == _queue.Remove(value));
+        const auto cWrong = std::count_if(std::begin(acRemoved), std::end(acRemoved), [](uint32_t cRemoved) { return cRemoved != 1; });
+        if(cWrong == 0 && cEmpty == 0 && fEmpty)
+        {
+            std::cout << "every value was removed once." << std::endl;
+        }
+        else
+        {
+            std::cout << cWrong << " values were lost or duplicated, " << cEmpty << " removes found the queue empty";
+            std::cout << (fEmpty ? "." : ", and the queue is not empty.") << std::endl;
+        }
     } // void operator()()
 
-    static unsigned int __stdcall QueueThreadFunc(_In_ void * pv)
+    static void QueueThreadFunc(_In_ ThreadData * ptd)
     {
-        unsigned int tid = GetCurrentThreadId();
-        ThreadData * ptd = reinterpret_cast<ThreadData *>(pv);
+        std::thread::id tid = std::this_thread::get_id();
         if(Is_Full_Trace())
         {
             std::cout << tid << " adding" << std::endl;
@@ -472,7 +591,9 @@ public:
         unsigned int ii;
         for(ii = 0; ii < cNodes; ++ii)
         {
-            ptd->pStress->_queue.Add(ptd->pStress->_apNodes[ptd->thread_num * cNodes + ii + 1]);
+            node<Ty> * pNode = ptd->pStress->_apNodes[ptd->thread_num * cNodes + ii + 1];
+            pNode->value = static_cast<Ty>(ptd->thread_num * cNodes + ii);
+            ptd->pStress->_queue.Add(pNode);
         }
 
         if(Is_Full_Trace())
@@ -480,15 +601,980 @@ public:
             std::cout << tid << " removing" << std::endl;
         }
 
+        ptd->aRemoved.reserve(cNodes);
         for(ii = 0; ii < cNodes; ++ii)
         {
-            ptd->pStress->_queue.Remove();
+            Ty value;
+            if(nullptr != ptd->pStress->_queue.Remove(value))
+            {
+                ptd->aRemoved.push_back(static_cast<uint32_t>(value));
+            }
+            else
+            {
+                ++ptd->cEmpty;
+            }
         }
-
-        return 0;
     }
 };  // class StressQueue
 
+//
+// Stress the queue with a reclamation policy, reusing each removed node.  The
+// nodes come from a freelist that retires them through the same policy, so a
+// node is only added again once no thread can still be reading it.  This is
+// the case that could break the original Add, which linked to a tail that
+// had already been removed and reused.
+//
+template<typename Ty, int NUMTHREADS, typename Reclaim>
+class StressRecycledQueue
+{
+    LockFreeFreeList<node<Ty>, Reclaim> _nodes;
+    std::unique_ptr<LockFreeQueue<Ty, Reclaim>> _pQueue;
+
+    struct ThreadData
+    {
+        StressRecycledQueue<Ty, NUMTHREADS, Reclaim> * pStress;
+        uint32_t thread_num;
+        std::vector<uint32_t> aRemoved;     // values removed by this thread
+        uint32_t cEmpty;                    // removes that found the queue empty
+    };
+
+    std::vector<ThreadData> _aThreadData;
+
+public:
+    static const unsigned int cNodes = 100;     // values per thread
+
+    StressRecycledQueue() : _nodes(1024, 0, FREELIST_UNBOUNDED), _aThreadData(NUMTHREADS)
+    {
+        _pQueue.reset(new LockFreeQueue<Ty, Reclaim>(_nodes.NewInstance()));
+    }
+
+    //
+    // Each thread adds a value and then removes one, cNodes times, and frees
+    // each node that it removes.  We expect that every value added is removed
+    // exactly once, that no remove finds the queue empty, and that every node
+    // is back in the freelist upon completion.
+    //
+    void operator()(const char * pszName)
+    {
+        std::cout << "Running " << pszName << " Stress...";
+
+        unsigned int ii;
+        for(ii = 0; ii < _aThreadData.size(); ++ii)
+        {
+            _aThreadData[ii].pStress = this;
+            _aThreadData[ii].thread_num = ii;
+            _aThreadData[ii].cEmpty = 0;
+        }
+
+        std::vector<std::thread> aThreads;
+        aThreads.reserve(NUMTHREADS);
+        for(ii = 0; ii < _aThreadData.size(); ++ii)
+        {
+            aThreads.emplace_back(QueueThreadFunc, &_aThreadData[ii]);
+        }
+
+        //
+        // Wait for the threads to exit.
+        //
+        std::for_each(std::begin(aThreads), std::end(aThreads), ThreadJoin);
+
+        std::vector<uint32_t> acRemoved(cNodes * NUMTHREADS);
+        uint32_t cEmpty = 0;
+        for(const ThreadData & td : _aThreadData)
+        {
+            for(uint32_t value : td.aRemoved)
+            {
+                ++acRemoved[value];
+            }
+            cEmpty += td.cEmpty;
+        }
+
+        Ty value;
+        const bool fEmpty = (nullptr == _pQueue->Remove(value));
+        const auto cWrong = std::count_if(std::begin(acRemoved), std::end(acRemoved), [](uint32_t cRemoved) { return cRemoved != 1; });
+
+        //
+        // The queue doesn't give up its dummy node, so add one more node and
+        // remove it.  That frees the old dummy, and leaves the new node as the
+        // dummy, which can be freed once the queue is gone.
+        //
+        node<Ty> * pLast = _nodes.NewInstance();
+        _pQueue->Add(pLast);
+        _nodes.FreeInstance(_pQueue->Remove(value));
+        _pQueue.reset();
+        _nodes.FreeInstance(pLast);
+
+        if(cWrong == 0 && cEmpty == 0 && fEmpty)
+        {
+            std::cout << "every value was removed once from " << _nodes.Capacity() << " nodes." << std::endl;
+        }
+        else
+        {
+            std::cout << cWrong << " values were lost or duplicated, " << cEmpty << " removes found the queue empty";
+            std::cout << (fEmpty ? "." : ", and the queue is not empty.") << std::endl;
+        }
+    } // void operator()()
+
+    static void QueueThreadFunc(_In_ ThreadData * ptd)
+    {
+        StressRecycledQueue<Ty, NUMTHREADS, Reclaim> * pStress = ptd->pStress;
+
+        ptd->aRemoved.reserve(cNodes);
+        for(unsigned int ii = 0; ii < cNodes; ++ii)
+        {
+            node<Ty> * pNode = pStress->_nodes.NewInstance();
+            pNode->value = static_cast<Ty>(ptd->thread_num * cNodes + ii);
+            pStress->_pQueue->Add(pNode);
+
+            Ty value;
+            node<Ty> * pRemoved = pStress->_pQueue->Remove(value);
+            if(nullptr != pRemoved)
+            {
+                ptd->aRemoved.push_back(static_cast<uint32_t>(value));
+                pStress->_nodes.FreeInstance(pRemoved);
+            }
+            else
+            {
+                ++ptd->cEmpty;
+            }
+        }
+    }
+};  // class StressRecycledQueue
+
+//
+// Stress the multithreaded ring code.
+//
+template<typename Ty, int NUMTHREADS>
+class StressRing
+{
+    LockFreeRing<Ty> _ring;
+
+    static const unsigned int cValues = 100;    // values per producer
+    static const size_t cBatch = 8;             // values per batch
+
+    struct ThreadData
+    {
+        StressRing<Ty, NUMTHREADS> * pStress;
+        uint32_t thread_num;
+        std::vector<uint32_t> aRemoved;     // values removed by this thread
+    };
+
+    std::vector<ThreadData> _aThreadData;
+
+public:
+    // A small ring, so that it wraps many times and is often full or empty.
+    StressRing() : _ring(256), _aThreadData(NUMTHREADS) {}
+
+    //
+    // The ring stress will spawn a number of threads (4096 in our tests).  Half of them add
+    // values and half of them remove values, some one at a time and some in batches.  We
+    // expect that every value added is removed exactly once, and that the ring is empty upon
+    // completion.
+    //
+    void operator()()
+    {
+        std::cout << "Running Ring Stress...";
+
+        unsigned int ii;
+        for(ii = 0; ii < _aThreadData.size(); ++ii)
+        {
+            _aThreadData[ii].pStress = this;
+            _aThreadData[ii].thread_num = ii;
+        }
+
+        std::vector<std::thread> aThreads;
+        aThreads.reserve(NUMTHREADS);
+        for(ii = 0; ii < _aThreadData.size(); ++ii)
+        {
+            aThreads.emplace_back(RingThreadFunc, &_aThreadData[ii]);
+        }
+
+        //
+        // Wait for the threads to exit.
+        //
+        std::for_each(std::begin(aThreads), std::end(aThreads), ThreadJoin);
+
+        std::vector<uint32_t> acRemoved(cValues * (NUMTHREADS / 2));
+        for(const ThreadData & td : _aThreadData)
+        {
+            for(uint32_t value : td.aRemoved)
+            {
+                ++acRemoved[value];
+            }
+        }
+
+        Ty value;
+        const bool fEmpty = !_ring.TryRemove(value);
+        const auto cWrong = std::count_if(std::begin(acRemoved), std::end(acRemoved), [](uint32_t cRemoved) { return cRemoved != 1; });
+        if(cWrong == 0 && fEmpty)
+        {
+            std::cout << "every value was removed once." << std::endl;
+        }
+        else
+        {
+            std::cout << cWrong << " values were lost or duplicated" << (fEmpty ? "." : ", and the ring is not empty.") << std::endl;
+        }
+    } // void operator()()
+
+    static void RingThreadFunc(_In_ ThreadData * ptd)
+    {
+        LockFreeRing<Ty> & ring = ptd->pStress->_ring;
+        const uint32_t iFirst = (ptd->thread_num / 2) * cValues;
+        const bool fBatch = (ptd->thread_num / 2) % 2 != 0;
+
+        Ty aValues[cBatch];
+        uint32_t cSpins = 0;
+        unsigned int ii = 0;
+        if(ptd->thread_num % 2 == 0)
+        {
+            while(ii < cValues)
+            {
+                if(!fBatch)
+                {
+                    ring.Add(static_cast<Ty>(iFirst + ii++));
+                    continue;
+                }
+
+                const size_t cValuesInBatch = std::min<size_t>(cBatch, cValues - ii);
+                for(size_t jj = 0; jj < cValuesInBatch; ++jj)
+                {
+                    aValues[jj] = static_cast<Ty>(iFirst + ii + jj);
+                }
+
+                // The ring may only have room for part of the batch.
+                size_t cAdded = 0;
+                while(cAdded < cValuesInBatch)
+                {
+                    const size_t cAddedNow = ring.TryAddMany(aValues + cAdded, cValuesInBatch - cAdded);
+                    if(cAddedNow == 0)
+                    {
+                        SpinBackoff(cSpins);
+                    }
+                    cAdded += cAddedNow;
+                }
+                ii += static_cast<unsigned int>(cValuesInBatch);
+            }
+        }
+        else
+        {
+            ptd->aRemoved.reserve(cValues);
+            while(ii < cValues)
+            {
+                size_t cRemoved = 1;
+                if(fBatch)
+                {
+                    cRemoved = ring.TryRemoveMany(aValues, std::min<size_t>(cBatch, cValues - ii));
+                    if(cRemoved == 0)
+                    {
+                        SpinBackoff(cSpins);
+                    }
+                }
+                else
+                {
+                    ring.Remove(aValues[0]);
+                }
+
+                for(size_t jj = 0; jj < cRemoved; ++jj)
+                {
+                    ptd->aRemoved.push_back(static_cast<uint32_t>(aValues[jj]));
+                }
+                ii += static_cast<unsigned int>(cRemoved);
+            }
+        }
+    }
+};  // class StressRing
+
+// std::min takes cBatch by reference, so it needs a definition.
+template<typename Ty, int NUMTHREADS>
+const size_t StressRing<Ty, NUMTHREADS>::cBatch;
+
+//
+// Benchmark a reclamation policy on the stack and the queue.  Each thread adds a
+// node and then removes one, so the container never runs dry, and every node
+// is removed exactly once.  With fRetire, every removed node is retired, so
+// memory is freed while the other threads run; otherwise the nodes are only
+// freed once the threads have exited, which is all that ReclaimNone allows.
+//
+const int BENCHMARK_THREADS = 4;
+const unsigned int cBenchmarkOps = 250000;     // per thread
+
+template<typename Stack, bool fRetire>
+double BenchmarkStack(unsigned int cThreads = BENCHMARK_THREADS)
+{
+    Stack stack;
+    std::vector<node<TEST_TYPE> *> apNodes(cThreads * cBenchmarkOps);
+    std::for_each(std::begin(apNodes), std::end(apNodes), CreateNode<TEST_TYPE>);
+
+    auto ThreadFunc = [&stack, &apNodes](unsigned int thread_num)
+    {
+        for(unsigned int ii = 0; ii < cBenchmarkOps; ++ii)
+        {
+            stack.Push(apNodes[thread_num * cBenchmarkOps + ii]);
+            node<TEST_TYPE> * pNode = stack.Pop();
+            if(fRetire)
+            {
+                Stack::Retire(pNode);
+            }
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> aThreads;
+    for(unsigned int ii = 0; ii < cThreads; ++ii)
+    {
+        aThreads.emplace_back(ThreadFunc, ii);
+    }
+    std::for_each(std::begin(aThreads), std::end(aThreads), ThreadJoin);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if(!fRetire)
+    {
+        std::for_each(std::begin(apNodes), std::end(apNodes), DeleteNode<TEST_TYPE>);
+    }
+
+    return 2.0 * cThreads * cBenchmarkOps / elapsed.count();
+}
+
+template<typename Queue, bool fRetire>
+double BenchmarkQueue()
+{
+    std::vector<node<TEST_TYPE> *> apNodes(BENCHMARK_THREADS * cBenchmarkOps + 1);    // 1 extra dummy node
+    std::for_each(std::begin(apNodes), std::end(apNodes), CreateNode<TEST_TYPE>);
+    Queue queue(apNodes[0]);
+
+    //
+    // Every node but the last dummy is removed once, so the XOR of all of the
+    // nodes and of all of the removed nodes is the last dummy.
+    //
+    std::atomic<uintptr_t> removed(0);
+    auto ThreadFunc = [&queue, &apNodes, &removed](unsigned int thread_num)
+    {
+        uintptr_t removedByThread = 0;
+        for(unsigned int ii = 0; ii < cBenchmarkOps; ++ii)
+        {
+            TEST_TYPE value;
+            queue.Add(apNodes[thread_num * cBenchmarkOps + ii + 1]);
+            node<TEST_TYPE> * pNode = queue.Remove(value);
+            removedByThread ^= reinterpret_cast<uintptr_t>(pNode);
+            if(fRetire)
+            {
+                Queue::Retire(pNode);
+            }
+        }
+        removed.fetch_xor(removedByThread);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> aThreads;
+    for(unsigned int ii = 0; ii < BENCHMARK_THREADS; ++ii)
+    {
+        aThreads.emplace_back(ThreadFunc, ii);
+    }
+    std::for_each(std::begin(aThreads), std::end(aThreads), ThreadJoin);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if(fRetire)
+    {
+        uintptr_t dummy = removed.load();
+        for(node<TEST_TYPE> * pNode : apNodes)
+        {
+            dummy ^= reinterpret_cast<uintptr_t>(pNode);
+        }
+        delete reinterpret_cast<node<TEST_TYPE> *>(dummy);
+    }
+    else
+    {
+        std::for_each(std::begin(apNodes), std::end(apNodes), DeleteNode<TEST_TYPE>);
+    }
+
+    return 2.0 * BENCHMARK_THREADS * cBenchmarkOps / elapsed.count();
+}
+
+void Benchmark_Reclaim()
+{
+    std::cout << "Benchmarking reclamation (" << BENCHMARK_THREADS << " threads)..." << std::endl;
+    std::cout << "  Stack, tags only:       " << BenchmarkStack<LockFreeStack<TEST_TYPE>, false>() << " ops/s" << std::endl;
+    std::cout << "  Stack, hazard pointers: " << BenchmarkStack<LockFreeStack<TEST_TYPE, ReclaimHazard>, true>() << " ops/s" << std::endl;
+    std::cout << "  Queue, tags only:       " << BenchmarkQueue<LockFreeQueue<TEST_TYPE>, false>() << " ops/s" << std::endl;
+    std::cout << "  Queue, hazard pointers: " << BenchmarkQueue<LockFreeQueue<TEST_TYPE, ReclaimHazard>, true>() << " ops/s" << std::endl;
+    std::cout << "  Stack, epochs:          " << BenchmarkStack<LockFreeStack<TEST_TYPE, ReclaimEpoch>, true>() << " ops/s" << std::endl;
+    std::cout << "  Queue, epochs:          " << BenchmarkQueue<LockFreeQueue<TEST_TYPE, ReclaimEpoch>, true>() << " ops/s" << std::endl;
+}
+
+//
+// Compare the elimination-backoff stack with the plain stack as threads are added.
+//
+void Benchmark_Elimination()
+{
+    std::cout << "Benchmarking elimination..." << std::endl;
+    for(unsigned int cThreads = 1; cThreads <= 16; cThreads *= 2)
+    {
+        std::cout << "  " << cThreads << (cThreads == 1 ? " thread,  " : " threads, ");
+        std::cout << "stack: " << BenchmarkStack<LockFreeStack<TEST_TYPE>, false>(cThreads) << " ops/s, ";
+        std::cout << "elimination: " << BenchmarkStack<LockFreeEliminationStack<TEST_TYPE>, false>(cThreads) << " ops/s" << std::endl;
+    }
+}
+
+//
+// Compare the SPSC ring with the queue for one producer and one consumer.
+// Throughput streams values from one thread to the other, and latency passes
+// a value back and forth between two threads.  Both check that the values
+// arrive in order.  The queue's nodes are preallocated, as ReclaimNone needs.
+//
+const uint32_t cSpscValues = 1 << 20;
+const uint32_t cSpscRoundTrips = 20000;
+const size_t cSpscCapacity = 1024;
+const size_t cSpscBatch = 64;
+
+template<typename Produce, typename Consume>
+void ReportThroughput(const char * pszName, Produce produce, Consume consume)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer(produce);
+    const bool fInOrder = consume();
+    producer.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << pszName << cSpscValues / elapsed.count() << " values/s" << (fInOrder ? "" : ", out of order") << std::endl;
+}
+
+template<typename Send, typename Receive, typename SendBack, typename ReceiveBack>
+void ReportLatency(const char * pszName, Send send, Receive receive, SendBack sendBack, ReceiveBack receiveBack)
+{
+    std::thread echo([&]()
+    {
+        for(uint32_t ii = 0; ii < cSpscRoundTrips; ++ii)
+        {
+            sendBack(receive());
+        }
+    });
+
+    bool fInOrder = true;
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t ii = 0; ii < cSpscRoundTrips; ++ii)
+    {
+        send(ii);
+        fInOrder &= (receiveBack() == ii);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    echo.join();
+
+    std::cout << pszName << elapsed.count() / cSpscRoundTrips << " ns/round trip" << (fInOrder ? "" : ", out of order") << std::endl;
+}
+
+void Benchmark_Spsc()
+{
+    std::cout << "Benchmarking one producer and one consumer..." << std::endl;
+
+    //
+    // Throughput
+    //
+    std::cout << "  Throughput:" << std::endl;
+    {
+        std::vector<node<uint32_t>> aNodes(cSpscValues + 1);
+        LockFreeQueue<uint32_t> queue(&aNodes[0]);
+        ReportThroughput("    Queue:               ",
+            [&]()
+            {
+                for(uint32_t ii = 0; ii < cSpscValues; ++ii)
+                {
+                    aNodes[ii + 1].value = ii;
+                    queue.Add(&aNodes[ii + 1]);
+                }
+            },
+            [&]()
+            {
+                bool fInOrder = true;
+                uint32_t cSpins = 0;
+                for(uint32_t ii = 0; ii < cSpscValues; ++ii)
+                {
+                    uint32_t value;
+                    while(nullptr == queue.Remove(value))
+                    {
+                        SpinBackoff(cSpins);
+                    }
+                    fInOrder &= (value == ii);
+                }
+                return fInOrder;
+            });
+    }
+
+    {
+        LockFreeSpscRing<uint32_t> ring(cSpscCapacity);
+        ReportThroughput("    SPSC ring:           ",
+            [&]()
+            {
+                uint32_t cSpins = 0;
+                for(uint32_t ii = 0; ii < cSpscValues; ++ii)
+                {
+                    while(!ring.TryAdd(ii))
+                    {
+                        SpinBackoff(cSpins);
+                    }
+                }
+            },
+            [&]()
+            {
+                bool fInOrder = true;
+                uint32_t cSpins = 0;
+                for(uint32_t ii = 0; ii < cSpscValues; ++ii)
+                {
+                    uint32_t value;
+                    while(!ring.TryRemove(value))
+                    {
+                        SpinBackoff(cSpins);
+                    }
+                    fInOrder &= (value == ii);
+                }
+                return fInOrder;
+            });
+    }
+
+    {
+        LockFreeSpscRing<uint32_t> ring(cSpscCapacity);
+        ReportThroughput("    SPSC ring, in place: ",
+            [&]()
+            {
+                uint32_t cSpins = 0;
+                for(uint32_t ii = 0; ii < cSpscValues; )
+                {
+                    uint32_t * pValues;
+                    const size_t cReserved = ring.Reserve(pValues, std::min<size_t>(cSpscBatch, cSpscValues - ii));
+                    if(cReserved == 0)
+                    {
+                        SpinBackoff(cSpins);
+                    }
+                    for(size_t jj = 0; jj < cReserved; ++jj)
+                    {
+                        pValues[jj] = ii++;
+                    }
+                    ring.Commit(cReserved);
+                }
+            },
+            [&]()
+            {
+                bool fInOrder = true;
+                uint32_t cSpins = 0;
+                for(uint32_t ii = 0; ii < cSpscValues; )
+                {
+                    uint32_t * pValues;
+                    const size_t cValues = ring.Peek(pValues, cSpscBatch);
+                    if(cValues == 0)
+                    {
+                        SpinBackoff(cSpins);
+                    }
+                    for(size_t jj = 0; jj < cValues; ++jj)
+                    {
+                        fInOrder &= (pValues[jj] == ii++);
+                    }
+                    ring.Release(cValues);
+                }
+                return fInOrder;
+            });
+    }
+
+    //
+    // Latency
+    //
+    std::cout << "  Latency:" << std::endl;
+    {
+        std::vector<node<uint32_t>> aNodes(cSpscRoundTrips + 1);
+        std::vector<node<uint32_t>> aNodesBack(cSpscRoundTrips + 1);
+        LockFreeQueue<uint32_t> queue(&aNodes[0]);
+        LockFreeQueue<uint32_t> queueBack(&aNodesBack[0]);
+        uint32_t iNode = 0;
+        uint32_t iNodeBack = 0;
+
+        auto Receive = [](LockFreeQueue<uint32_t> & queue)
+        {
+            uint32_t value;
+            uint32_t cSpins = 0;
+            while(nullptr == queue.Remove(value))
+            {
+                SpinBackoff(cSpins);
+            }
+            return value;
+        };
+
+        ReportLatency("    Queue:               ",
+            [&](uint32_t value) { aNodes[++iNode].value = value; queue.Add(&aNodes[iNode]); },
+            [&]() { return Receive(queue); },
+            [&](uint32_t value) { aNodesBack[++iNodeBack].value = value; queueBack.Add(&aNodesBack[iNodeBack]); },
+            [&]() { return Receive(queueBack); });
+    }
+
+    {
+        LockFreeSpscRing<uint32_t> ring(cSpscCapacity);
+        LockFreeSpscRing<uint32_t> ringBack(cSpscCapacity);
+
+        auto Receive = [](LockFreeSpscRing<uint32_t> & ring)
+        {
+            uint32_t value;
+            uint32_t cSpins = 0;
+            while(!ring.TryRemove(value))
+            {
+                SpinBackoff(cSpins);
+            }
+            return value;
+        };
+
+        ReportLatency("    SPSC ring:           ",
+            [&](uint32_t value) { ring.TryAdd(value); },
+            [&]() { return Receive(ring); },
+            [&](uint32_t value) { ringBack.TryAdd(value); },
+            [&]() { return Receive(ringBack); });
+    }
+}
+
+//
+// Compare work stealing with a global queue on a recursive workload.  This is
+// a perft over a synthetic game tree: each position has 4 to 7 moves, chosen
+// by hashing the position, so the tree is irregular, like a real game tree.
+// Each node above PERFT_SERIAL_DEPTH spawns a task for each move, and the
+// nodes below are counted serially.
+//
+// A spawn that runs inline, because every task is in use or the thread is
+// nested too deeply, skips the scheduler, so the fraction of spawns that ran
+// inline is reported too.  A run with more than PERFT_MAX_INLINE of its spawns
+// inline mostly measures the serial recursion, so it is flagged.
+//
+const uint32_t PERFT_DEPTH = 9;
+const uint32_t PERFT_SERIAL_DEPTH = 2;
+const uint32_t PERFT_MAX_MOVES = 7;
+const uint32_t cPerftTasks = 1 << 16;
+const double PERFT_MAX_INLINE = 0.05;
+
+static uint64_t PerftMove(uint64_t position, uint32_t move)
+{
+    // splitmix64
+    uint64_t z = position + (move + 1) * 0x9e3779b97f4a7c15;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static uint32_t PerftMoveCount(uint64_t position)
+{
+    return 4 + static_cast<uint32_t>(position % 4);
+}
+
+static uint64_t PerftSerial(uint64_t position, uint32_t depth)
+{
+    if(depth == 0)
+    {
+        return 1;
+    }
+
+    uint64_t cLeaves = 0;
+    const uint32_t cMoves = PerftMoveCount(position);
+    for(uint32_t move = 0; move < cMoves; ++move)
+    {
+        cLeaves += PerftSerial(PerftMove(position, move), depth - 1);
+    }
+    return cLeaves;
+}
+
+struct PerftContext
+{
+    uint64_t position;
+    uint32_t depth;
+    uint64_t cLeaves;
+};
+
+static void PerftTask(TaskScheduler & scheduler, void * pContext)
+{
+    PerftContext & context = *static_cast<PerftContext *>(pContext);
+    if(context.depth <= PERFT_SERIAL_DEPTH)
+    {
+        context.cLeaves = PerftSerial(context.position, context.depth);
+        return;
+    }
+
+    // The children's contexts live on this task's stack, which is safe because
+    // the task waits for the children before it returns.
+    PerftContext aChildren[PERFT_MAX_MOVES];
+    TaskCounter cPending(0);
+    const uint32_t cMoves = PerftMoveCount(context.position);
+    for(uint32_t move = 0; move < cMoves; ++move)
+    {
+        aChildren[move].position = PerftMove(context.position, move);
+        aChildren[move].depth = context.depth - 1;
+        aChildren[move].cLeaves = 0;
+        scheduler.Spawn(cPending, PerftTask, &aChildren[move]);
+    }
+    scheduler.Wait(cPending);
+
+    context.cLeaves = 0;
+    for(uint32_t move = 0; move < cMoves; ++move)
+    {
+        context.cLeaves += aChildren[move].cLeaves;
+    }
+}
+
+void Benchmark_Tasks()
+{
+    std::cout << "Benchmarking fork/join perft (depth " << PERFT_DEPTH << ")..." << std::endl;
+
+    const uint64_t cExpected = PerftSerial(0, PERFT_DEPTH);
+    for(uint32_t cThreads = 1; cThreads <= 8; cThreads *= 2)
+    {
+        for(int iMode = 0; iMode < 2; ++iMode)
+        {
+            const bool fWorkStealing = (iMode == 0);
+            PerftContext context = { 0, PERFT_DEPTH, 0 };
+
+            double inlineFraction;
+            auto start = std::chrono::steady_clock::now();
+            {
+                TaskScheduler scheduler(cThreads, cPerftTasks, fWorkStealing);
+                scheduler.Run(PerftTask, &context);
+                inlineFraction = scheduler.InlineFraction();
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            std::cout << "  " << cThreads << (cThreads == 1 ? " thread,  " : " threads, ") << (fWorkStealing ? "work stealing: " : "global queue:  ");
+            std::cout << context.cLeaves / elapsed.count() << " leaves/s, " << 100.0 * inlineFraction << "% inline";
+            std::cout << (inlineFraction > PERFT_MAX_INLINE ? ", too many to compare" : "");
+            std::cout << (context.cLeaves == cExpected ? "" : ", wrong count") << std::endl;
+        }
+    }
+}
+
+//
+// Compare the freelist with and without per-thread magazines.  Each thread
+// allocates a burst of instances, marks them as its own, and then checks the
+// marks and frees them, as a particle system or a message pump would.  An
+// instance handed to two threads at once would fail the check.
+//
+const uint32_t cFreelistObjects = 4096;
+const uint32_t cFreelistBurst = 16;
+const uint32_t cFreelistBursts = 50000;    // per thread
+const uint32_t cFreelistMagazine = 32;
+
+struct Particle
+{
+    uint32_t thread;
+    uint32_t ix;
+};
+
+double BenchmarkFreelist(unsigned int cThreads, uint32_t cMagazine, _Out_ bool & fCorrect)
+{
+    LockFreeFreeList<Particle> freelist(cFreelistObjects, cMagazine);
+    std::atomic<bool> fFailed(false);
+
+    auto ThreadFunc = [&freelist, &fFailed](unsigned int thread_num)
+    {
+        Particle * apParticles[cFreelistBurst];
+        for(uint32_t ii = 0; ii < cFreelistBursts; ++ii)
+        {
+            for(uint32_t ix = 0; ix < cFreelistBurst; ++ix)
+            {
+                apParticles[ix] = freelist.NewInstance();
+                if(nullptr == apParticles[ix])
+                {
+                    fFailed.store(true);
+                    return;
+                }
+                apParticles[ix]->thread = thread_num;
+                apParticles[ix]->ix = ix;
+            }
+            for(uint32_t ix = 0; ix < cFreelistBurst; ++ix)
+            {
+                if(apParticles[ix]->thread != thread_num || apParticles[ix]->ix != ix)
+                {
+                    fFailed.store(true);
+                }
+                freelist.FreeInstance(apParticles[ix]);
+            }
+        }
+        freelist.Flush();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> aThreads;
+    for(unsigned int ii = 0; ii < cThreads; ++ii)
+    {
+        aThreads.emplace_back(ThreadFunc, ii);
+    }
+    std::for_each(std::begin(aThreads), std::end(aThreads), ThreadJoin);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    fCorrect = !fFailed.load();
+    return 2.0 * cThreads * cFreelistBursts * cFreelistBurst / elapsed.count();
+}
+
+void Benchmark_Freelist()
+{
+    std::cout << "Benchmarking freelist magazines..." << std::endl;
+    for(unsigned int cThreads = 1; cThreads <= 8; cThreads *= 2)
+    {
+        bool fShared;
+        bool fMagazines;
+        std::cout << "  " << cThreads << (cThreads == 1 ? " thread,  " : " threads, ");
+        std::cout << "shared list: " << BenchmarkFreelist(cThreads, 0, fShared) << " ops/s, ";
+        std::cout << "magazines: " << BenchmarkFreelist(cThreads, cFreelistMagazine, fMagazines) << " ops/s";
+        std::cout << ((fShared && fMagazines) ? "" : ", check failed") << std::endl;
+    }
+}
+
+//
+// Compare the packed and padded queue layouts, with half of the threads adding
+// values and the other half removing them, so the head and the tail are
+// written by different threads.  The consumers sum what they remove, which
+// checks that every value was removed once.
+//
+template<typename Queue>
+double BenchmarkQueueLayout(unsigned int cThreads, _Out_ bool & fCorrect)
+{
+    const unsigned int cProducers = cThreads / 2;
+    const uint64_t cValues = static_cast<uint64_t>(cProducers) * cBenchmarkOps;
+    std::vector<node<uint64_t> *> apNodes(cValues + 1);     // 1 extra dummy node
+    std::for_each(std::begin(apNodes), std::end(apNodes), CreateNode<uint64_t>);
+    Queue queue(apNodes[0]);
+
+    std::atomic<uint64_t> cRemoved(0);
+    std::atomic<uint64_t> sum(0);
+    auto Produce = [&queue, &apNodes](unsigned int thread_num)
+    {
+        for(unsigned int ii = 0; ii < cBenchmarkOps; ++ii)
+        {
+            const uint64_t ix = static_cast<uint64_t>(thread_num) * cBenchmarkOps + ii + 1;
+            apNodes[ix]->value = ix;
+            queue.Add(apNodes[ix]);
+        }
+    };
+    auto Consume = [&queue, &cRemoved, &sum, cValues]()
+    {
+        uint64_t sumByThread = 0;
+        while(cRemoved.load(std::memory_order_relaxed) < cValues)
+        {
+            uint64_t value;
+            if(nullptr != queue.Remove(value))
+            {
+                sumByThread += value;
+                cRemoved.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        sum.fetch_add(sumByThread);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> aThreads;
+    for(unsigned int ii = 0; ii < cProducers; ++ii)
+    {
+        aThreads.emplace_back(Produce, ii);
+        aThreads.emplace_back(Consume);
+    }
+    std::for_each(std::begin(aThreads), std::end(aThreads), ThreadJoin);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::for_each(std::begin(apNodes), std::end(apNodes), DeleteNode<uint64_t>);
+
+    fCorrect = (sum.load() == cValues * (cValues + 1) / 2);
+    return cValues / elapsed.count();
+}
+
+//
+// Compare a stack of intrusive nodes with a stack that copies each value into
+// and out of a node<Ty>.  Each thread pushes a message, pops one, and reads it.
+// Message ix carries ix, so the sum of what is popped checks that every
+// message was popped once.
+//
+struct Message
+{
+    uint64_t aPayload[8];
+};
+
+struct IntrusiveMessage : node<void>
+{
+    uint64_t aPayload[8];
+};
+
+template<typename Push, typename Pop>
+double BenchmarkMessages(Push push, Pop pop, _Out_ bool & fCorrect)
+{
+    std::atomic<uint64_t> checksum(0);
+    auto ThreadFunc = [&push, &pop, &checksum](unsigned int thread_num)
+    {
+        uint64_t checksumByThread = 0;
+        for(unsigned int ii = 0; ii < cBenchmarkOps; ++ii)
+        {
+            push(thread_num, ii);
+            checksumByThread += pop();
+        }
+        checksum.fetch_add(checksumByThread);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> aThreads;
+    for(unsigned int ii = 0; ii < BENCHMARK_THREADS; ++ii)
+    {
+        aThreads.emplace_back(ThreadFunc, ii);
+    }
+    std::for_each(std::begin(aThreads), std::end(aThreads), ThreadJoin);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    const uint64_t cMessages = static_cast<uint64_t>(BENCHMARK_THREADS) * cBenchmarkOps;
+    fCorrect = (checksum.load() == cMessages * (cMessages - 1) / 2);
+    return 2.0 * BENCHMARK_THREADS * cBenchmarkOps / elapsed.count();
+}
+
+void Benchmark_Layout()
+{
+    std::cout << "Benchmarking layout..." << std::endl;
+    for(unsigned int cThreads = 2; cThreads <= 8; cThreads *= 2)
+    {
+        bool fPacked;
+        bool fPadded;
+        std::cout << "  " << cThreads << " threads, ";
+        std::cout << "packed queue: " << BenchmarkQueueLayout<LockFreeQueue<uint64_t>>(cThreads, fPacked) << " values/s, ";
+        std::cout << "padded queue: " << BenchmarkQueueLayout<LockFreeQueue<uint64_t, ReclaimNone, PaddedLayout>>(cThreads, fPadded) << " values/s";
+        std::cout << ((fPacked && fPadded) ? "" : ", wrong sum") << std::endl;
+    }
+
+    //
+    // Every thread owns the nodes for its own messages, and pops whatever
+    // message is on top, which may be another thread's.
+    //
+    const size_t cMessages = BENCHMARK_THREADS * cBenchmarkOps;
+    {
+        std::vector<Message> aMessages(cMessages);
+        std::vector<node<Message>> aNodes(cMessages);
+        LockFreeStack<Message> stack;
+        bool fCorrect;
+        std::cout << "  Stack, values copied:   " << BenchmarkMessages(
+            [&](unsigned int thread_num, unsigned int ii)
+            {
+                const size_t ix = thread_num * cBenchmarkOps + ii;
+                aMessages[ix].aPayload[0] = ix;
+                aNodes[ix].value = aMessages[ix];
+                stack.Push(&aNodes[ix]);
+            },
+            [&]()
+            {
+                Message message = stack.Pop()->value;
+                return message.aPayload[0];
+            }, fCorrect) << " ops/s" << (fCorrect ? "" : ", wrong sum") << std::endl;
+    }
+    {
+        std::vector<IntrusiveMessage> aMessages(cMessages);
+        LockFreeStack<void> stack;
+        bool fCorrect;
+        std::cout << "  Stack, intrusive nodes: " << BenchmarkMessages(
+            [&](unsigned int thread_num, unsigned int ii)
+            {
+                const size_t ix = thread_num * cBenchmarkOps + ii;
+                aMessages[ix].aPayload[0] = ix;
+                stack.Push(&aMessages[ix]);
+            },
+            [&]()
+            {
+                IntrusiveMessage * pMessage = static_cast<IntrusiveMessage *>(stack.Pop());
+                return pMessage->aPayload[0];
+            }, fCorrect) << " ops/s" << (fCorrect ? "" : ", wrong sum") << std::endl;
+    }
+}
+
 //
 // Demonstrate the lock-free freelist.
 // The freelist is based off of ideas found in the freelist article in Game
@@ -514,6 +1600,135 @@ void Demo_Freelist()
     //
     fl.FreeInstance(pStruct);
 
+    //
+    // With epochs, a freed object is not reused while another thread could
+    // still be reading it.  The reader holds a guard while it uses the object.
+    //
+    LockFreeFreeList<MyStruct, ReclaimEpoch> flEpoch(10);
+    pStruct = flEpoch.NewInstance();
+    {
+        ReclaimEpoch::Guard guard;
+        flEpoch.FreeInstance(pStruct);  // not reused until the guard is released
+    }
+
+    //
+    // A Freelist can start small and add slabs as it runs out, up to a limit.
+    // This one starts with 4 MyStructs in huge pages on this thread's NUMA
+    // node, and grows to at most 10.
+    //
+    LockFreeFreeList<MyStruct> flGrowable(4, 0, 10, SLAB_HUGE_PAGES | SLAB_LOCAL_NODE);
+    MyStruct * apStructs[10];
+    for(MyStruct * & pGrown : apStructs)
+    {
+        pGrown = flGrowable.NewInstance();
+        assert(nullptr != pGrown);
+    }
+    MyStruct * pOverLimit = flGrowable.NewInstance();
+    assert(nullptr == pOverLimit && flGrowable.Capacity() == 10);
+    (void)pOverLimit;
+    for(MyStruct * pGrown : apStructs)
+    {
+        flGrowable.FreeInstance(pGrown);
+    }
+
+    //
+    // FreeAll returns every instance, freed or not, without destroying them.
+    // Each instance comes back once, so the list is full again.
+    //
+    for(int ii = 0; ii < 6; ++ii)
+    {
+        flGrowable.NewInstance();
+    }
+    flGrowable.FreeAll();
+    for(MyStruct * & pGrown : apStructs)
+    {
+        pGrown = flGrowable.NewInstance();
+        assert(nullptr != pGrown);
+    }
+    pOverLimit = flGrowable.NewInstance();
+    assert(nullptr == pOverLimit);
+    for(MyStruct * pGrown : apStructs)
+    {
+        flGrowable.FreeInstance(pGrown);
+    }
+
+    //
+    // With epochs and magazines, a freed object may be reclaimed on another
+    // thread, such as one that collects in the background.  It goes back to
+    // the shared list, so this thread can still allocate it.
+    //
+    LockFreeFreeList<MyStruct, ReclaimEpoch> flMagazines(64, 8);
+    MyStruct * apMagazine[64];
+    for(MyStruct * & pAllocated : apMagazine)
+    {
+        pAllocated = flMagazines.NewInstance();
+        assert(nullptr != pAllocated);
+    }
+    for(MyStruct * pAllocated : apMagazine)
+    {
+        flMagazines.FreeInstance(pAllocated);
+    }
+    std::thread collector([] { ReclaimEpoch::Synchronize(); });
+    collector.join();
+    for(MyStruct * & pAllocated : apMagazine)
+    {
+        pAllocated = flMagazines.NewInstance();
+        assert(nullptr != pAllocated);
+    }
+    for(MyStruct * pAllocated : apMagazine)
+    {
+        flMagazines.FreeInstance(pAllocated);
+    }
+
+    //
+    // With hazard pointers, an object freed by a thread that is still running
+    // waits in that thread's retired list.  FreeAll and the destructor wait
+    // for it rather than leave it to be returned to the list later.
+    //
+    std::unique_ptr<LockFreeFreeList<MyStruct, ReclaimHazard>> pflHazard(new LockFreeFreeList<MyStruct, ReclaimHazard>(4));
+    std::atomic<int> step(0);
+    std::thread retirer([&pflHazard, &step]
+    {
+        pflHazard->FreeInstance(pflHazard->NewInstance());
+        step.store(1, std::memory_order_release);
+        while(step.load(std::memory_order_acquire) != 2)
+        {
+            std::this_thread::yield();
+        }
+        pflHazard->FreeInstance(pflHazard->NewInstance());
+        step.store(3, std::memory_order_release);
+        while(step.load(std::memory_order_acquire) != 4)
+        {
+            std::this_thread::yield();
+        }
+    });
+    while(step.load(std::memory_order_acquire) != 1)
+    {
+        std::this_thread::yield();
+    }
+    pflHazard->FreeAll();
+    MyStruct * apHazard[4];
+    for(MyStruct * & pAllocated : apHazard)
+    {
+        pAllocated = pflHazard->NewInstance();
+        assert(nullptr != pAllocated);
+    }
+    pOverLimit = pflHazard->NewInstance();
+    assert(nullptr == pOverLimit);
+    for(MyStruct * pAllocated : apHazard)
+    {
+        pflHazard->FreeInstance(pAllocated);
+    }
+    ReclaimHazard::Synchronize();
+    step.store(2, std::memory_order_release);
+    while(step.load(std::memory_order_acquire) != 3)
+    {
+        std::this_thread::yield();
+    }
+    pflHazard.reset();
+    step.store(4, std::memory_order_release);
+    retirer.join();
+
     std::cout << "done" << std::endl;
 }
 
@@ -528,15 +1743,18 @@ int main()
     Test_CAS_assembly();
     Test_CAS_intrinsic();
     Test_CAS_windows();
+    Test_CAS_atomic();
 
     Test_CAS2_assembly();
     Test_CAS2_intrinsic();
     Test_CAS2_windows();
+    Test_CAS2_atomic();
 
     //
     // Test Lock-free Stack
     //
     StressStack<TEST_TYPE, 4096>()();
+    StressStack<TEST_TYPE, 4096, LockFreeEliminationStack<TEST_TYPE>>()("Elimination Stack");
 
     // Demo the stack
     node<MyStruct> Nodes[10];
@@ -557,18 +1775,66 @@ int main()
 
     std::for_each(std::begin(apNodes), std::end(apNodes), DeleteNode<TEST_TYPE>);
 
+    StressRecycledQueue<TEST_TYPE, 4096, ReclaimHazard>()("Recycled Queue (hazard pointers)");
+    StressRecycledQueue<TEST_TYPE, 4096, ReclaimEpoch>()("Recycled Queue (epochs)");
+
+    //
+    // Test Lock-free Ring
+    //
+    StressRing<TEST_TYPE, 4096>()();
+
     // Demo the queue
     LockFreeQueue<MyStruct> queue(&Nodes[0]);   // Nodes[0] is dummy node
 
+    MyStruct value;
     queue.Add(&Nodes[1]);
-    queue.Remove();     // returns &Nodes[1]
-    queue.Remove();     // returns nullptr;
+    queue.Remove(value);    // returns &Nodes[0], the old dummy node, and moves Nodes[1].value into value
+    queue.Remove(value);    // returns nullptr
+
+    // The values only need to be movable.
+    node<std::unique_ptr<MyStruct>> dummy;
+    node<std::unique_ptr<MyStruct>> owner(std::unique_ptr<MyStruct>(new MyStruct()));
+    LockFreeQueue<std::unique_ptr<MyStruct>> ownerQueue(&dummy);
+
+    std::unique_ptr<MyStruct> pOwned;
+    ownerQueue.Add(&owner);
+    ownerQueue.Remove(pOwned);  // returns &dummy, and pOwned now owns the MyStruct
 
     //
     // Demonstrate Lock-free Freelist
     //
     Demo_Freelist();
 
+    //
+    // Compare the cost of memory reclamation
+    //
+    Benchmark_Reclaim();
+
+    //
+    // Compare the elimination-backoff stack with the plain stack
+    //
+    Benchmark_Elimination();
+
+    //
+    // Compare the SPSC ring with the queue
+    //
+    Benchmark_Spsc();
+
+    //
+    // Compare work stealing with a global queue
+    //
+    Benchmark_Tasks();
+
+    //
+    // Compare the freelist with and without magazines
+    //
+    Benchmark_Freelist();
+
+    //
+    // Compare the container layouts
+    //
+    Benchmark_Layout();
+
     return 0;
 }
 
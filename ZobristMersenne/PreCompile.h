@@ -2,4 +2,22 @@
 
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <iterator>
 #include <iostream>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX        // keep windows.h from defining min and max over std::min and std::max
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
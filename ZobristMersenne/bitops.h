@@ -0,0 +1,77 @@
+#ifndef BITOPS_H
+#define BITOPS_H
+
+// Bit scanning for bitboards.  These compile to tzcnt/bsf and popcnt where
+// the processor has them, and to a short sequence of instructions otherwise.
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit.  The value must not be zero.
+inline int LowestBitIndex(uint64_t value)
+{
+    assert(value != 0);
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<int>(index);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if(_BitScanForward(&index, static_cast<uint32_t>(value)))
+    {
+        return static_cast<int>(index);
+    }
+    _BitScanForward(&index, static_cast<uint32_t>(value >> 32));
+    return static_cast<int>(index) + 32;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+// Index of the highest set bit.  The value must not be zero.
+inline int HighestBitIndex(uint64_t value)
+{
+    assert(value != 0);
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if(_BitScanReverse(&index, static_cast<uint32_t>(value >> 32)))
+    {
+        return static_cast<int>(index) + 32;
+    }
+    _BitScanReverse(&index, static_cast<uint32_t>(value));
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+// Clear the lowest set bit, and return its index.
+inline int PopLowestBit(uint64_t & value)
+{
+    int index = LowestBitIndex(value);
+    value &= value - 1;
+    return index;
+}
+
+inline int CountBits(uint64_t value)
+{
+#ifdef _MSC_VER
+    // __popcnt64 faults on processors without popcnt, so count in parallel instead.
+    value = value - ((value >> 1) & 0x5555555555555555);
+    value = (value & 0x3333333333333333) + ((value >> 2) & 0x3333333333333333);
+    value = (value + (value >> 4)) & 0x0f0f0f0f0f0f0f0f;
+    return static_cast<int>((value * 0x0101010101010101) >> 56);
+#else
+    return __builtin_popcountll(value);
+#endif
+}
+
+#endif
+
@@ -0,0 +1,84 @@
+#ifndef CONSTMERSENNE_H
+#define CONSTMERSENNE_H
+
+#include "mersenne64.h"
+
+// Parameters for MT19937-64
+// http://www.math.sci.hiroshima-u.ac.jp/~m-mat/MT/emt64.html
+// MT64_N (the degree of recursion) is in mersenne64.h, as it sizes the state.
+constexpr int      MT64_M = 156;                    // middle term
+constexpr uint64_t MT64_A = 0xb5026f5aa96619e9;     // vector parameter a (matrix A)
+constexpr int      MT64_U = 29;                     // integer parameter u
+constexpr uint64_t MT64_D = 0x5555555555555555;     // vector parameter d
+constexpr int      MT64_S = 17;                     // integer parameter s
+constexpr uint64_t MT64_B = 0x71d67fffeda60000;     // vector parameter b
+constexpr int      MT64_T = 37;                     // integer parameter t
+constexpr uint64_t MT64_C = 0xfff7eee000000000;     // vector parameter c
+constexpr int      MT64_L = 43;                     // integer parameter l
+constexpr uint64_t MT64_F = 6364136223846793005;    // initialization multiplier f
+
+// The separation point of one word is at bit 31, as in MT19937.
+constexpr uint64_t MT64_LLMASK = 0x000000007fffffff;
+constexpr uint64_t MT64_UMASK  = 0xffffffff80000000;
+
+// The default seed of the reference implementation, and of std::mt19937_64.
+constexpr uint64_t MT64_DEFAULT_SEED = 5489;
+
+constexpr uint64_t Twist64(uint64_t upper, uint64_t lower, uint64_t middle)
+{
+    uint64_t ui = (upper & MT64_UMASK) | (lower & MT64_LLMASK);
+    return middle ^ (ui >> 1) ^ ((ui & 1) * MT64_A);
+}
+
+constexpr uint64_t Temper64(uint64_t num)
+{
+    num ^= (num >> MT64_U) & MT64_D;
+    num ^= (num << MT64_S) & MT64_B;
+    num ^= (num << MT64_T) & MT64_C;
+    num ^= num >> MT64_L;
+
+    return num;
+}
+
+// MT19937-64 evaluated by the compiler, so that tables of random numbers
+// can be built at compile time and placed in read-only data.  This is the
+// constexpr successor to the template metaprogramming in pow2.h.  It
+// generates the same sequence as MersenneTwister64, but is meant only for
+// constant expressions, so it is written for clarity rather than speed.
+class ConstMersenneTwister64
+{
+    uint64_t m_aMT[MT64_N];
+    int m_ix;
+
+    constexpr void Regenerate()
+    {
+        for(int kk = 0; kk < MT64_N; kk++)
+        {
+            m_aMT[kk] = Twist64(m_aMT[kk], m_aMT[(kk + 1) % MT64_N], m_aMT[(kk + MT64_M) % MT64_N]);
+        }
+        m_ix = 0;
+    }
+
+public:
+    constexpr explicit ConstMersenneTwister64(uint64_t seed = MT64_DEFAULT_SEED) : m_aMT(), m_ix(MT64_N)
+    {
+        m_aMT[0] = seed;
+        for(int kk = 1; kk < MT64_N; kk++)
+        {
+            m_aMT[kk] = MT64_F * (m_aMT[kk - 1] ^ (m_aMT[kk - 1] >> 62)) + kk;
+        }
+    }
+
+    constexpr uint64_t Rand64()
+    {
+        if(m_ix == MT64_N)
+        {
+            Regenerate();
+        }
+
+        return Temper64(m_aMT[m_ix++]);
+    }
+};
+
+#endif
+
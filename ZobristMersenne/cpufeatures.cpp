@@ -0,0 +1,76 @@
+#include "PreCompile.h"
+#include "cpufeatures.h"
+
+#if defined(CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+
+// Query CPUID leaf 7 for the extended features, and XGETBV to verify that the
+// OS saves the wider registers on a context switch.  A CPU may support AVX
+// while the OS does not.
+static bool CpuHasExtendedFeature(int register_index, int bit, unsigned __int64 xcr0_mask)
+{
+    int aInfo[4];
+    __cpuid(aInfo, 0);
+    if(aInfo[0] < 7)
+    {
+        return false;
+    }
+
+    __cpuid(aInfo, 1);
+    const int OSXSAVE = 1 << 27;
+    if((aInfo[2] & OSXSAVE) == 0)
+    {
+        return false;
+    }
+    if((_xgetbv(0) & xcr0_mask) != xcr0_mask)
+    {
+        return false;
+    }
+
+    __cpuidex(aInfo, 7, 0);
+    return (aInfo[register_index] & (1 << bit)) != 0;
+}
+#endif
+
+bool CpuHasSSE2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+    return true;    // SSE2 is part of the x64 architecture
+#elif defined(CPU_X86) && defined(_MSC_VER)
+    int aInfo[4];
+    __cpuid(aInfo, 1);
+    return (aInfo[3] & (1 << 26)) != 0;     // EDX bit 26
+#elif defined(CPU_X86)
+    static const bool fSSE2 = __builtin_cpu_supports("sse2") != 0;
+    return fSSE2;
+#else
+    return false;
+#endif
+}
+
+bool CpuHasAVX2()
+{
+#if defined(CPU_X86) && defined(_MSC_VER)
+    static const bool fAVX2 = CpuHasExtendedFeature(1, 5, 0x6);     // EBX bit 5; XMM and YMM state
+    return fAVX2;
+#elif defined(CPU_X86)
+    static const bool fAVX2 = __builtin_cpu_supports("avx2") != 0;
+    return fAVX2;
+#else
+    return false;
+#endif
+}
+
+bool CpuHasAVX512F()
+{
+#if defined(CPU_X86) && defined(_MSC_VER)
+    static const bool fAVX512F = CpuHasExtendedFeature(1, 16, 0xe6);  // EBX bit 16; XMM, YMM, and ZMM state
+    return fAVX512F;
+#elif defined(CPU_X86)
+    static const bool fAVX512F = __builtin_cpu_supports("avx512f") != 0;
+    return fAVX512F;
+#else
+    return false;
+#endif
+}
+
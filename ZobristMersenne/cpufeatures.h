@@ -0,0 +1,30 @@
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+// The optimized code paths are written with x86 SIMD intrinsics, and are chosen
+// at runtime based on what the processor supports.  Other architectures always
+// use the portable code paths.
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CPU_X86
+#include <immintrin.h>
+#endif
+
+// gcc only allows intrinsics beyond the compiler's baseline instruction set in
+// functions marked with the matching target.  Visual C++ allows any intrinsic
+// in any function.
+#if defined(CPU_X86) && defined(__GNUC__)
+#define TARGET_SSE2     __attribute__((target("sse2")))
+#define TARGET_AVX2     __attribute__((target("avx2")))
+#define TARGET_AVX512   __attribute__((target("avx512f")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+bool CpuHasSSE2();
+bool CpuHasAVX2();
+bool CpuHasAVX512F();
+
+#endif
+
@@ -0,0 +1,220 @@
+#include "PreCompile.h"
+#include "gf2poly.h"
+
+int Gf2Polynomial::Degree() const
+{
+    for(size_t ii = m_aWords.size(); ii > 0; ii--)
+    {
+        uint64_t word = m_aWords[ii - 1];
+        if(word != 0)
+        {
+            int bit = 63;
+            while((word >> bit) == 0)
+            {
+                bit--;
+            }
+            return static_cast<int>((ii - 1) * 64) + bit;
+        }
+    }
+
+    return -1;
+}
+
+bool Gf2Polynomial::Coefficient(int ii) const
+{
+    size_t ixWord = ii / 64;
+    return ixWord < m_aWords.size() && ((m_aWords[ixWord] >> (ii % 64)) & 1) != 0;
+}
+
+void Gf2Polynomial::SetCoefficient(int ii)
+{
+    size_t ixWord = ii / 64;
+    if(ixWord >= m_aWords.size())
+    {
+        m_aWords.resize(ixWord + 1, 0);
+    }
+    m_aWords[ixWord] |= static_cast<uint64_t>(1) << (ii % 64);
+}
+
+// Cancel each term at or above the degree of the modulus, from the top down,
+// by adding the modulus shifted up to that term.
+void Gf2Polynomial::ReduceMod(const Gf2Polynomial & modulus)
+{
+    const int degree = modulus.Degree();
+    const size_t cModulusWords = degree / 64 + 1;
+
+    for(int ii = Degree(); ii >= degree; ii--)
+    {
+        if(!Coefficient(ii))
+        {
+            continue;
+        }
+
+        const int shift = ii - degree;
+        const size_t ixWord = shift / 64;
+        const int bit = shift % 64;
+        for(size_t jj = 0; jj < cModulusWords; jj++)
+        {
+            uint64_t word = modulus.m_aWords[jj];
+            m_aWords[ixWord + jj] ^= word << bit;
+            if(bit != 0 && ixWord + jj + 1 < m_aWords.size())
+            {
+                m_aWords[ixWord + jj + 1] ^= word >> (64 - bit);
+            }
+        }
+    }
+
+    m_aWords.resize(degree / 64 + 1);
+}
+
+// Squaring is linear over GF(2): the coefficient of x^ii moves to x^(2 * ii).
+void Gf2Polynomial::Square()
+{
+    std::vector<uint64_t> aSquare(m_aWords.size() * 2, 0);
+    for(size_t ii = 0; ii < m_aWords.size(); ii++)
+    {
+        uint64_t word = m_aWords[ii];
+        for(int bit = 0; bit < 64; bit++)
+        {
+            if((word >> bit) & 1)
+            {
+                aSquare[(2 * bit) / 64 + 2 * ii] |= static_cast<uint64_t>(1) << ((2 * bit) % 64);
+            }
+        }
+    }
+    m_aWords.swap(aSquare);
+}
+
+void Gf2Polynomial::MultiplyByX()
+{
+    m_aWords.push_back(0);
+    for(size_t ii = m_aWords.size() - 1; ii > 0; ii--)
+    {
+        m_aWords[ii] = (m_aWords[ii] << 1) | (m_aWords[ii - 1] >> 63);
+    }
+    m_aWords[0] <<= 1;
+}
+
+// Square and multiply, from the most significant bit of the exponent down.
+Gf2Polynomial Gf2Polynomial::PowerOfXMod(uint64_t exponent) const
+{
+    assert(Degree() > 0);
+
+    Gf2Polynomial result;
+    result.SetCoefficient(0);
+
+    for(int bit = 63; bit >= 0; bit--)
+    {
+        result.Square();
+        if((exponent >> bit) & 1)
+        {
+            result.MultiplyByX();
+        }
+        result.ReduceMod(*this);
+    }
+
+    return result;
+}
+
+Gf2Polynomial Gf2Polynomial::MinimalPolynomial(const std::vector<bool> & aBits)
+{
+    const int cBits = static_cast<int>(aBits.size());
+    const size_t cWords = cBits / 64 + 2;
+
+    // The connection polynomial C(x) = 1 + c1 x + ... + cL x^L satisfies
+    // s[n] = c1 s[n - 1] + ... + cL s[n - L].  Store the sequence reversed, so
+    // that the terms s[n], s[n - 1], ... are consecutive bits, and the
+    // discrepancy is a word-wise dot product with C.
+    std::vector<uint64_t> aReversed(cWords + 1, 0);
+    for(int ii = 0; ii < cBits; ii++)
+    {
+        if(aBits[ii])
+        {
+            int ixReversed = cBits - 1 - ii;
+            aReversed[ixReversed / 64] |= static_cast<uint64_t>(1) << (ixReversed % 64);
+        }
+    }
+
+    std::vector<uint64_t> aC(cWords, 0);
+    std::vector<uint64_t> aB(cWords, 0);
+    std::vector<uint64_t> aT;
+    aC[0] = aB[0] = 1;
+    int L = 0;
+    int m = 1;
+
+    for(int n = 0; n < cBits; n++)
+    {
+        // The sequence terms s[n], s[n - 1], ..., s[n - L] start at this bit.
+        const int offset = cBits - 1 - n;
+        const size_t ixWord = offset / 64;
+        const int bit = offset % 64;
+
+        uint64_t sum = 0;
+        for(size_t jj = 0; jj <= static_cast<size_t>(L) / 64; jj++)
+        {
+            uint64_t terms = aReversed[ixWord + jj] >> bit;
+            if(bit != 0)
+            {
+                terms |= aReversed[ixWord + jj + 1] << (64 - bit);
+            }
+            sum ^= terms & aC[jj];
+        }
+
+        // Only the coefficients up to L are set, so no masking is needed.
+        // The discrepancy is the parity of the sum.
+        sum ^= sum >> 32;
+        sum ^= sum >> 16;
+        sum ^= sum >> 8;
+        sum ^= sum >> 4;
+        sum ^= sum >> 2;
+        sum ^= sum >> 1;
+
+        if((sum & 1) == 0)
+        {
+            m++;
+            continue;
+        }
+
+        // C(x) = C(x) + x^m B(x)
+        const bool fLengthChange = 2 * L <= n;
+        if(fLengthChange)
+        {
+            aT = aC;
+        }
+
+        const size_t ixShift = m / 64;
+        const int bitShift = m % 64;
+        for(size_t jj = 0; jj + ixShift < cWords; jj++)
+        {
+            aC[jj + ixShift] ^= aB[jj] << bitShift;
+            if(bitShift != 0 && jj + ixShift + 1 < cWords)
+            {
+                aC[jj + ixShift + 1] ^= aB[jj] >> (64 - bitShift);
+            }
+        }
+
+        if(fLengthChange)
+        {
+            L = n + 1 - L;
+            aB.swap(aT);
+            m = 1;
+        }
+        else
+        {
+            m++;
+        }
+    }
+
+    // The characteristic polynomial is the reciprocal, x^L C(1/x).
+    Gf2Polynomial minimal;
+    for(int ii = 0; ii <= L; ii++)
+    {
+        if((aC[ii / 64] >> (ii % 64)) & 1)
+        {
+            minimal.SetCoefficient(L - ii);
+        }
+    }
+
+    return minimal;
+}
+
@@ -0,0 +1,34 @@
+#ifndef GF2POLY_H
+#define GF2POLY_H
+
+// Polynomials with coefficients in GF(2), stored one bit per coefficient:
+// bit (ii % 64) of word (ii / 64) is the coefficient of x^ii.  Addition is XOR.
+// These are used to jump the Mersenne Twister ahead, where the polynomials
+// have around 20000 terms.
+class Gf2Polynomial
+{
+    std::vector<uint64_t> m_aWords;
+
+public:
+    Gf2Polynomial() {}
+
+    int Degree() const;     // -1 for the zero polynomial
+    bool Coefficient(int ii) const;
+    void SetCoefficient(int ii);
+
+    // Returns x^exponent mod this polynomial.
+    Gf2Polynomial PowerOfXMod(uint64_t exponent) const;
+
+    // Returns the minimal polynomial of a linearly recurring bit sequence, using the
+    // Berlekamp-Massey algorithm.  A sequence of length 2 * n is enough to find a
+    // polynomial of degree n.
+    static Gf2Polynomial MinimalPolynomial(const std::vector<bool> & aBits);
+
+private:
+    void ReduceMod(const Gf2Polynomial & modulus);
+    void Square();
+    void MultiplyByX();
+};
+
+#endif
+
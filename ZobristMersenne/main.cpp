@@ -4,7 +4,13 @@
 
 #include "PreCompile.h"
 #include "mersenne.h"
+#include "mersenne64.h"
+#include "sfmt.h"
 #include "zobrist.h"
+#include "transposition.h"
+#include "zobristhasher.h"
+#include "zobristbatch.h"
+#include "positionstore.h"
 
 // Output the first 1024 generated numbers
 static void TestMT()
@@ -19,6 +25,136 @@ static void TestMT()
     }
 }
 
+// Demonstrate that bulk generation matches per-call generation
+template<typename Engine>
+static bool FillMatchesRand()
+{
+    // Start the bulk generators at an odd offset so that 64-bit values
+    // straddle the state regeneration.
+    Engine rng32;
+    Engine rng64;
+    Engine rngFill32;
+    Engine rngFill64;
+    rng32.Rand();
+    rng64.Rand();
+    rngFill32.Rand();
+    rngFill64.Rand();
+
+    std::vector<uint32_t> aValues32(5000);
+    std::vector<uint64_t> aValues64(5000);
+    rngFill32.Fill(aValues32.data(), aValues32.size());
+    rngFill64.Fill(aValues64.data(), aValues64.size());
+
+    bool fMatch = true;
+    for(size_t ii = 0; ii < aValues32.size(); ii++)
+    {
+        fMatch = fMatch && (rng32.Rand() == aValues32[ii]);
+    }
+    for(size_t ii = 0; ii < aValues64.size(); ii++)
+    {
+        fMatch = fMatch && (rng64.Rand64() == aValues64[ii]);
+    }
+
+    return fMatch;
+}
+
+// Measure the bulk generation throughput of 64-bit values in GB/s
+template<typename Engine>
+static double FillThroughput()
+{
+    // Generate 256 MB in 1 MB blocks.
+    const size_t cValuesPerBlock = (1024 * 1024) / sizeof(uint64_t);
+    const int cBlocks = 256;
+    std::vector<uint64_t> aValues64(cValuesPerBlock);
+
+    Engine rng;
+
+    auto start = std::chrono::steady_clock::now();
+    for(int ii = 0; ii < cBlocks; ii++)
+    {
+        rng.Fill(aValues64.data(), aValues64.size());
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return (cBlocks / 1024.0) / elapsed.count();
+}
+
+// Demonstrate bulk generation for each engine, and compare their throughput
+static void TestMTFill()
+{
+    bool fMatch = FillMatchesRand<MersenneTwister>() &&
+                  FillMatchesRand<MersenneTwister64>() &&
+                  FillMatchesRand<SFMT>();
+
+    if(fMatch)
+    {
+        std::cout << "Bulk generated numbers match." << std::endl;
+    }
+    else
+    {
+        std::cout << "Bulk generated numbers do _not_ match." << std::endl;
+    }
+
+    std::cout << std::dec;
+    std::cout << "Bulk generation throughput (MT19937):    " << FillThroughput<MersenneTwister>() << " GB/s" << std::endl;
+    std::cout << "Bulk generation throughput (MT19937-64): " << FillThroughput<MersenneTwister64>() << " GB/s" << std::endl;
+    std::cout << "Bulk generation throughput (SFMT19937):  " << FillThroughput<SFMT>() << " GB/s" << std::endl;
+    std::cout << std::hex;
+}
+
+// Demonstrate that jumping ahead is the same as generating and discarding values,
+// and that split generators continue from where they were split
+static void TestMTJump()
+{
+    const int cSteps = 100000;
+
+    MersenneTwister rngJump;
+    MersenneTwister rngDiscard;
+    rngJump.Jump(cSteps);
+    for(int ii = 0; ii < cSteps; ii++)
+    {
+        rngDiscard.Rand();
+    }
+
+    MersenneTwister rngSplit = rngDiscard.Split();
+    MersenneTwister rngWorker = rngJump.Split();
+
+    bool fMatch = true;
+    for(int ii = 0; ii < 1024; ii++)
+    {
+        fMatch = fMatch && (rngJump.Rand() == rngDiscard.Rand());
+        fMatch = fMatch && (rngWorker.Rand() == rngSplit.Rand());
+    }
+
+    if(fMatch)
+    {
+        std::cout << "Jumped numbers match." << std::endl;
+    }
+    else
+    {
+        std::cout << "Jumped numbers do _not_ match." << std::endl;
+    }
+}
+
+// Demonstrate that the compile-time Zobrist table matches the runtime generator
+static void TestZobristTable()
+{
+    const size_t cKeys = sizeof(g_ZobristTable.aKeys) / sizeof(uint64_t);
+
+    MersenneTwister64 rng;
+    std::vector<uint64_t> aKeys(cKeys);
+    rng.Fill(aKeys.data(), aKeys.size());
+
+    if(std::equal(aKeys.begin(), aKeys.end(), &g_ZobristTable.aKeys[0][0][0]))
+    {
+        std::cout << "Zobrist table matches." << std::endl;
+    }
+    else
+    {
+        std::cout << "Zobrist table does _not_ match." << std::endl;
+    }
+}
+
 // Demonstrate that a full hash calculation is the same as an incremental operation
 static void TestZH()
 {
@@ -48,6 +184,422 @@ static void TestZH()
     }
 }
 
+// Demonstrate that making and unmaking moves keeps the incremental key equal to
+// the full key, for every kind of move
+static void TestMakeUnmake()
+{
+    // Squares are numbered from a1 = 0 to h8 = 63.
+    const Move aMoves[] = {
+        { 12, 28, MOVE_DOUBLE_PUSH, EMPTY },    // e2-e4
+        { 51, 35, MOVE_DOUBLE_PUSH, EMPTY },    // d7-d5
+        { 28, 35, MOVE_NORMAL,      EMPTY },    // e4xd5
+        { 50, 34, MOVE_DOUBLE_PUSH, EMPTY },    // c7-c5
+        { 35, 42, MOVE_EN_PASSANT,  EMPTY },    // d5xc6 e.p.
+        { 62, 45, MOVE_NORMAL,      EMPTY },    // Ng8-f6
+        { 42, 49, MOVE_NORMAL,      EMPTY },    // c6xb7
+        { 52, 44, MOVE_NORMAL,      EMPTY },    // e7-e6
+        { 49, 56, MOVE_PROMOTION,   W_QUEEN },  // b7xa8=Q, taking black's queenside castling
+        { 61, 52, MOVE_NORMAL,      EMPTY },    // Bf8-e7
+        {  6, 21, MOVE_NORMAL,      EMPTY },    // Ng1-f3
+        { 60, 62, MOVE_CASTLE,      EMPTY },    // O-O
+        {  5, 12, MOVE_NORMAL,      EMPTY },    // Bf1-e2
+        { 48, 40, MOVE_NORMAL,      EMPTY },    // a7-a6
+        {  4,  6, MOVE_CASTLE,      EMPTY },    // O-O
+    };
+    const int cMoves = sizeof(aMoves) / sizeof(aMoves[0]);
+
+    ChessBoard chessBoard;
+    const ChessBoard initialBoard = chessBoard;
+
+    UndoState aUndo[cMoves];
+    bool fMatch = true;
+    for(int ii = 0; ii < cMoves; ii++)
+    {
+        chessBoard.MakeMove(aMoves[ii], aUndo[ii]);
+        fMatch = fMatch && (chessBoard.Key() == chessBoard.CalculateZobristKey(chessBoard.SideToMove()));
+    }
+
+    std::cout << "Castling rights after the moves: " << chessBoard.Castling() << std::endl;
+
+    for(int ii = 0; ii < cMoves; ii++)
+    {
+        chessBoard.UnmakeMove(aUndo[cMoves - 1 - ii]);
+        fMatch = fMatch && (chessBoard.Key() == chessBoard.CalculateZobristKey(chessBoard.SideToMove()));
+    }
+
+    fMatch = fMatch && (chessBoard.Key() == initialBoard.Key());
+    for(int ii = 0; ii < BOARD_SIZE; ii++)
+    {
+        fMatch = fMatch && (chessBoard.PieceAt(ii) == initialBoard.PieceAt(ii));
+    }
+    for(int ii = 0; ii < NUM_PIECE_TYPES; ii++)
+    {
+        fMatch = fMatch && (chessBoard.Bitboard(eChessPiece(ii)) == initialBoard.Bitboard(eChessPiece(ii)));
+    }
+
+    if(fMatch)
+    {
+        std::cout << "Make/unmake keys match." << std::endl;
+    }
+    else
+    {
+        std::cout << "Make/unmake keys do _not_ match." << std::endl;
+    }
+}
+
+// Check that a FEN string only grants the castling rights that its position
+// supports, and that one that fails to parse leaves the board unchanged
+static void TestSetFEN()
+{
+    ChessBoard chessBoard;
+
+    // Black's king is not on e8, and white's kingside rook is not on h1.
+    bool fMatch = chessBoard.SetFEN("3k4/8/8/8/8/8/8/R3K1R1 w KQkq - 0 1") &&
+                  chessBoard.Castling() == CASTLE_W_QUEENSIDE;
+
+    const ChessBoard validBoard = chessBoard;
+    fMatch = fMatch && !chessBoard.SetFEN("rnbqkbnr/ppppxppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    fMatch = fMatch && !chessBoard.SetFEN("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1");
+
+    // Positions that the move generator can't handle.
+    fMatch = fMatch && !chessBoard.SetFEN("P6k/8/8/8/8/8/8/7K w - - 0 1");           // pawn on the last rank
+    fMatch = fMatch && !chessBoard.SetFEN("8/8/8/8/8/8/8/8 w - - 0 1");              // no kings
+    fMatch = fMatch && !chessBoard.SetFEN("4k3/8/8/3P4/8/8/8/4K3 w - e6 0 1");       // no pawn in front of e6
+    fMatch = fMatch && !chessBoard.SetFEN("4k3/8/8/3Pp3/8/8/8/4K3 w - e3 0 1");      // wrong rank for white to move
+    fMatch = fMatch && !chessBoard.SetFEN("4k3/8/8/3P4/8/8/8/4K w - - 0 1");         // short rank
+    fMatch = fMatch && chessBoard.Key() == validBoard.Key() && chessBoard.Castling() == validBoard.Castling();
+    for(int ii = 0; ii < BOARD_SIZE; ii++)
+    {
+        fMatch = fMatch && (chessBoard.PieceAt(ii) == validBoard.PieceAt(ii));
+    }
+
+    // Black's pawn has just moved from e7 to e5.
+    fMatch = fMatch && chessBoard.SetFEN("4k3/8/8/3Pp3/8/8/8/4K3 w - e6 0 1") && chessBoard.EnPassant() == 44;
+
+    if(fMatch)
+    {
+        std::cout << "FEN castling rights and errors are handled." << std::endl;
+    }
+    else
+    {
+        std::cout << "FEN castling rights and errors are _not_ handled." << std::endl;
+    }
+}
+
+// Place stones on a Go board one at a time and in a batch, and check both
+// against a full hash of the board
+template<typename KeyT>
+static bool GoHashesMatch()
+{
+    const int GO_POINTS = 19 * 19;
+    enum { GO_BLACK, GO_WHITE, GO_STONES };
+    typedef ZobristHasher<GO_POINTS, GO_STONES, KeyT> GoHasher;
+
+    std::vector<int> aPoints(GO_POINTS, GoHasher::NO_FEATURE);
+    std::vector<ZobristFeature> aStones;
+    KeyT incrementalKey = GoHasher::Full(aPoints.begin(), aPoints.end());
+    KeyT batchKey = incrementalKey;
+
+    // Fill every third point, alternating colors.
+    for(int ii = 0; ii < GO_POINTS; ii += 3)
+    {
+        int stone = (ii / 3) % 2 == 0 ? GO_BLACK : GO_WHITE;
+        aPoints[ii] = stone;
+        aStones.push_back(ZobristFeature{ ii, stone });
+        GoHasher::Toggle(incrementalKey, ii, stone);
+    }
+    GoHasher::ToggleMany(batchKey, aStones.data(), aStones.size());
+
+    KeyT fullKey = GoHasher::Full(aPoints.begin(), aPoints.end());
+    return incrementalKey == fullKey && batchKey == fullKey;
+}
+
+// Demonstrate the generic hasher at each key width
+static void TestZobristHasher()
+{
+    if(GoHashesMatch<uint32_t>() && GoHashesMatch<uint64_t>() && GoHashesMatch<ZobristKey128>())
+    {
+        std::cout << "Go board keys match." << std::endl;
+    }
+    else
+    {
+        std::cout << "Go board keys do _not_ match." << std::endl;
+    }
+}
+
+// Measure the cost of a full hash calculation
+static void TestZHSpeed()
+{
+    ChessBoard chessBoard;
+    const int cKeys = 10000000;
+
+    uint64_t uKeys = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int ii = 0; ii < cKeys; ii++)
+    {
+        uKeys += chessBoard.CalculateZobristKey((ii & 1) ? WHITE : BLACK);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // Print the sum of the keys so that the loop cannot be optimized away.
+    std::cout << std::dec << "Full key calculation: " << (elapsed.count() * 1e9) / cKeys << " ns"
+              << std::hex << " (" << uKeys << ")" << std::endl;
+}
+
+// Hash a large batch of scrambled positions, check the keys against the full
+// key of each board, and measure the throughput on one and on all threads
+static void TestZobristBatch()
+{
+    // Positions with black to move, castling rights and en passant targets.
+    const char * const aszFENs[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 b - - 0 1",
+    };
+    const int cFENs = sizeof(aszFENs) / sizeof(aszFENs[0]);
+    const size_t cBoards = 1000000;
+
+    // Scramble each position with a few random piece moves.  The moves need not
+    // be legal, as the keys only depend on what is on the board.
+    ZobristBatch batch(cBoards);
+    std::vector<uint64_t> aExpected(cBoards);
+    MersenneTwister rng;
+    ChessBoard chessBoard;
+    for(size_t ii = 0; ii < cBoards; ii++)
+    {
+        chessBoard.SetFEN(aszFENs[ii % cFENs]);
+        for(int jj = 0; jj < 8; jj++)
+        {
+            int from = rng.Rand() % BOARD_SIZE;
+            if(chessBoard.PieceAt(from) != EMPTY)
+            {
+                chessBoard.MovePiece(from, rng.Rand() % BOARD_SIZE);
+            }
+        }
+
+        batch.SetBoard(ii, chessBoard);
+        aExpected[ii] = chessBoard.CalculateZobristKey(chessBoard.SideToMove());
+    }
+
+    std::vector<uint64_t> aKeys(cBoards);
+    const int cMaxThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    std::cout << std::dec;
+    for(int cThreads = 1; ; cThreads = cMaxThreads)
+    {
+        std::fill(aKeys.begin(), aKeys.end(), 0);
+
+        auto start = std::chrono::steady_clock::now();
+        batch.CalculateKeys(aKeys.data(), cThreads);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << "Batch hashing (" << cThreads << (cThreads == 1 ? " thread): " : " threads): ")
+                  << static_cast<uint64_t>(cBoards / elapsed.count()) << " positions/s, "
+                  << (aKeys == aExpected ? "batch keys match." : "batch keys do _not_ match.") << std::endl;
+
+        if(cThreads == cMaxThreads)
+        {
+            break;
+        }
+    }
+    std::cout << std::hex;
+}
+
+// Write a store of positions to a file, map it back in, and look up every
+// position, along with keys that aren't in the store
+static void TestPositionStore()
+{
+    const char * const pszPath = "zobrist.store";
+    const size_t cRecords = 100000;
+
+    // Keys of scrambled positions, with each position's index as its payload.
+    std::vector<PositionRecord> aRecords(cRecords);
+    MersenneTwister rng;
+    ChessBoard chessBoard;
+    for(size_t ii = 0; ii < cRecords; ii++)
+    {
+        int from = rng.Rand() % BOARD_SIZE;
+        if(chessBoard.PieceAt(from) == EMPTY || (ii % 16) == 0)
+        {
+            chessBoard = ChessBoard();
+        }
+        else
+        {
+            chessBoard.MovePiece(from, rng.Rand() % BOARD_SIZE);
+        }
+
+        aRecords[ii].key = chessBoard.CalculateZobristKey((ii & 1) ? BLACK : WHITE);
+        aRecords[ii].payload = ii;
+    }
+
+    PositionStore store;
+    if(!PositionStore::Write(pszPath, aRecords) || !store.Open(pszPath))
+    {
+        std::cout << "Position store could _not_ be written and opened." << std::endl;
+        return;
+    }
+
+    // Duplicate positions keep the payload of the first record.
+    bool fMatch = true;
+    uint64_t payload;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t ii = 0; ii < cRecords; ii++)
+    {
+        fMatch = fMatch && store.Find(aRecords[ii].key, payload) && aRecords[payload].key == aRecords[ii].key &&
+                 payload <= ii;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    MersenneTwister64 rngMissing;
+    for(int ii = 0; ii < 1000; ii++)
+    {
+        fMatch = fMatch && !store.Find(rngMissing.Rand64(), payload);
+    }
+
+    std::cout << std::dec << "Position store: " << store.Size() << " positions, "
+              << (elapsed.count() * 1e9) / cRecords << " ns per lookup" << std::hex << std::endl;
+    if(fMatch)
+    {
+        std::cout << "Position store lookups match." << std::endl;
+    }
+    else
+    {
+        std::cout << "Position store lookups do _not_ match." << std::endl;
+    }
+    store.Close();
+
+    // A store written for a different Zobrist table must not open.
+    std::FILE * pFile = std::fopen(pszPath, "r+b");
+    if(pFile != nullptr)
+    {
+        const uint64_t otherSeed = ZOBRIST_SEED + 1;
+        std::fseek(pFile, 16, SEEK_SET);    // offset of the table seed
+        std::fwrite(&otherSeed, sizeof(otherSeed), 1, pFile);
+        std::fclose(pFile);
+    }
+    if(store.Open(pszPath))
+    {
+        std::cout << "Position store with another seed was _not_ rejected." << std::endl;
+    }
+    else
+    {
+        std::cout << "Position store with another seed was rejected." << std::endl;
+    }
+
+    std::remove(pszPath);
+}
+
+// Data derived from the key, so that a hit can be checked against the key
+// it was returned for
+static TranspositionData DataForKey(uint64_t key)
+{
+    TranspositionData data;
+    data.move  = static_cast<uint16_t>(key >> 16);
+    data.score = static_cast<int16_t>(key >> 32);
+    data.depth = static_cast<uint8_t>((key >> 48) & 0x3f);
+    data.bound = BOUND_EXACT;
+
+    return data;
+}
+
+// Probe for keys drawn from a shared pool, and store the misses
+static void TTThreadFunc(
+    TranspositionTable *          pTable,
+    const std::vector<uint64_t> * paKeys,
+    uint32_t                      seed,
+    TranspositionStats *          pStats,
+    bool *                        pfMatch)
+{
+    MersenneTwister rng(seed);
+
+    for(int ii = 0; ii < 1000000; ii++)
+    {
+        uint64_t key = (*paKeys)[rng.Rand() % paKeys->size()];
+        TranspositionData expected = DataForKey(key);
+        TranspositionData data;
+
+        if(pTable->Probe(key, data, *pStats))
+        {
+            *pfMatch = *pfMatch && (data.move == expected.move) && (data.score == expected.score) &&
+                                   (data.depth == expected.depth) && (data.bound == expected.bound);
+        }
+        else
+        {
+            pTable->Store(key, expected, *pStats);
+        }
+    }
+}
+
+// Demonstrate a transposition table shared between threads without locks,
+// under each replacement policy
+static void TestTT()
+{
+    const eReplacement aPolicies[] = { REPLACE_ALWAYS, REPLACE_DEPTH, REPLACE_TWO_TIER };
+    const char * const aPolicyNames[] = { "always", "depth", "two-tier" };
+
+    // Prefetch the bucket for the key after a move, while the board is updated.
+    {
+        TranspositionTable table(1024 * 1024);
+        TranspositionStats stats;
+        ChessBoard chessBoard;
+
+        uint64_t key = chessBoard.CalculateZobristKey(WHITE);
+        uint64_t newKey = chessBoard.UpdateZobristKey(key, W_PAWN, 8, 24);
+        table.Prefetch(newKey);
+        chessBoard.MovePiece(8, 24);
+
+        TranspositionData data = DataForKey(newKey);
+        table.Store(newKey, data, stats);
+        if(table.Probe(chessBoard.CalculateZobristKey(BLACK), data, stats))
+        {
+            std::cout << "Transposition table found the moved position." << std::endl;
+        }
+        else
+        {
+            std::cout << "Transposition table did _not_ find the moved position." << std::endl;
+        }
+        std::cout << "Transposition table huge pages: " << (table.UsesHugePages() ? "yes" : "no") << std::endl;
+    }
+
+    // Four times as many keys as entries, so that there are hits, collisions and overwrites.
+    const size_t cbTable = 1024 * 1024;
+    std::vector<uint64_t> aKeys(cbTable / 4);
+    MersenneTwister64 rngKeys;
+    rngKeys.Fill(aKeys.data(), aKeys.size());
+
+    std::cout << std::dec;
+    for(int ii = 0; ii < 3; ii++)
+    {
+        TranspositionTable table(cbTable, aPolicies[ii]);
+
+        const int cThreads = 4;
+        std::vector<TranspositionStats> aStats(cThreads);
+        bool afMatch[cThreads];
+        std::vector<std::thread> aThreads;
+        for(int jj = 0; jj < cThreads; jj++)
+        {
+            afMatch[jj] = true;
+            aThreads.push_back(std::thread(TTThreadFunc, &table, &aKeys, jj + 1, &aStats[jj], &afMatch[jj]));
+        }
+
+        TranspositionStats total;
+        bool fMatch = true;
+        for(int jj = 0; jj < cThreads; jj++)
+        {
+            aThreads[jj].join();
+            total += aStats[jj];
+            fMatch = fMatch && afMatch[jj];
+        }
+
+        std::cout << "Transposition table (" << aPolicyNames[ii] << "): "
+                  << total.cProbes << " probes, " << total.cHits << " hits, "
+                  << total.cCollisions << " collisions, " << total.cOverwrites << " overwrites, "
+                  << (fMatch ? "all hits match." : "hits do _not_ match.") << std::endl;
+    }
+    std::cout << std::hex;
+}
+
 int main()
 {
     std::cout.setf(std::ios::showbase);
@@ -55,11 +607,21 @@ int main()
 
     std::cout << "-Testing Mersenne Twister-" << std::endl;
     TestMT();
+    TestMTFill();
+    TestMTJump();
 
     std::cout << std::endl;
 
     std::cout << "-Testing Zobrist Hash-" << std::endl;
+    TestZobristTable();
     TestZH();
+    TestMakeUnmake();
+    TestSetFEN();
+    TestZobristHasher();
+    TestZHSpeed();
+    TestZobristBatch();
+    TestPositionStore();
+    TestTT();
 
     return 0;
 }
@@ -1,14 +1,16 @@
 #include "PreCompile.h"
 #include "mersenne.h"
 #include "pow2.h"
+#include "cpufeatures.h"
+#include "gf2poly.h"
 
 // Parameters for MT19937
 // See Matsumoto for definition of parameters, and
 // alternate parameters for different k-distributions.
 // http://en.wikipedia.org/wiki/Mersenne_twister
 // http://www.math.sci.hiroshima-u.ac.jp/~m-mat/MT/ARTICLES/mt.pdf
+// MT_N (the degree of recursion) is in mersenne.h, as it sizes the state.
 static const int      MT_W = 32;            // word size
-static const int      MT_N = 624;           // degree of recursion
 static const int      MT_M = 397;           // middle term
 static const int      MT_R = 31;            // separation point of one word
 static const uint32_t MT_A = 0x9908b0df;    // vector parameter a (matrix A)
@@ -18,6 +20,7 @@ static const uint32_t MT_B = 0x9d2c5680;    // vector parameter b
 static const int      MT_T = 15;            // integer parameter t
 static const uint32_t MT_C = 0xefc60000;    // vector parameter c
 static const int      MT_L = 18;            // integer parameter l
+static const uint32_t MT_F = 1812433253;    // initialization multiplier f
 
 // Autogenerate the masks based on the R parameter. All of the
 // proposed MT parameters have a 32-bit word size, so I assume that.
@@ -27,8 +30,9 @@ static const uint32_t MT_UMASK  = 0xffffffff - Pow2Minus1<MT_R>::value;
 // All values for the array are fine initial seed choices, except for
 // an array of all zeros.  The Mersenne Twister paper states that
 // these numbers should be odd, so choose the first 624 prime numbers,
-// of which, 623 of them are odd.
-static uint32_t s_aMT[MT_N] = {
+// of which, 623 of them are odd.  This is the state of a default
+// constructed generator.
+static const uint32_t s_aPrimes[MT_N] = {
        2,    3,    5,    7,   11,   13,   17,   19,   23,   29,
       31,   37,   41,   43,   47,   53,   59,   61,   67,   71,
       73,   79,   83,   89,   97,  101,  103,  107,  109,  113,
@@ -94,20 +98,339 @@ static uint32_t s_aMT[MT_N] = {
     4591, 4597, 4603, 4621
 };
 
+// Compute the next value of one word of the state from the word itself
+// (upper bit), its successor (lower bits), and the middle term.
+// Multiplying by the low bit of ui selects between 0 and MT_A without a branch.
+static inline uint32_t Twist(uint32_t upper, uint32_t lower, uint32_t middle)
+{
+    uint32_t ui = (upper & MT_UMASK) | (lower & MT_LLMASK);
+    return middle ^ (ui >> 1) ^ ((ui & 0x00000001) * MT_A);
+}
+
+// The recurrence reads words kk + 1 and kk + MT_M, so the loop is split where
+// each of those wraps around to the start of the state.  This eliminates the
+// modulus operators.  In the first segment, the middle term has not yet been
+// regenerated; in the second, it has.
+static void RegenerateScalar(uint32_t * pMT)
+{
+    int kk = 0;
+    for(; kk < MT_N - MT_M; kk++)
+    {
+        pMT[kk] = Twist(pMT[kk], pMT[kk + 1], pMT[kk + MT_M]);
+    }
+    for(; kk < MT_N - 1; kk++)
+    {
+        pMT[kk] = Twist(pMT[kk], pMT[kk + 1], pMT[kk + MT_M - MT_N]);
+    }
+    pMT[MT_N - 1] = Twist(pMT[MT_N - 1], pMT[0], pMT[MT_M - 1]);
+}
+
+#ifdef CPU_X86
+
+// The vector versions compute several consecutive words at once.  This is safe
+// because all loads for a group happen before its store, and the middle term is
+// always at least MT_N - MT_M (227) words away from the word being computed.
+// The low bit of ui is broadcast across the word with shifts to form the mask
+// for MT_A, as SSE2 has no 32-bit multiply.
+TARGET_SSE2 static void RegenerateSSE2(uint32_t * pMT)
+{
+    const __m128i upperMask = _mm_set1_epi32(static_cast<int>(MT_UMASK));
+    const __m128i lowerMask = _mm_set1_epi32(static_cast<int>(MT_LLMASK));
+    const __m128i matrixA   = _mm_set1_epi32(static_cast<int>(MT_A));
+
+    int kk = 0;
+    for(; kk + 4 <= MT_N - MT_M; kk += 4)
+    {
+        __m128i upper  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pMT[kk]));
+        __m128i lower  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pMT[kk + 1]));
+        __m128i middle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pMT[kk + MT_M]));
+        __m128i ui     = _mm_or_si128(_mm_and_si128(upper, upperMask), _mm_and_si128(lower, lowerMask));
+        __m128i mag    = _mm_and_si128(_mm_srai_epi32(_mm_slli_epi32(ui, 31), 31), matrixA);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&pMT[kk]), _mm_xor_si128(_mm_xor_si128(middle, _mm_srli_epi32(ui, 1)), mag));
+    }
+    for(; kk < MT_N - MT_M; kk++)
+    {
+        pMT[kk] = Twist(pMT[kk], pMT[kk + 1], pMT[kk + MT_M]);
+    }
+    for(; kk + 4 <= MT_N - 1; kk += 4)
+    {
+        __m128i upper  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pMT[kk]));
+        __m128i lower  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pMT[kk + 1]));
+        __m128i middle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pMT[kk + MT_M - MT_N]));
+        __m128i ui     = _mm_or_si128(_mm_and_si128(upper, upperMask), _mm_and_si128(lower, lowerMask));
+        __m128i mag    = _mm_and_si128(_mm_srai_epi32(_mm_slli_epi32(ui, 31), 31), matrixA);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&pMT[kk]), _mm_xor_si128(_mm_xor_si128(middle, _mm_srli_epi32(ui, 1)), mag));
+    }
+    for(; kk < MT_N - 1; kk++)
+    {
+        pMT[kk] = Twist(pMT[kk], pMT[kk + 1], pMT[kk + MT_M - MT_N]);
+    }
+    pMT[MT_N - 1] = Twist(pMT[MT_N - 1], pMT[0], pMT[MT_M - 1]);
+}
+
+TARGET_AVX2 static void RegenerateAVX2(uint32_t * pMT)
+{
+    const __m256i upperMask = _mm256_set1_epi32(static_cast<int>(MT_UMASK));
+    const __m256i lowerMask = _mm256_set1_epi32(static_cast<int>(MT_LLMASK));
+    const __m256i matrixA   = _mm256_set1_epi32(static_cast<int>(MT_A));
+
+    int kk = 0;
+    for(; kk + 8 <= MT_N - MT_M; kk += 8)
+    {
+        __m256i upper  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[kk]));
+        __m256i lower  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[kk + 1]));
+        __m256i middle = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[kk + MT_M]));
+        __m256i ui     = _mm256_or_si256(_mm256_and_si256(upper, upperMask), _mm256_and_si256(lower, lowerMask));
+        __m256i mag    = _mm256_and_si256(_mm256_srai_epi32(_mm256_slli_epi32(ui, 31), 31), matrixA);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&pMT[kk]), _mm256_xor_si256(_mm256_xor_si256(middle, _mm256_srli_epi32(ui, 1)), mag));
+    }
+    for(; kk < MT_N - MT_M; kk++)
+    {
+        pMT[kk] = Twist(pMT[kk], pMT[kk + 1], pMT[kk + MT_M]);
+    }
+    for(; kk + 8 <= MT_N - 1; kk += 8)
+    {
+        __m256i upper  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[kk]));
+        __m256i lower  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[kk + 1]));
+        __m256i middle = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[kk + MT_M - MT_N]));
+        __m256i ui     = _mm256_or_si256(_mm256_and_si256(upper, upperMask), _mm256_and_si256(lower, lowerMask));
+        __m256i mag    = _mm256_and_si256(_mm256_srai_epi32(_mm256_slli_epi32(ui, 31), 31), matrixA);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&pMT[kk]), _mm256_xor_si256(_mm256_xor_si256(middle, _mm256_srli_epi32(ui, 1)), mag));
+    }
+    for(; kk < MT_N - 1; kk++)
+    {
+        pMT[kk] = Twist(pMT[kk], pMT[kk + 1], pMT[kk + MT_M - MT_N]);
+    }
+    pMT[MT_N - 1] = Twist(pMT[MT_N - 1], pMT[0], pMT[MT_M - 1]);
+}
+
+#endif  // CPU_X86
+
+// Temper a word of the state into an output value.
+static inline uint32_t Temper(uint32_t num)
+{
+    num ^= num >> MT_U;
+    num ^= num << MT_S & MT_B;
+    num ^= num << MT_T & MT_C;
+    num ^= num >> MT_L;
+
+    return num;
+}
+
+static void TemperScalar(const uint32_t * pMT, uint32_t * pOut, size_t cValues)
+{
+    for(size_t ii = 0; ii < cValues; ii++)
+    {
+        pOut[ii] = Temper(pMT[ii]);
+    }
+}
+
+// Rand64() puts the first 32-bit value in the upper half.
+static void TemperPairsScalar(const uint32_t * pMT, uint64_t * pOut, size_t cValues)
+{
+    for(size_t ii = 0; ii < cValues; ii++)
+    {
+        pOut[ii] = (static_cast<uint64_t>(Temper(pMT[2 * ii])) << 32) | Temper(pMT[2 * ii + 1]);
+    }
+}
+
+#ifdef CPU_X86
+
+TARGET_SSE2 static inline __m128i Temper4(__m128i num)
+{
+    num = _mm_xor_si128(num, _mm_srli_epi32(num, MT_U));
+    num = _mm_xor_si128(num, _mm_and_si128(_mm_slli_epi32(num, MT_S), _mm_set1_epi32(static_cast<int>(MT_B))));
+    num = _mm_xor_si128(num, _mm_and_si128(_mm_slli_epi32(num, MT_T), _mm_set1_epi32(static_cast<int>(MT_C))));
+    return _mm_xor_si128(num, _mm_srli_epi32(num, MT_L));
+}
+
+TARGET_SSE2 static void TemperSSE2(const uint32_t * pMT, uint32_t * pOut, size_t cValues)
+{
+    size_t ii = 0;
+    for(; ii + 4 <= cValues; ii += 4)
+    {
+        __m128i num = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pMT[ii]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&pOut[ii]), Temper4(num));
+    }
+    TemperScalar(pMT + ii, pOut + ii, cValues - ii);
+}
+
+// Swapping adjacent words puts the first of each pair in the upper half
+// of each little-endian 64-bit value.
+TARGET_SSE2 static void TemperPairsSSE2(const uint32_t * pMT, uint64_t * pOut, size_t cValues)
+{
+    size_t ii = 0;
+    for(; ii + 2 <= cValues; ii += 2)
+    {
+        __m128i num = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pMT[2 * ii]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&pOut[ii]), _mm_shuffle_epi32(Temper4(num), _MM_SHUFFLE(2, 3, 0, 1)));
+    }
+    TemperPairsScalar(pMT + 2 * ii, pOut + ii, cValues - ii);
+}
+
+TARGET_AVX2 static inline __m256i Temper8(__m256i num)
+{
+    num = _mm256_xor_si256(num, _mm256_srli_epi32(num, MT_U));
+    num = _mm256_xor_si256(num, _mm256_and_si256(_mm256_slli_epi32(num, MT_S), _mm256_set1_epi32(static_cast<int>(MT_B))));
+    num = _mm256_xor_si256(num, _mm256_and_si256(_mm256_slli_epi32(num, MT_T), _mm256_set1_epi32(static_cast<int>(MT_C))));
+    return _mm256_xor_si256(num, _mm256_srli_epi32(num, MT_L));
+}
+
+TARGET_AVX2 static void TemperAVX2(const uint32_t * pMT, uint32_t * pOut, size_t cValues)
+{
+    size_t ii = 0;
+    for(; ii + 8 <= cValues; ii += 8)
+    {
+        __m256i num = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[ii]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&pOut[ii]), Temper8(num));
+    }
+    TemperScalar(pMT + ii, pOut + ii, cValues - ii);
+}
+
+TARGET_AVX2 static void TemperPairsAVX2(const uint32_t * pMT, uint64_t * pOut, size_t cValues)
+{
+    size_t ii = 0;
+    for(; ii + 4 <= cValues; ii += 4)
+    {
+        __m256i num = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[2 * ii]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&pOut[ii]), _mm256_shuffle_epi32(Temper8(num), _MM_SHUFFLE(2, 3, 0, 1)));
+    }
+    TemperPairsScalar(pMT + 2 * ii, pOut + ii, cValues - ii);
+}
+
+#endif  // CPU_X86
+
+// The implementations of the bulk operations, chosen once for the processor.
+struct MersenneKernels
+{
+    void (*pfnRegenerate)(uint32_t * pMT);
+    void (*pfnTemper)(const uint32_t * pMT, uint32_t * pOut, size_t cValues);
+    void (*pfnTemperPairs)(const uint32_t * pMT, uint64_t * pOut, size_t cValues);
+};
+
+static MersenneKernels ChooseKernels()
+{
+    MersenneKernels kernels = { RegenerateScalar, TemperScalar, TemperPairsScalar };
+
+#ifdef CPU_X86
+    if(CpuHasAVX2())
+    {
+        kernels.pfnRegenerate  = RegenerateAVX2;
+        kernels.pfnTemper      = TemperAVX2;
+        kernels.pfnTemperPairs = TemperPairsAVX2;
+    }
+    else if(CpuHasSSE2())
+    {
+        kernels.pfnRegenerate  = RegenerateSSE2;
+        kernels.pfnTemper      = TemperSSE2;
+        kernels.pfnTemperPairs = TemperPairsSSE2;
+    }
+#endif
+
+#ifndef NDEBUG
+    // The optimized versions must produce exactly the same output as the scalar versions.
+    uint32_t aExpected[MT_N];
+    uint32_t aActual[MT_N];
+    std::copy(std::begin(s_aPrimes), std::end(s_aPrimes), std::begin(aExpected));
+    std::copy(std::begin(s_aPrimes), std::end(s_aPrimes), std::begin(aActual));
+    RegenerateScalar(aExpected);
+    kernels.pfnRegenerate(aActual);
+    assert(std::equal(std::begin(aExpected), std::end(aExpected), std::begin(aActual)));
+
+    uint32_t aTempered[MT_N];
+    TemperScalar(aExpected, aExpected, MT_N);
+    kernels.pfnTemper(aActual, aTempered, MT_N);
+    assert(std::equal(std::begin(aExpected), std::end(aExpected), std::begin(aTempered)));
+
+    uint64_t aExpectedPairs[MT_N / 2];
+    uint64_t aActualPairs[MT_N / 2];
+    TemperPairsScalar(aActual, aExpectedPairs, MT_N / 2);
+    kernels.pfnTemperPairs(aActual, aActualPairs, MT_N / 2);
+    assert(std::equal(std::begin(aExpectedPairs), std::end(aExpectedPairs), std::begin(aActualPairs)));
+#endif
+
+    return kernels;
+}
+
+static const MersenneKernels & Kernels()
+{
+    static const MersenneKernels kernels = ChooseKernels();
+    return kernels;
+}
+
 void MersenneTwister::Regenerate()
 {
-    // NOTE: this should be unrolled in an optimized version
-    // to eliminate the modulus operator.
-    for(int kk = 0; kk < MT_N; kk++)
+    Kernels().pfnRegenerate(m_aMT);
+}
+
+// Seed the state from a single word (init_genrand in the reference code).
+void MersenneTwister::Seed(uint32_t seed)
+{
+    m_aMT[0] = seed;
+    for(int kk = 1; kk < MT_N; kk++)
+    {
+        m_aMT[kk] = MT_F * (m_aMT[kk - 1] ^ (m_aMT[kk - 1] >> 30)) + kk;
+    }
+}
+
+// Seed the state from an array of words (init_by_array in the reference code).
+// Every word of the key affects the entire state.
+void MersenneTwister::Seed(
+    const uint32_t * pKey,
+    size_t           cKey)
+{
+    assert(pKey != nullptr && cKey > 0);
+
+    Seed(19650218);
+
+    int ii = 1;
+    size_t jj = 0;
+    for(size_t kk = (MT_N > cKey ? MT_N : cKey); kk > 0; kk--)
+    {
+        m_aMT[ii] = (m_aMT[ii] ^ ((m_aMT[ii - 1] ^ (m_aMT[ii - 1] >> 30)) * 1664525)) + pKey[jj] + static_cast<uint32_t>(jj);
+        ii++;
+        jj++;
+        if(ii >= MT_N)
+        {
+            m_aMT[0] = m_aMT[MT_N - 1];
+            ii = 1;
+        }
+        if(jj >= cKey)
+        {
+            jj = 0;
+        }
+    }
+    for(int kk = MT_N - 1; kk > 0; kk--)
     {
-        uint32_t ui = (s_aMT[kk] & MT_UMASK) | (s_aMT[(kk + 1) % MT_N] & MT_LLMASK);
-        s_aMT[kk] = s_aMT[(kk + MT_M) % MT_N] ^ (ui >> 1) ^ ((ui & 0x00000001) ? MT_A : 0);
+        m_aMT[ii] = (m_aMT[ii] ^ ((m_aMT[ii - 1] ^ (m_aMT[ii - 1] >> 30)) * 1566083941)) - ii;
+        ii++;
+        if(ii >= MT_N)
+        {
+            m_aMT[0] = m_aMT[MT_N - 1];
+            ii = 1;
+        }
     }
+
+    m_aMT[0] = 0x80000000;    // MSB is 1, assuring a non-zero initial state
 }
 
 MersenneTwister::MersenneTwister()
 {
-    // s_aMT is already initialized with the first N primes.
+    std::copy(std::begin(s_aPrimes), std::end(s_aPrimes), std::begin(m_aMT));
+    Regenerate();
+}
+
+MersenneTwister::MersenneTwister(uint32_t seed)
+{
+    Seed(seed);
+    Regenerate();
+}
+
+MersenneTwister::MersenneTwister(
+    const uint32_t * pKey,
+    size_t           cKey)
+{
+    Seed(pKey, cKey);
     Regenerate();
 }
 
@@ -120,14 +443,7 @@ uint32_t MersenneTwister::Rand()
         Regenerate();
     }
 
-    uint32_t num;
-    num = s_aMT[m_ix++];
-    num ^= num >> MT_U;
-    num ^= num << MT_S & MT_B;
-    num ^= num << MT_T & MT_C;
-    num ^= num >> MT_L;
-
-    return num;
+    return Temper(m_aMT[m_ix++]);
 }
 
 uint64_t MersenneTwister::Rand64()
@@ -141,3 +457,171 @@ uint64_t MersenneTwister::Rand64()
     return ui64;
 }
 
+// Temper whole runs of the state straight into the buffer, rather than
+// paying for the bounds check and scalar tempering of each Rand() call.
+void MersenneTwister::Fill(
+    uint32_t * pBuffer,
+    size_t     cValues)
+{
+    while(cValues > 0)
+    {
+        if(m_ix == MT_N)
+        {
+            m_ix = 0;
+
+            Regenerate();
+        }
+
+        size_t cRun = std::min(static_cast<size_t>(MT_N - m_ix), cValues);
+        Kernels().pfnTemper(&m_aMT[m_ix], pBuffer, cRun);
+
+        m_ix += static_cast<int>(cRun);
+        pBuffer += cRun;
+        cValues -= cRun;
+    }
+}
+
+void MersenneTwister::Fill(
+    uint64_t * pBuffer,
+    size_t     cValues)
+{
+    while(cValues > 0)
+    {
+        if(m_ix == MT_N)
+        {
+            m_ix = 0;
+
+            Regenerate();
+        }
+
+        size_t cRun = std::min(static_cast<size_t>(MT_N - m_ix) / 2, cValues);
+        if(cRun == 0)
+        {
+            // After an odd number of calls to Rand(), one value in each
+            // state straddles the regeneration.
+            *pBuffer++ = Rand64();
+            cValues--;
+            continue;
+        }
+
+        Kernels().pfnTemperPairs(&m_aMT[m_ix], pBuffer, cRun);
+
+        m_ix += static_cast<int>(2 * cRun);
+        pBuffer += cRun;
+        cValues -= cRun;
+    }
+}
+
+// Advance a circular copy of the state by one word.  The oldest word, at
+// ixOldest, is replaced with the next word of the sequence.
+static inline void StepState(uint32_t * pMT, int & ixOldest)
+{
+    int ixNext   = (ixOldest + 1 == MT_N) ? 0 : ixOldest + 1;
+    int ixMiddle = (ixOldest + MT_M >= MT_N) ? ixOldest + MT_M - MT_N : ixOldest + MT_M;
+
+    pMT[ixOldest] = Twist(pMT[ixOldest], pMT[ixNext], pMT[ixMiddle]);
+    ixOldest = ixNext;
+}
+
+// The characteristic polynomial of the recurrence, which has degree 19937.
+// Rather than embed the coefficients, find it from the recurrence itself.
+// The polynomial is primitive (the period is the prime 2^19937 - 1), so it is
+// the minimal polynomial of any bit of the generated words.
+static const Gf2Polynomial & CharacteristicPolynomial()
+{
+    static const Gf2Polynomial characteristic = []
+    {
+        const int degree = MT_N * MT_W - MT_R;
+
+        // After one regeneration, every word is part of the recurring sequence.
+        uint32_t aMT[MT_N];
+        std::copy(std::begin(s_aPrimes), std::end(s_aPrimes), std::begin(aMT));
+        RegenerateScalar(aMT);
+
+        std::vector<bool> aBits(2 * degree);
+        int ixOldest = 0;
+        for(size_t ii = 0; ii < aBits.size(); ii++)
+        {
+            aBits[ii] = (aMT[ixOldest] & 0x00000001) != 0;
+            StepState(aMT, ixOldest);
+        }
+
+        Gf2Polynomial minimal = Gf2Polynomial::MinimalPolynomial(aBits);
+        assert(minimal.Degree() == degree);
+        return minimal;
+    }();
+
+    return characteristic;
+}
+
+// Advancing the sequence by one word is a linear map T on the state, and
+// p(T) = 0 for the characteristic polynomial p.  So T^n is equal to
+// (x^n mod p)(T), which has fewer than 19937 terms, however large n is.
+// This applies the polynomial 'jump' to the state.  (Haramoto et al., "Efficient
+// Jump Ahead for F2-Linear Random Number Generators", 2008)
+void MersenneTwister::JumpState(const Gf2Polynomial & jump)
+{
+    // Generate the first m_ix words of the next state in place.  This leaves
+    // the MT_N words following the last returned value in a circular buffer
+    // that starts at ixOldest.
+    int ixOldest = 0;
+    for(int ii = 0; ii < m_ix; ii++)
+    {
+        StepState(m_aMT, ixOldest);
+    }
+
+    // Sum the states T^ii(state) for each term x^ii of the polynomial.
+    uint32_t aJumped[MT_N] = {};
+    const int degree = jump.Degree();
+    for(int ii = 0; ii <= degree; ii++)
+    {
+        if(jump.Coefficient(ii))
+        {
+            const int cWrap = MT_N - ixOldest;
+            for(int kk = 0; kk < cWrap; kk++)
+            {
+                aJumped[kk] ^= m_aMT[ixOldest + kk];
+            }
+            for(int kk = cWrap; kk < MT_N; kk++)
+            {
+                aJumped[kk] ^= m_aMT[kk - cWrap];
+            }
+        }
+
+        StepState(m_aMT, ixOldest);
+    }
+
+    // The jumped state has been used up, so the next value will be
+    // taken from the start of the following state.
+    std::copy(std::begin(aJumped), std::end(aJumped), std::begin(m_aMT));
+    m_ix = MT_N;
+}
+
+void MersenneTwister::Jump(uint64_t steps)
+{
+    if(steps < static_cast<uint64_t>(MT_N))
+    {
+        // The values are in the current or next state, so just skip over them.
+        int ix = m_ix + static_cast<int>(steps);
+        if(ix > MT_N)
+        {
+            Regenerate();
+            ix -= MT_N;
+        }
+        m_ix = ix;
+        return;
+    }
+
+    // JumpState() leaves the generator MT_N values past the current position.
+    JumpState(CharacteristicPolynomial().PowerOfXMod(steps - MT_N));
+}
+
+MersenneTwister MersenneTwister::Split()
+{
+    // 2^64 - MT_N, wrapped around in 64-bit arithmetic.
+    static const Gf2Polynomial jump = CharacteristicPolynomial().PowerOfXMod(0 - static_cast<uint64_t>(MT_N));
+
+    MersenneTwister split(*this);
+    JumpState(jump);
+    return split;
+}
@@ -1,17 +1,44 @@
 #ifndef MERSENNE_H
 #define MERSENNE_H
 
+class Gf2Polynomial;
+
+const int MT_N = 624;           // degree of recursion (words of state)
+
+// Each instance owns its state, so generators on different threads do not
+// interfere.  A single instance is not safe to share between threads.
 class MersenneTwister
 {
+    uint32_t m_aMT[MT_N];
     int m_ix = 0;
 
     void Regenerate();
+    void Seed(uint32_t seed);
+    void Seed(const uint32_t * pKey, size_t cKey);
+    void JumpState(const Gf2Polynomial & jump);
 
 public:
     MersenneTwister();
+    explicit MersenneTwister(uint32_t seed);
+    MersenneTwister(const uint32_t * pKey, size_t cKey);
 
     uint32_t Rand();
     uint64_t Rand64();
+
+    // Fill a buffer with the values of that many calls to Rand() or Rand64().
+    void Fill(uint32_t * pBuffer, size_t cValues);
+    void Fill(uint64_t * pBuffer, size_t cValues);
+
+    // Advance the generator as if Rand() had been called 'steps' times, without
+    // generating the values.  Jumps past the next state take milliseconds, as
+    // they compute a polynomial with around 20000 terms.
+    void Jump(uint64_t steps);
+
+    // Returns a generator that continues from the current position, and jumps
+    // this generator 2^64 values ahead.  Calling Split() once per worker thread
+    // gives each worker a stream that cannot overlap any other for 2^64 values.
+    // The jump polynomial is only computed for the first call.
+    MersenneTwister Split();
 };
 
 #endif
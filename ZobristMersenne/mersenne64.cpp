@@ -0,0 +1,240 @@
+#include "PreCompile.h"
+#include "mersenne64.h"
+#include "constmersenne.h"
+#include "cpufeatures.h"
+
+// See RegenerateScalar() in mersenne.cpp for the loop structure.
+static void Regenerate64Scalar(uint64_t * pMT)
+{
+    int kk = 0;
+    for(; kk < MT64_N - MT64_M; kk++)
+    {
+        pMT[kk] = Twist64(pMT[kk], pMT[kk + 1], pMT[kk + MT64_M]);
+    }
+    for(; kk < MT64_N - 1; kk++)
+    {
+        pMT[kk] = Twist64(pMT[kk], pMT[kk + 1], pMT[kk + MT64_M - MT64_N]);
+    }
+    pMT[MT64_N - 1] = Twist64(pMT[MT64_N - 1], pMT[0], pMT[MT64_M - 1]);
+}
+
+static void Temper64Scalar(const uint64_t * pMT, uint64_t * pOut, size_t cValues)
+{
+    for(size_t ii = 0; ii < cValues; ii++)
+    {
+        pOut[ii] = Temper64(pMT[ii]);
+    }
+}
+
+#ifdef CPU_X86
+
+// AVX2 has no 64-bit arithmetic shift, so the mask for MT64_A is formed by
+// negating the low bit instead.
+TARGET_AVX2 static inline __m256i Twist64x4(__m256i upper, __m256i lower, __m256i middle)
+{
+    const __m256i upperMask = _mm256_set1_epi64x(static_cast<int64_t>(MT64_UMASK));
+    const __m256i lowerMask = _mm256_set1_epi64x(static_cast<int64_t>(MT64_LLMASK));
+    const __m256i matrixA   = _mm256_set1_epi64x(static_cast<int64_t>(MT64_A));
+    const __m256i one       = _mm256_set1_epi64x(1);
+
+    __m256i ui  = _mm256_or_si256(_mm256_and_si256(upper, upperMask), _mm256_and_si256(lower, lowerMask));
+    __m256i mag = _mm256_and_si256(_mm256_sub_epi64(_mm256_setzero_si256(), _mm256_and_si256(ui, one)), matrixA);
+    return _mm256_xor_si256(_mm256_xor_si256(middle, _mm256_srli_epi64(ui, 1)), mag);
+}
+
+TARGET_AVX2 static void Regenerate64AVX2(uint64_t * pMT)
+{
+    int kk = 0;
+    for(; kk + 4 <= MT64_N - MT64_M; kk += 4)
+    {
+        __m256i upper  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[kk]));
+        __m256i lower  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[kk + 1]));
+        __m256i middle = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[kk + MT64_M]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&pMT[kk]), Twist64x4(upper, lower, middle));
+    }
+    for(; kk + 4 <= MT64_N - 1; kk += 4)
+    {
+        __m256i upper  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[kk]));
+        __m256i lower  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[kk + 1]));
+        __m256i middle = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[kk + MT64_M - MT64_N]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&pMT[kk]), Twist64x4(upper, lower, middle));
+    }
+    for(; kk < MT64_N - 1; kk++)
+    {
+        pMT[kk] = Twist64(pMT[kk], pMT[kk + 1], pMT[kk + MT64_M - MT64_N]);
+    }
+    pMT[MT64_N - 1] = Twist64(pMT[MT64_N - 1], pMT[0], pMT[MT64_M - 1]);
+}
+
+TARGET_AVX2 static void Temper64AVX2(const uint64_t * pMT, uint64_t * pOut, size_t cValues)
+{
+    const __m256i maskD = _mm256_set1_epi64x(static_cast<int64_t>(MT64_D));
+    const __m256i maskB = _mm256_set1_epi64x(static_cast<int64_t>(MT64_B));
+    const __m256i maskC = _mm256_set1_epi64x(static_cast<int64_t>(MT64_C));
+
+    size_t ii = 0;
+    for(; ii + 4 <= cValues; ii += 4)
+    {
+        __m256i num = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&pMT[ii]));
+        num = _mm256_xor_si256(num, _mm256_and_si256(_mm256_srli_epi64(num, MT64_U), maskD));
+        num = _mm256_xor_si256(num, _mm256_and_si256(_mm256_slli_epi64(num, MT64_S), maskB));
+        num = _mm256_xor_si256(num, _mm256_and_si256(_mm256_slli_epi64(num, MT64_T), maskC));
+        num = _mm256_xor_si256(num, _mm256_srli_epi64(num, MT64_L));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&pOut[ii]), num);
+    }
+    Temper64Scalar(pMT + ii, pOut + ii, cValues - ii);
+}
+
+#endif  // CPU_X86
+
+struct Mersenne64Kernels
+{
+    void (*pfnRegenerate)(uint64_t * pMT);
+    void (*pfnTemper)(const uint64_t * pMT, uint64_t * pOut, size_t cValues);
+};
+
+static Mersenne64Kernels ChooseKernels()
+{
+    Mersenne64Kernels kernels = { Regenerate64Scalar, Temper64Scalar };
+
+#ifdef CPU_X86
+    if(CpuHasAVX2())
+    {
+        kernels.pfnRegenerate = Regenerate64AVX2;
+        kernels.pfnTemper     = Temper64AVX2;
+    }
+#endif
+
+    return kernels;
+}
+
+static const Mersenne64Kernels & Kernels()
+{
+    static const Mersenne64Kernels kernels = ChooseKernels();
+    return kernels;
+}
+
+void MersenneTwister64::Regenerate()
+{
+    Kernels().pfnRegenerate(m_aMT);
+}
+
+// Seed the state from a single word (init_genrand64 in the reference code).
+void MersenneTwister64::Seed(uint64_t seed)
+{
+    m_aMT[0] = seed;
+    for(int kk = 1; kk < MT64_N; kk++)
+    {
+        m_aMT[kk] = MT64_F * (m_aMT[kk - 1] ^ (m_aMT[kk - 1] >> 62)) + kk;
+    }
+}
+
+// Seed the state from an array of words (init_by_array64 in the reference code).
+void MersenneTwister64::Seed(
+    const uint64_t * pKey,
+    size_t           cKey)
+{
+    assert(pKey != nullptr && cKey > 0);
+
+    Seed(19650218);
+
+    int ii = 1;
+    size_t jj = 0;
+    for(size_t kk = (MT64_N > cKey ? MT64_N : cKey); kk > 0; kk--)
+    {
+        m_aMT[ii] = (m_aMT[ii] ^ ((m_aMT[ii - 1] ^ (m_aMT[ii - 1] >> 62)) * 3935559000370003845)) + pKey[jj] + jj;
+        ii++;
+        jj++;
+        if(ii >= MT64_N)
+        {
+            m_aMT[0] = m_aMT[MT64_N - 1];
+            ii = 1;
+        }
+        if(jj >= cKey)
+        {
+            jj = 0;
+        }
+    }
+    for(int kk = MT64_N - 1; kk > 0; kk--)
+    {
+        m_aMT[ii] = (m_aMT[ii] ^ ((m_aMT[ii - 1] ^ (m_aMT[ii - 1] >> 62)) * 2862933555777941757)) - ii;
+        ii++;
+        if(ii >= MT64_N)
+        {
+            m_aMT[0] = m_aMT[MT64_N - 1];
+            ii = 1;
+        }
+    }
+
+    m_aMT[0] = static_cast<uint64_t>(1) << 63;    // MSB is 1, assuring a non-zero initial state
+}
+
+MersenneTwister64::MersenneTwister64()
+{
+    Seed(MT64_DEFAULT_SEED);
+    Regenerate();
+}
+
+MersenneTwister64::MersenneTwister64(uint64_t seed)
+{
+    Seed(seed);
+    Regenerate();
+}
+
+MersenneTwister64::MersenneTwister64(
+    const uint64_t * pKey,
+    size_t           cKey)
+{
+    Seed(pKey, cKey);
+    Regenerate();
+}
+
+uint32_t MersenneTwister64::Rand()
+{
+    return static_cast<uint32_t>(Rand64() >> 32);
+}
+
+uint64_t MersenneTwister64::Rand64()
+{
+    if (m_ix == MT64_N)
+    {
+        m_ix = 0;
+
+        Regenerate();
+    }
+
+    return Temper64(m_aMT[m_ix++]);
+}
+
+void MersenneTwister64::Fill(
+    uint32_t * pBuffer,
+    size_t     cValues)
+{
+    for(size_t ii = 0; ii < cValues; ii++)
+    {
+        pBuffer[ii] = Rand();
+    }
+}
+
+void MersenneTwister64::Fill(
+    uint64_t * pBuffer,
+    size_t     cValues)
+{
+    while(cValues > 0)
+    {
+        if(m_ix == MT64_N)
+        {
+            m_ix = 0;
+
+            Regenerate();
+        }
+
+        size_t cRun = std::min(static_cast<size_t>(MT64_N - m_ix), cValues);
+        Kernels().pfnTemper(&m_aMT[m_ix], pBuffer, cRun);
+
+        m_ix += static_cast<int>(cRun);
+        pBuffer += cRun;
+        cValues -= cRun;
+    }
+}
+
@@ -0,0 +1,32 @@
+#ifndef MERSENNE64_H
+#define MERSENNE64_H
+
+const int MT64_N = 312;         // degree of recursion (words of state)
+
+// The 64-bit Mersenne Twister (MT19937-64), with the same interface as
+// MersenneTwister.  Each value is a native 64-bit word, so Rand64() costs
+// one step of the generator rather than two.
+class MersenneTwister64
+{
+    uint64_t m_aMT[MT64_N];
+    int m_ix = 0;
+
+    void Regenerate();
+    void Seed(uint64_t seed);
+    void Seed(const uint64_t * pKey, size_t cKey);
+
+public:
+    MersenneTwister64();
+    explicit MersenneTwister64(uint64_t seed);
+    MersenneTwister64(const uint64_t * pKey, size_t cKey);
+
+    uint32_t Rand();        // upper half of Rand64()
+    uint64_t Rand64();
+
+    // Fill a buffer with the values of that many calls to Rand() or Rand64().
+    void Fill(uint32_t * pBuffer, size_t cValues);
+    void Fill(uint64_t * pBuffer, size_t cValues);
+};
+
+#endif
+
@@ -0,0 +1,244 @@
+#include "PreCompile.h"
+#include "positionstore.h"
+#include "zobrist.h"
+#include "cpufeatures.h"
+#include "bitops.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char     STORE_MAGIC[8] = { 'Z', 'O', 'B', 'S', 'T', 'O', 'R', 'E' };
+static const uint32_t STORE_VERSION  = 1;
+
+// The file starts with this header, followed by the keys and then the payloads,
+// each as an array of 64-bit words indexed from 1 (index 0 is padding).  The
+// header is a cache line, so the arrays are aligned in the mapping.
+struct PositionStore::Header
+{
+    char     aMagic[8];
+    uint32_t version;
+    uint32_t cbHeader;
+    uint64_t tableSeed;         // ZOBRIST_SEED
+    uint64_t tableFingerprint;  // TableFingerprint()
+    uint64_t cRecords;
+    uint64_t aReserved[3];
+};
+
+// A hash of every key in the Zobrist table.  The seed alone would not catch a
+// change to the table's layout or to how it is filled.
+static uint64_t TableFingerprint()
+{
+    const uint64_t * pWords = reinterpret_cast<const uint64_t *>(&g_ZobristTable);
+    const size_t cWords = sizeof(g_ZobristTable) / sizeof(uint64_t);
+
+    // FNV-1a, a word at a time.
+    uint64_t fingerprint = 0xcbf29ce484222325;
+    for(size_t ii = 0; ii < cWords; ii++)
+    {
+        fingerprint = (fingerprint ^ pWords[ii]) * 0x100000001b3;
+    }
+
+    return (fingerprint ^ BLACK_TO_MOVE) * 0x100000001b3;
+}
+
+// Copy the sorted records into Eytzinger order: the root at index 1, and the
+// children of node k at 2k and 2k + 1.  An in-order walk of the tree visits
+// the sorted records in order.  Returns the index of the next sorted record.
+static size_t FillEytzinger(
+    const std::vector<PositionRecord> & aSorted,
+    size_t                              iSorted,
+    size_t                              node,
+    std::vector<uint64_t> &             aKeys,
+    std::vector<uint64_t> &             aPayloads)
+{
+    if(node < aKeys.size())
+    {
+        iSorted = FillEytzinger(aSorted, iSorted, 2 * node, aKeys, aPayloads);
+        aKeys[node]     = aSorted[iSorted].key;
+        aPayloads[node] = aSorted[iSorted].payload;
+        iSorted = FillEytzinger(aSorted, iSorted + 1, 2 * node + 1, aKeys, aPayloads);
+    }
+
+    return iSorted;
+}
+
+bool PositionStore::Write(const char * pszPath, std::vector<PositionRecord> aRecords)
+{
+    auto keyLess  = [](const PositionRecord & a, const PositionRecord & b) { return a.key < b.key; };
+    auto keyEqual = [](const PositionRecord & a, const PositionRecord & b) { return a.key == b.key; };
+
+    // A stable sort keeps duplicates in their original order, so unique() keeps the first.
+    std::stable_sort(aRecords.begin(), aRecords.end(), keyLess);
+    aRecords.erase(std::unique(aRecords.begin(), aRecords.end(), keyEqual), aRecords.end());
+
+    std::vector<uint64_t> aKeys(aRecords.size() + 1);
+    std::vector<uint64_t> aPayloads(aRecords.size() + 1);
+    FillEytzinger(aRecords, 0, 1, aKeys, aPayloads);
+
+    Header header = {};
+    std::memcpy(header.aMagic, STORE_MAGIC, sizeof(header.aMagic));
+    header.version          = STORE_VERSION;
+    header.cbHeader         = sizeof(Header);
+    header.tableSeed        = ZOBRIST_SEED;
+    header.tableFingerprint = TableFingerprint();
+    header.cRecords         = aRecords.size();
+
+    std::FILE * pFile = std::fopen(pszPath, "wb");
+    if(pFile == nullptr)
+    {
+        return false;
+    }
+
+    bool fWritten = std::fwrite(&header, sizeof(header), 1, pFile) == 1 &&
+                    std::fwrite(aKeys.data(), sizeof(uint64_t), aKeys.size(), pFile) == aKeys.size() &&
+                    std::fwrite(aPayloads.data(), sizeof(uint64_t), aPayloads.size(), pFile) == aPayloads.size();
+
+    return (std::fclose(pFile) == 0) && fWritten;
+}
+
+PositionStore::~PositionStore()
+{
+    Close();
+}
+
+bool PositionStore::Open(const char * pszPath)
+{
+    static_assert(sizeof(Header) == 64, "The header must keep the arrays aligned.");
+
+    Close();
+
+#ifdef _WIN32
+    m_hFile = CreateFileA(pszPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER cbFile;
+    if(m_hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_hFile, &cbFile) || cbFile.QuadPart < static_cast<LONGLONG>(sizeof(Header)))
+    {
+        Close();
+        return false;
+    }
+
+    m_hMapping = CreateFileMappingA(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(m_hMapping != nullptr)
+    {
+        m_pView = static_cast<const uint8_t *>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if(m_pView == nullptr)
+    {
+        Close();
+        return false;
+    }
+    m_cbView = static_cast<size_t>(cbFile.QuadPart);
+#else
+    int fd = open(pszPath, O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header)))
+    {
+        close(fd);
+        return false;
+    }
+
+    // The mapping keeps its own reference to the file.
+    void * pView = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(pView == MAP_FAILED)
+    {
+        return false;
+    }
+    m_pView  = static_cast<const uint8_t *>(pView);
+    m_cbView = static_cast<size_t>(st.st_size);
+#endif
+
+    const Header * pHeader = reinterpret_cast<const Header *>(m_pView);
+    if(std::memcmp(pHeader->aMagic, STORE_MAGIC, sizeof(pHeader->aMagic)) != 0 ||
+       pHeader->version != STORE_VERSION ||
+       pHeader->cbHeader != sizeof(Header) ||
+       pHeader->tableSeed != ZOBRIST_SEED ||
+       pHeader->tableFingerprint != TableFingerprint() ||
+       pHeader->cRecords >= m_cbView / (2 * sizeof(uint64_t)) ||
+       m_cbView != sizeof(Header) + 2 * (pHeader->cRecords + 1) * sizeof(uint64_t))
+    {
+        Close();
+        return false;
+    }
+
+    m_cRecords  = static_cast<size_t>(pHeader->cRecords);
+    m_pKeys     = reinterpret_cast<const uint64_t *>(m_pView + sizeof(Header));
+    m_pPayloads = m_pKeys + m_cRecords + 1;
+
+    return true;
+}
+
+void PositionStore::Close()
+{
+#ifdef _WIN32
+    if(m_pView != nullptr)
+    {
+        UnmapViewOfFile(m_pView);
+    }
+    if(m_hMapping != nullptr)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+    }
+    if(m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if(m_pView != nullptr)
+    {
+        munmap(const_cast<uint8_t *>(m_pView), m_cbView);
+    }
+#endif
+
+    m_pView     = nullptr;
+    m_cbView    = 0;
+    m_pKeys     = nullptr;
+    m_pPayloads = nullptr;
+    m_cRecords  = 0;
+}
+
+// Descend the tree, going right where the node's key is less than the key.
+// The only branch is the loop, which runs log2(n) or log2(n) + 1 times for
+// any key.  The sixteen descendants four levels down are two cache lines, so
+// prefetching them hides most of the memory latency of a large store.
+//
+// When the walk falls off the tree, the path taken is the bits of the node
+// index, with a 1 for every step right.  The last step left was to the
+// smallest key that is not less than the key, so removing the trailing
+// steps right, and then that step left, gives the node to compare.
+bool PositionStore::Find(uint64_t key, uint64_t & payload) const
+{
+    size_t node = 1;
+    while(node <= m_cRecords)
+    {
+        // Near the leaves, the descendants are past the end of the keys, and
+        // forming a pointer there is undefined even just to prefetch it, so
+        // compute the address as an integer.  A prefetch of an address that
+        // isn't mapped is harmless.
+#if defined(CPU_X86)
+        _mm_prefetch(reinterpret_cast<const char *>(reinterpret_cast<uintptr_t>(m_pKeys) + 16 * node * sizeof(uint64_t)), _MM_HINT_T0);
+#elif defined(__GNUC__)
+        __builtin_prefetch(reinterpret_cast<const void *>(reinterpret_cast<uintptr_t>(m_pKeys) + 16 * node * sizeof(uint64_t)));
+#endif
+        node = 2 * node + (m_pKeys[node] < key);
+    }
+    node >>= LowestBitIndex(~static_cast<uint64_t>(node)) + 1;
+
+    if(node == 0 || m_pKeys[node] != key)
+    {
+        return false;
+    }
+
+    payload = m_pPayloads[node];
+    return true;
+}
+
@@ -0,0 +1,62 @@
+#ifndef POSITIONSTORE_H
+#define POSITIONSTORE_H
+
+// A record for building a store, such as a book move and its weight, packed
+// by the caller into the payload.
+struct PositionRecord
+{
+    uint64_t key;
+    uint64_t payload;
+};
+
+// A read-only store of positions and payloads, keyed by Zobrist key, such as
+// an opening book.  It is built offline by Write(), and Open() maps the file
+// into memory, so opening costs no parsing and no allocation, and the pages
+// are shared by every process that opens the same file.
+//
+// The keys are stored in Eytzinger (breadth-first) order, so a lookup is a
+// binary search without branches on the keys, and the first levels of the
+// tree share a few cache lines.  The payloads are stored separately in the
+// same order, so the search only touches keys.
+//
+// The file header holds the seed and a fingerprint of the Zobrist table, and
+// a file written by a build with a different table fails to open.  Files are
+// in the native byte order.
+class PositionStore
+{
+    struct Header;
+
+    const uint8_t *  m_pView = nullptr;
+    size_t           m_cbView = 0;
+    const uint64_t * m_pKeys = nullptr;     // m_cRecords + 1 keys, from index 1
+    const uint64_t * m_pPayloads = nullptr; // m_cRecords + 1 payloads, from index 1
+    size_t           m_cRecords = 0;
+
+#ifdef _WIN32
+    HANDLE m_hFile = INVALID_HANDLE_VALUE;
+    HANDLE m_hMapping = nullptr;
+#endif
+
+public:
+    PositionStore() {}
+    ~PositionStore();
+
+    PositionStore(const PositionStore &) = delete;
+    PositionStore & operator=(const PositionStore &) = delete;
+
+    // Sort the records and write them to a file.  Where several records have
+    // the same key, only the first is kept.
+    static bool Write(const char * pszPath, std::vector<PositionRecord> aRecords);
+
+    // Map a file written by Write().  Returns false if the file can't be
+    // mapped, or if it is not a store for this Zobrist table.
+    bool Open(const char * pszPath);
+    void Close();
+
+    bool Find(uint64_t key, uint64_t & payload) const;
+
+    size_t Size() const { return m_cRecords; }
+};
+
+#endif
+
@@ -0,0 +1,342 @@
+#include "PreCompile.h"
+#include "sfmt.h"
+#include "cpufeatures.h"
+
+// Parameters for SFMT19937
+// http://www.math.sci.hiroshima-u.ac.jp/~m-mat/MT/SFMT/
+static const int      SFMT_N    = SFMT_N32 / 4;     // 128-bit elements of state
+static const int      SFMT_POS1 = 122;              // pick up position of the middle element
+static const int      SFMT_SL1  = 18;               // 32-bit left shift
+static const int      SFMT_SL2  = 1;                // 128-bit left shift, in bytes
+static const int      SFMT_SR1  = 11;               // 32-bit right shift
+static const int      SFMT_SR2  = 1;                // 128-bit right shift, in bytes
+static const uint32_t SFMT_MSK1 = 0xdfffffef;       // masks for the 32-bit right shift
+static const uint32_t SFMT_MSK2 = 0xddfecb7f;
+static const uint32_t SFMT_MSK3 = 0xbffaffff;
+static const uint32_t SFMT_MSK4 = 0xbffffff6;
+static const uint32_t SFMT_PARITY[4] = { 0x00000001, 0x00000000, 0x00000000, 0x13c9e684 };
+
+// The default seed of the reference implementation's test program.
+static const uint32_t SFMT_DEFAULT_SEED = 1234;
+
+// Shifts of a 128-bit element held as four little-endian 32-bit words.
+static inline void ShiftLeft128(uint32_t * pOut, const uint32_t * pIn, int cBytes)
+{
+    uint64_t hi = (static_cast<uint64_t>(pIn[3]) << 32) | pIn[2];
+    uint64_t lo = (static_cast<uint64_t>(pIn[1]) << 32) | pIn[0];
+    uint64_t outHi = (hi << (cBytes * 8)) | (lo >> (64 - cBytes * 8));
+    uint64_t outLo = lo << (cBytes * 8);
+
+    pOut[0] = static_cast<uint32_t>(outLo);
+    pOut[1] = static_cast<uint32_t>(outLo >> 32);
+    pOut[2] = static_cast<uint32_t>(outHi);
+    pOut[3] = static_cast<uint32_t>(outHi >> 32);
+}
+
+static inline void ShiftRight128(uint32_t * pOut, const uint32_t * pIn, int cBytes)
+{
+    uint64_t hi = (static_cast<uint64_t>(pIn[3]) << 32) | pIn[2];
+    uint64_t lo = (static_cast<uint64_t>(pIn[1]) << 32) | pIn[0];
+    uint64_t outHi = hi >> (cBytes * 8);
+    uint64_t outLo = (lo >> (cBytes * 8)) | (hi << (64 - cBytes * 8));
+
+    pOut[0] = static_cast<uint32_t>(outLo);
+    pOut[1] = static_cast<uint32_t>(outLo >> 32);
+    pOut[2] = static_cast<uint32_t>(outHi);
+    pOut[3] = static_cast<uint32_t>(outHi >> 32);
+}
+
+// r = a ^ (a << 8*SL2) ^ ((b >> SR1) & MSK) ^ (c >> 8*SR2) ^ (d << SL1)
+static inline void Recursion(
+    uint32_t *       pR,
+    const uint32_t * pA,
+    const uint32_t * pB,
+    const uint32_t * pC,
+    const uint32_t * pD)
+{
+    static const uint32_t aMask[4] = { SFMT_MSK1, SFMT_MSK2, SFMT_MSK3, SFMT_MSK4 };
+
+    uint32_t x[4];
+    uint32_t y[4];
+    ShiftLeft128(x, pA, SFMT_SL2);
+    ShiftRight128(y, pC, SFMT_SR2);
+
+    for(int ii = 0; ii < 4; ii++)
+    {
+        pR[ii] = pA[ii] ^ x[ii] ^ ((pB[ii] >> SFMT_SR1) & aMask[ii]) ^ y[ii] ^ (pD[ii] << SFMT_SL1);
+    }
+}
+
+// As with MersenneTwister, the loop is split where the middle element wraps,
+// so that no index needs a modulus.  c and d are the two previously computed
+// elements, which start as the last two elements of the old state.
+static void RegenerateScalar(uint32_t * pState)
+{
+    const uint32_t * pC = &pState[(SFMT_N - 2) * 4];
+    const uint32_t * pD = &pState[(SFMT_N - 1) * 4];
+
+    int ii = 0;
+    for(; ii < SFMT_N - SFMT_POS1; ii++)
+    {
+        Recursion(&pState[ii * 4], &pState[ii * 4], &pState[(ii + SFMT_POS1) * 4], pC, pD);
+        pC = pD;
+        pD = &pState[ii * 4];
+    }
+    for(; ii < SFMT_N; ii++)
+    {
+        Recursion(&pState[ii * 4], &pState[ii * 4], &pState[(ii + SFMT_POS1 - SFMT_N) * 4], pC, pD);
+        pC = pD;
+        pD = &pState[ii * 4];
+    }
+}
+
+#ifdef CPU_X86
+
+TARGET_SSE2 static inline __m128i Recursion(__m128i a, __m128i b, __m128i c, __m128i d, __m128i mask)
+{
+    __m128i z = _mm_xor_si128(a, _mm_slli_si128(a, SFMT_SL2));
+    z = _mm_xor_si128(z, _mm_and_si128(_mm_srli_epi32(b, SFMT_SR1), mask));
+    z = _mm_xor_si128(z, _mm_srli_si128(c, SFMT_SR2));
+    return _mm_xor_si128(z, _mm_slli_epi32(d, SFMT_SL1));
+}
+
+// The design target of SFMT: one 128-bit element per iteration, with the two
+// previous results carried in registers.
+TARGET_SSE2 static void RegenerateSSE2(uint32_t * pState)
+{
+    __m128i * pElements = reinterpret_cast<__m128i *>(pState);
+    const __m128i mask = _mm_set_epi32(static_cast<int>(SFMT_MSK4), static_cast<int>(SFMT_MSK3),
+                                       static_cast<int>(SFMT_MSK2), static_cast<int>(SFMT_MSK1));
+
+    __m128i c = _mm_load_si128(&pElements[SFMT_N - 2]);
+    __m128i d = _mm_load_si128(&pElements[SFMT_N - 1]);
+
+    int ii = 0;
+    for(; ii < SFMT_N - SFMT_POS1; ii++)
+    {
+        __m128i r = Recursion(_mm_load_si128(&pElements[ii]), _mm_load_si128(&pElements[ii + SFMT_POS1]), c, d, mask);
+        _mm_store_si128(&pElements[ii], r);
+        c = d;
+        d = r;
+    }
+    for(; ii < SFMT_N; ii++)
+    {
+        __m128i r = Recursion(_mm_load_si128(&pElements[ii]), _mm_load_si128(&pElements[ii + SFMT_POS1 - SFMT_N]), c, d, mask);
+        _mm_store_si128(&pElements[ii], r);
+        c = d;
+        d = r;
+    }
+}
+
+#endif  // CPU_X86
+
+typedef void (*PFN_REGENERATE)(uint32_t * pState);
+
+static PFN_REGENERATE ChooseRegenerate()
+{
+#ifdef CPU_X86
+    if(CpuHasSSE2())
+    {
+        return RegenerateSSE2;
+    }
+#endif
+
+    return RegenerateScalar;
+}
+
+void SFMT::Regenerate()
+{
+    static const PFN_REGENERATE pfnRegenerate = ChooseRegenerate();
+    pfnRegenerate(m_aState);
+}
+
+// Seed the state from a single word (sfmt_init_gen_rand in the reference code).
+void SFMT::Seed(uint32_t seed)
+{
+    m_aState[0] = seed;
+    for(int ii = 1; ii < SFMT_N32; ii++)
+    {
+        m_aState[ii] = 1812433253 * (m_aState[ii - 1] ^ (m_aState[ii - 1] >> 30)) + ii;
+    }
+
+    CertifyPeriod();
+}
+
+static inline uint32_t SeedMix1(uint32_t ui)
+{
+    return (ui ^ (ui >> 27)) * 1664525;
+}
+
+static inline uint32_t SeedMix2(uint32_t ui)
+{
+    return (ui ^ (ui >> 27)) * 1566083941;
+}
+
+// Seed the state from an array of words (sfmt_init_by_array in the reference code).
+void SFMT::Seed(
+    const uint32_t * pKey,
+    size_t           cKey)
+{
+    assert(pKey != nullptr && cKey > 0);
+
+    const int cLag = 11;
+    const int iMid = (SFMT_N32 - cLag) / 2;
+
+    std::fill(std::begin(m_aState), std::end(m_aState), 0x8b8b8b8b);
+
+    size_t cCount = std::max(cKey + 1, static_cast<size_t>(SFMT_N32));
+
+    uint32_t r = SeedMix1(m_aState[0] ^ m_aState[iMid] ^ m_aState[SFMT_N32 - 1]);
+    m_aState[iMid] += r;
+    r += static_cast<uint32_t>(cKey);
+    m_aState[iMid + cLag] += r;
+    m_aState[0] = r;
+    cCount--;
+
+    int ii = 1;
+    for(size_t jj = 0; jj < cCount; jj++)
+    {
+        r = SeedMix1(m_aState[ii] ^ m_aState[(ii + iMid) % SFMT_N32] ^ m_aState[(ii + SFMT_N32 - 1) % SFMT_N32]);
+        m_aState[(ii + iMid) % SFMT_N32] += r;
+        r += (jj < cKey ? pKey[jj] : 0) + ii;
+        m_aState[(ii + iMid + cLag) % SFMT_N32] += r;
+        m_aState[ii] = r;
+        ii = (ii + 1) % SFMT_N32;
+    }
+    for(int jj = 0; jj < SFMT_N32; jj++)
+    {
+        r = SeedMix2(m_aState[ii] + m_aState[(ii + iMid) % SFMT_N32] + m_aState[(ii + SFMT_N32 - 1) % SFMT_N32]);
+        m_aState[(ii + iMid) % SFMT_N32] ^= r;
+        r -= ii;
+        m_aState[(ii + iMid + cLag) % SFMT_N32] ^= r;
+        m_aState[ii] = r;
+        ii = (ii + 1) % SFMT_N32;
+    }
+
+    CertifyPeriod();
+}
+
+// Not every state lies on the full period of 2^19937 - 1.  If the parity
+// check fails, flip the lowest bit of the parity vector to move onto it.
+void SFMT::CertifyPeriod()
+{
+    uint32_t inner = 0;
+    for(int ii = 0; ii < 4; ii++)
+    {
+        inner ^= m_aState[ii] & SFMT_PARITY[ii];
+    }
+    for(int shift = 16; shift > 0; shift >>= 1)
+    {
+        inner ^= inner >> shift;
+    }
+
+    if((inner & 1) == 0)
+    {
+        for(int ii = 0; ii < 4; ii++)
+        {
+            if(SFMT_PARITY[ii] != 0)
+            {
+                m_aState[ii] ^= SFMT_PARITY[ii] & (0 - SFMT_PARITY[ii]);
+                break;
+            }
+        }
+    }
+}
+
+SFMT::SFMT()
+{
+    Seed(SFMT_DEFAULT_SEED);
+    Regenerate();
+}
+
+SFMT::SFMT(uint32_t seed)
+{
+    Seed(seed);
+    Regenerate();
+}
+
+SFMT::SFMT(
+    const uint32_t * pKey,
+    size_t           cKey)
+{
+    Seed(pKey, cKey);
+    Regenerate();
+}
+
+uint32_t SFMT::Rand()
+{
+    if (m_ix == SFMT_N32)
+    {
+        m_ix = 0;
+
+        Regenerate();
+    }
+
+    return m_aState[m_ix++];
+}
+
+uint64_t SFMT::Rand64()
+{
+    uint64_t ui64;
+
+    ui64 = Rand();
+    ui64 |= static_cast<uint64_t>(Rand()) << 32;
+
+    return ui64;
+}
+
+void SFMT::Fill(
+    uint32_t * pBuffer,
+    size_t     cValues)
+{
+    while(cValues > 0)
+    {
+        if(m_ix == SFMT_N32)
+        {
+            m_ix = 0;
+
+            Regenerate();
+        }
+
+        size_t cRun = std::min(static_cast<size_t>(SFMT_N32 - m_ix), cValues);
+        std::copy(&m_aState[m_ix], &m_aState[m_ix] + cRun, pBuffer);
+
+        m_ix += static_cast<int>(cRun);
+        pBuffer += cRun;
+        cValues -= cRun;
+    }
+}
+
+void SFMT::Fill(
+    uint64_t * pBuffer,
+    size_t     cValues)
+{
+    while(cValues > 0)
+    {
+        if(m_ix == SFMT_N32)
+        {
+            m_ix = 0;
+
+            Regenerate();
+        }
+
+        // After an odd number of calls to Rand(), every 64-bit value straddles
+        // two elements, so fall back to assembling each one.
+        if(m_ix & 1)
+        {
+            *pBuffer++ = Rand64();
+            cValues--;
+            continue;
+        }
+
+        // On a little-endian machine, an aligned pair of words with the first
+        // in the lower half is the 64-bit value, so the state copies directly.
+        size_t cRun = std::min(static_cast<size_t>(SFMT_N32 - m_ix) / 2, cValues);
+        std::memcpy(pBuffer, &m_aState[m_ix], cRun * sizeof(uint64_t));
+
+        m_ix += static_cast<int>(cRun * 2);
+        pBuffer += cRun;
+        cValues -= cRun;
+    }
+}
+
@@ -0,0 +1,36 @@
+#ifndef SFMT_H
+#define SFMT_H
+
+const int SFMT_N32 = 624;       // words of state (156 128-bit elements)
+
+// The SIMD-oriented Fast Mersenne Twister (SFMT19937), with the same interface
+// as MersenneTwister.  The recursion works on 128-bit elements and needs no
+// tempering, so the state is the output, and bulk generation is a copy.
+class SFMT
+{
+    alignas(16) uint32_t m_aState[SFMT_N32];
+    int m_ix = 0;
+
+    void Regenerate();
+    void Seed(uint32_t seed);
+    void Seed(const uint32_t * pKey, size_t cKey);
+    void CertifyPeriod();
+
+public:
+    SFMT();
+    explicit SFMT(uint32_t seed);
+    SFMT(const uint32_t * pKey, size_t cKey);
+
+    uint32_t Rand();
+
+    // The first of the two 32-bit values is the lower half, which makes
+    // the sequence match the 64-bit output of the reference implementation.
+    uint64_t Rand64();
+
+    // Fill a buffer with the values of that many calls to Rand() or Rand64().
+    void Fill(uint32_t * pBuffer, size_t cValues);
+    void Fill(uint64_t * pBuffer, size_t cValues);
+};
+
+#endif
+
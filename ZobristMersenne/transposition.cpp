@@ -0,0 +1,316 @@
+#include "PreCompile.h"
+#include "transposition.h"
+#include "cpufeatures.h"
+
+// Layout of the data word of an entry.  The valid bit distinguishes a stored
+// entry from the zeroed memory of an empty one.
+static const int      DATA_SCORE_SHIFT      = 16;
+static const int      DATA_DEPTH_SHIFT      = 32;
+static const int      DATA_BOUND_SHIFT      = 40;
+static const int      DATA_GENERATION_SHIFT = 48;
+static const uint64_t DATA_VALID            = static_cast<uint64_t>(1) << 63;
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;   // x86-64 huge page size, where the OS doesn't say
+
+static inline uint64_t PackData(const TranspositionData & data, uint8_t generation)
+{
+    return DATA_VALID |
+           static_cast<uint64_t>(data.move) |
+           (static_cast<uint64_t>(static_cast<uint16_t>(data.score)) << DATA_SCORE_SHIFT) |
+           (static_cast<uint64_t>(data.depth) << DATA_DEPTH_SHIFT) |
+           (static_cast<uint64_t>(data.bound) << DATA_BOUND_SHIFT) |
+           (static_cast<uint64_t>(generation) << DATA_GENERATION_SHIFT);
+}
+
+static inline void UnpackData(uint64_t packed, TranspositionData & data)
+{
+    data.move  = static_cast<uint16_t>(packed);
+    data.score = static_cast<int16_t>(packed >> DATA_SCORE_SHIFT);
+    data.depth = static_cast<uint8_t>(packed >> DATA_DEPTH_SHIFT);
+    data.bound = static_cast<eBound>((packed >> DATA_BOUND_SHIFT) & 0xff);
+}
+
+static inline uint8_t DataDepth(uint64_t packed)
+{
+    return static_cast<uint8_t>(packed >> DATA_DEPTH_SHIFT);
+}
+
+static inline uint8_t DataGeneration(uint64_t packed)
+{
+    return static_cast<uint8_t>(packed >> DATA_GENERATION_SHIFT);
+}
+
+TranspositionStats & TranspositionStats::operator+=(const TranspositionStats & other)
+{
+    cProbes     += other.cProbes;
+    cHits       += other.cHits;
+    cCollisions += other.cCollisions;
+    cStores     += other.cStores;
+    cOverwrites += other.cOverwrites;
+
+    return *this;
+}
+
+// Map zeroed, page-aligned memory for the table, preferring huge pages.  A
+// probe into a large table is a TLB miss as often as a cache miss, and huge
+// pages remove most of those.
+static void * AllocateTable(size_t & cbSize, bool fUseHugePages, bool & fHugePages)
+{
+    fHugePages = false;
+
+#ifdef _WIN32
+    // Large pages need the SeLockMemoryPrivilege, which most accounts don't have.
+    size_t cbLargePage = GetLargePageMinimum();
+    if(fUseHugePages && cbLargePage != 0)
+    {
+        size_t cbRounded = (cbSize + cbLargePage - 1) & ~(cbLargePage - 1);
+        void * pMemory = VirtualAlloc(nullptr, cbRounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if(pMemory != nullptr)
+        {
+            cbSize = cbRounded;
+            fHugePages = true;
+            return pMemory;
+        }
+    }
+
+    return VirtualAlloc(nullptr, cbSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    if(fUseHugePages)
+    {
+        cbSize = (cbSize + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    }
+
+#ifdef MAP_HUGETLB
+    // Explicit huge pages must be reserved by the administrator (vm.nr_hugepages).
+    if(fUseHugePages)
+    {
+        void * pMemory = mmap(nullptr, cbSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(pMemory != MAP_FAILED)
+        {
+            fHugePages = true;
+            return pMemory;
+        }
+    }
+#endif
+
+    void * pMemory = mmap(nullptr, cbSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(pMemory == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+#ifdef MADV_HUGEPAGE
+    // Otherwise ask for transparent huge pages, which the kernel provides when it can.
+    if(fUseHugePages)
+    {
+        madvise(pMemory, cbSize, MADV_HUGEPAGE);
+    }
+#endif
+
+    return pMemory;
+#endif
+}
+
+static void FreeTable(void * pMemory, size_t cbSize)
+{
+#ifdef _WIN32
+    UNREFERENCED_PARAMETER(cbSize);
+    VirtualFree(pMemory, 0, MEM_RELEASE);
+#else
+    munmap(pMemory, cbSize);
+#endif
+}
+
+TranspositionTable::TranspositionTable(
+    size_t       cbSize,
+    eReplacement replacement,
+    bool         fUseHugePages) : m_replacement(replacement)
+{
+    assert(cbSize >= sizeof(Bucket));
+
+    // A power of two number of buckets, so that the key can be masked into an index.
+    m_cBuckets = 1;
+    while(m_cBuckets * 2 * sizeof(Bucket) <= cbSize)
+    {
+        m_cBuckets *= 2;
+    }
+
+    m_cbAllocation = m_cBuckets * sizeof(Bucket);
+    m_pBuckets = static_cast<Bucket *>(AllocateTable(m_cbAllocation, fUseHugePages, m_fHugePages));
+    if(m_pBuckets == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    // Touch every page now, rather than during the first search.
+    Clear();
+}
+
+TranspositionTable::~TranspositionTable()
+{
+    FreeTable(m_pBuckets, m_cbAllocation);
+}
+
+// The low bits of the key choose the bucket, and the high bits choose
+// the home slot for REPLACE_ALWAYS, so the two are independent.
+TranspositionTable::Bucket & TranspositionTable::BucketForKey(uint64_t key) const
+{
+    return m_pBuckets[key & (m_cBuckets - 1)];
+}
+
+bool TranspositionTable::Probe(
+    uint64_t            key,
+    TranspositionData & data,
+    TranspositionStats & stats) const
+{
+    const Bucket & bucket = BucketForKey(key);
+    bool fOtherKeys = false;
+
+    stats.cProbes++;
+
+    for(const Entry & entry : bucket.aEntries)
+    {
+        // Relaxed loads are enough, as a torn entry fails the XOR check.
+        uint64_t packed = entry.data.load(std::memory_order_relaxed);
+        uint64_t keyXorData = entry.keyXorData.load(std::memory_order_relaxed);
+
+        if((packed & DATA_VALID) == 0)
+        {
+            continue;
+        }
+
+        if((keyXorData ^ packed) == key)
+        {
+            UnpackData(packed, data);
+            stats.cHits++;
+            return true;
+        }
+
+        fOtherKeys = true;
+    }
+
+    if(fOtherKeys)
+    {
+        stats.cCollisions++;
+    }
+
+    return false;
+}
+
+// Entries from earlier searches are always worth less than current ones;
+// among entries of the same age, the deeper search is worth more.
+static inline int EntryWorth(uint64_t packed, uint8_t generation)
+{
+    return (DataGeneration(packed) == generation ? 256 : 0) + DataDepth(packed);
+}
+
+int TranspositionTable::ChooseVictim(
+    const Bucket & bucket,
+    uint64_t       key,
+    uint8_t        depth) const
+{
+    const int cEntries = sizeof(bucket.aEntries) / sizeof(bucket.aEntries[0]);
+
+    int aWorth[cEntries];
+    for(int ii = 0; ii < cEntries; ii++)
+    {
+        aWorth[ii] = EntryWorth(bucket.aEntries[ii].data.load(std::memory_order_relaxed), m_generation);
+    }
+
+    switch(m_replacement)
+    {
+    case REPLACE_ALWAYS:
+        return static_cast<int>(key >> 62);
+
+    case REPLACE_DEPTH:
+        return static_cast<int>(std::min_element(aWorth, aWorth + cEntries) - aWorth);
+
+    case REPLACE_TWO_TIER:
+    default:
+        {
+            // The first half of the bucket only accepts entries at least as
+            // valuable as what it holds; anything else goes to the second half.
+            const int cDepthTier = cEntries / 2;
+            int victim = static_cast<int>(std::min_element(aWorth, aWorth + cDepthTier) - aWorth);
+            if(256 + depth >= aWorth[victim])
+            {
+                return victim;
+            }
+
+            return cDepthTier + static_cast<int>((key >> 63) % (cEntries - cDepthTier));
+        }
+    }
+}
+
+void TranspositionTable::Store(
+    uint64_t                  key,
+    const TranspositionData & data,
+    TranspositionStats &      stats)
+{
+    Bucket & bucket = BucketForKey(key);
+    const int cEntries = sizeof(bucket.aEntries) / sizeof(bucket.aEntries[0]);
+
+    stats.cStores++;
+
+    // Prefer the entry already holding this key, then an empty entry.
+    int slot = -1;
+    for(int ii = 0; ii < cEntries; ii++)
+    {
+        uint64_t packed = bucket.aEntries[ii].data.load(std::memory_order_relaxed);
+        uint64_t keyXorData = bucket.aEntries[ii].keyXorData.load(std::memory_order_relaxed);
+
+        if((packed & DATA_VALID) == 0)
+        {
+            if(slot < 0)
+            {
+                slot = ii;
+            }
+        }
+        else if((keyXorData ^ packed) == key)
+        {
+            slot = ii;
+            break;
+        }
+    }
+
+    if(slot < 0)
+    {
+        slot = ChooseVictim(bucket, key, data.depth);
+        stats.cOverwrites++;
+    }
+
+    uint64_t packed = PackData(data, m_generation);
+    bucket.aEntries[slot].keyXorData.store(key ^ packed, std::memory_order_relaxed);
+    bucket.aEntries[slot].data.store(packed, std::memory_order_relaxed);
+}
+
+void TranspositionTable::Prefetch(uint64_t key) const
+{
+#if defined(CPU_X86)
+    _mm_prefetch(reinterpret_cast<const char *>(&BucketForKey(key)), _MM_HINT_T0);
+#elif defined(__GNUC__)
+    __builtin_prefetch(&BucketForKey(key));
+#else
+    (void)key;
+#endif
+}
+
+void TranspositionTable::NewSearch()
+{
+    m_generation++;
+}
+
+void TranspositionTable::Clear()
+{
+    for(size_t ii = 0; ii < m_cBuckets; ii++)
+    {
+        for(Entry & entry : m_pBuckets[ii].aEntries)
+        {
+            entry.keyXorData.store(0, std::memory_order_relaxed);
+            entry.data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    m_generation = 0;
+}
+
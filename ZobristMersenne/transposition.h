@@ -0,0 +1,95 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+// How a store chooses which entry of a full bucket to overwrite.
+enum eReplacement
+{
+    REPLACE_ALWAYS,     // overwrite the entry at the key's home slot
+    REPLACE_DEPTH,      // overwrite the stalest, then shallowest, entry
+    REPLACE_TWO_TIER,   // half the bucket keeps the deepest entries, the other half is always replaced
+};
+
+enum eBound { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT };
+
+// The search result stored for a position.  This packs into the 64-bit
+// data word of an entry, along with the search generation.
+struct TranspositionData
+{
+    uint16_t move;
+    int16_t  score;
+    uint8_t  depth;
+    eBound   bound;
+};
+
+// Counters kept by each search thread and summed afterwards, so that
+// the threads never contend on them.
+struct TranspositionStats
+{
+    uint64_t cProbes     = 0;
+    uint64_t cHits       = 0;   // probe found the key
+    uint64_t cCollisions = 0;   // probe missed, but the bucket held other keys
+    uint64_t cStores     = 0;
+    uint64_t cOverwrites = 0;   // store evicted a different key
+
+    TranspositionStats & operator+=(const TranspositionStats & other);
+};
+
+// A fixed-size transposition table indexed by Zobrist key, shared by all
+// search threads without locks.
+//
+// Each 64-byte bucket holds four entries, so a probe touches one cache line.
+// An entry stores key ^ data alongside data (Hyatt's lockless hashing).  If
+// two threads race to store into the same entry, the words may come from
+// different stores, but then the XOR no longer reproduces the probed key, so
+// a torn entry reads as a miss instead of as a wrong result.
+class TranspositionTable
+{
+    struct Entry
+    {
+        std::atomic<uint64_t> keyXorData;
+        std::atomic<uint64_t> data;
+    };
+
+    struct alignas(64) Bucket
+    {
+        Entry aEntries[4];
+    };
+
+    Bucket *     m_pBuckets = nullptr;
+    size_t       m_cBuckets = 0;
+    size_t       m_cbAllocation = 0;
+    bool         m_fHugePages = false;
+    eReplacement m_replacement;
+    uint8_t      m_generation = 0;
+
+    Bucket & BucketForKey(uint64_t key) const;
+    int ChooseVictim(const Bucket & bucket, uint64_t key, uint8_t depth) const;
+
+public:
+    // The size is rounded down to a power of two number of buckets.  Huge pages
+    // are used when requested and available, and otherwise fall back quietly.
+    TranspositionTable(size_t cbSize, eReplacement replacement = REPLACE_DEPTH, bool fUseHugePages = true);
+    ~TranspositionTable();
+
+    TranspositionTable(const TranspositionTable &) = delete;
+    TranspositionTable & operator=(const TranspositionTable &) = delete;
+
+    bool Probe(uint64_t key, TranspositionData & data, TranspositionStats & stats) const;
+    void Store(uint64_t key, const TranspositionData & data, TranspositionStats & stats);
+
+    // Start loading the bucket for a key.  Call this as soon as a move's key
+    // is known (UpdateZobristKey), before the board is updated, so that the
+    // probe at the next node does not stall on memory.
+    void Prefetch(uint64_t key) const;
+
+    // Age the existing entries, so that replacement prefers them over the
+    // results of the new search.  Not safe to call while threads are searching.
+    void NewSearch();
+    void Clear();
+
+    size_t BucketCount() const { return m_cBuckets; }
+    bool UsesHugePages() const { return m_fHugePages; }
+};
+
+#endif
+
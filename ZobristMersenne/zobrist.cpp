@@ -1,66 +1,109 @@
 #include "PreCompile.h"
 #include "zobrist.h"
-#include "mersenne.h"
+#include "constmersenne.h"
+#include "cpufeatures.h"
+#include "bitops.h"
 
-// Use a constant instead of transposing the key depending on the side to play.
-// This is more efficient, since I can more easily undo operations (so I can
-// incrementally update the key).
-static const uint64_t BLACK_TO_MOVE = 0x8913125CFB309AFC;   // Random number to XOR into black moves
-
-void ChessBoard::InitializeZobristTable()
+// Fill the table with the output of MT19937-64, in the same order as
+// MersenneTwister64::Fill() would.  The piece keys come first, then one key
+// per castling right, then the en passant keys.
+static constexpr ZobristTable GenerateZobristTable()
 {
-    MersenneTwister rng;
+    ZobristTable table = {};
+    ConstMersenneTwister64 rng(ZOBRIST_SEED);
 
-    // Use the Mersenne Twister to fill up the Zobrist random table
     for(int ii = 0; ii < BOARD_SIZE; ii++)
     {
         for(int jj = 0; jj < NUM_PIECES; jj++)
         {
             for(int kk = 0; kk < NUM_COLORS; kk++)
             {
-                m_aZobristTable[ii][jj][kk] = rng.Rand64();
+                table.aKeys[ii][jj][kk] = rng.Rand64();
+            }
+        }
+    }
+
+    uint64_t aRights[4] = {};
+    for(int ii = 0; ii < 4; ii++)
+    {
+        aRights[ii] = rng.Rand64();
+    }
+    for(int mask = 0; mask < NUM_CASTLING_MASKS; mask++)
+    {
+        for(int ii = 0; ii < 4; ii++)
+        {
+            if(mask & (1 << ii))
+            {
+                table.aCastling[mask] ^= aRights[ii];
             }
         }
     }
+
+    for(int ii = 0; ii < 8; ii++)
+    {
+        table.aEnPassant[ii] = rng.Rand64();
+    }
+
+    return table;
+}
+
+constexpr ZobristTable g_ZobristTable = GenerateZobristTable();
+
+// The first output of std::mt19937_64 with the default seed.
+static_assert(g_ZobristTable.aKeys[0][0][0] == 14514284786278117030u, "Compile-time MT19937-64 is incorrect.");
+
+void ChessBoard::SetPiece(int pos, eChessPiece piece)
+{
+    assert(piece != EMPTY && m_aBoard[pos] == EMPTY);
+
+    m_aBoard[pos] = piece;
+    m_aBitboards[piece] |= static_cast<uint64_t>(1) << pos;
+}
+
+void ChessBoard::ClearPiece(int pos)
+{
+    assert(m_aBoard[pos] != EMPTY);
+
+    m_aBitboards[m_aBoard[pos]] &= ~(static_cast<uint64_t>(1) << pos);
+    m_aBoard[pos] = EMPTY;
 }
 
 void ChessBoard::PopulateChessBoard()
 {
+    std::fill(std::begin(m_aBoard), std::end(m_aBoard), EMPTY);
+    std::fill(std::begin(m_aBitboards), std::end(m_aBitboards), 0);
+
     // To test different hash possibilities, change this to reflect
     // the initial board state to test.
     int ii;
-    for(ii = 16; ii < (BOARD_SIZE - 16); ii++)
-    {
-        m_aBoard[ii] = EMPTY;
-    }
 
     // Set up pawns
     for(ii = 0; ii < 8; ii++)
     {
-        m_aBoard[ii + 8] = W_PAWN;
+        SetPiece(ii + 8, W_PAWN);
     }
     for(ii = 0; ii < 8; ii++)
     {
-        m_aBoard[ii + (BOARD_SIZE - 16)] = B_PAWN;
+        SetPiece(ii + (BOARD_SIZE - 16), B_PAWN);
     }
 
-    m_aBoard[0] = W_ROOK;
-    m_aBoard[1] = W_KNIGHT;
-    m_aBoard[2] = W_BISHOP;
-    m_aBoard[3] = W_QUEEN;
-    m_aBoard[4] = W_KING;
-    m_aBoard[5] = W_BISHOP;
-    m_aBoard[6] = W_KNIGHT;
-    m_aBoard[7] = W_ROOK;
+    SetPiece(0, W_ROOK);
+    SetPiece(1, W_KNIGHT);
+    SetPiece(2, W_BISHOP);
+    SetPiece(3, W_QUEEN);
+    SetPiece(4, W_KING);
+    SetPiece(5, W_BISHOP);
+    SetPiece(6, W_KNIGHT);
+    SetPiece(7, W_ROOK);
 
-    m_aBoard[56] = B_ROOK;
-    m_aBoard[57] = B_KNIGHT;
-    m_aBoard[58] = B_BISHOP;
-    m_aBoard[59] = B_QUEEN;
-    m_aBoard[60] = B_KING;
-    m_aBoard[61] = B_BISHOP;
-    m_aBoard[62] = B_KNIGHT;
-    m_aBoard[63] = B_ROOK;
+    SetPiece(56, B_ROOK);
+    SetPiece(57, B_KNIGHT);
+    SetPiece(58, B_BISHOP);
+    SetPiece(59, B_QUEEN);
+    SetPiece(60, B_KING);
+    SetPiece(61, B_BISHOP);
+    SetPiece(62, B_KNIGHT);
+    SetPiece(63, B_ROOK);
 
     for(ii = 0; ii < BOARD_SIZE; ii++)
     {
@@ -70,9 +113,162 @@ void ChessBoard::PopulateChessBoard()
 
 ChessBoard::ChessBoard()
 {
-    InitializeZobristTable();
-
     PopulateChessBoard();
+
+    m_key = CalculateZobristKey(m_sideToMove);
+}
+
+// Set up the board from the first four fields of a FEN string: the pieces,
+// the side to move, the castling rights and the en passant target.  The move
+// clocks are ignored, as they are not part of the key.
+//
+// The string is parsed in full before the board is changed, so a string that
+// fails to parse leaves the board as it was.  A castling right is dropped if
+// its king or rook is not on its home square, as MakeMove assumes they are.
+// Positions that the move generator can't handle are rejected: each side must
+// have one king, no pawn may be on the first or last rank, and an en passant
+// target must be behind a pawn that could just have moved two squares.
+bool ChessBoard::SetFEN(const char * pszFEN)
+{
+    static const char s_szPieces[] = "rnbkqpRNBKQP";    // in eChessPiece order
+
+    eChessPiece aBoard[BOARD_SIZE];
+    std::fill(std::begin(aBoard), std::end(aBoard), EMPTY);
+    uint8_t castling = 0;
+    int enPassant = NO_SQUARE;
+
+    const char * pch = pszFEN;
+    int rank = 7;
+    int file = 0;
+    for(; *pch != '\0' && *pch != ' '; pch++)
+    {
+        if(*pch == '/')
+        {
+            if(file != 8 || rank == 0)
+            {
+                return false;
+            }
+            rank--;
+            file = 0;
+        }
+        else if(*pch >= '1' && *pch <= '8')
+        {
+            file += *pch - '0';
+            if(file > 8)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            const char * pchPiece = std::strchr(s_szPieces, *pch);
+            if(pchPiece == nullptr || file > 7)
+            {
+                return false;
+            }
+            aBoard[rank * 8 + file] = eChessPiece(pchPiece - s_szPieces);
+            file++;
+        }
+    }
+    if(rank != 0 || file != 8)
+    {
+        return false;
+    }
+
+    int cWhiteKings = 0;
+    int cBlackKings = 0;
+    for(int ii = 0; ii < BOARD_SIZE; ii++)
+    {
+        cWhiteKings += (aBoard[ii] == W_KING) ? 1 : 0;
+        cBlackKings += (aBoard[ii] == B_KING) ? 1 : 0;
+        if((aBoard[ii] == W_PAWN || aBoard[ii] == B_PAWN) && (ii < 8 || ii >= BOARD_SIZE - 8))
+        {
+            return false;
+        }
+    }
+    if(cWhiteKings != 1 || cBlackKings != 1)
+    {
+        return false;
+    }
+
+    if(*pch++ != ' ' || (*pch != 'w' && *pch != 'b'))
+    {
+        return false;
+    }
+    const eColor sideToMove = (*pch++ == 'w') ? WHITE : BLACK;
+
+    if(*pch++ != ' ')
+    {
+        return false;
+    }
+    for(; *pch != '\0' && *pch != ' '; pch++)
+    {
+        switch(*pch)
+        {
+        case 'K': castling |= CASTLE_W_KINGSIDE;  break;
+        case 'Q': castling |= CASTLE_W_QUEENSIDE; break;
+        case 'k': castling |= CASTLE_B_KINGSIDE;  break;
+        case 'q': castling |= CASTLE_B_QUEENSIDE; break;
+        case '-': break;
+        default: return false;
+        }
+    }
+
+    //
+    // The en passant target is the empty square that the last move's pawn
+    // skipped over, so it is on the sixth rank from the side to move, with
+    // the pawn in front of it and its starting square empty.
+    //
+    if(*pch == ' ' && pch[1] != '-')
+    {
+        if(pch[1] < 'a' || pch[1] > 'h' || pch[2] < '1' || pch[2] > '8')
+        {
+            return false;
+        }
+        enPassant = (pch[2] - '1') * 8 + (pch[1] - 'a');
+
+        const int toPawn = (sideToMove == WHITE) ? -8 : 8;
+        const eChessPiece pawn = (sideToMove == WHITE) ? B_PAWN : W_PAWN;
+        if(enPassant / 8 != ((sideToMove == WHITE) ? 5 : 2) ||
+           aBoard[enPassant] != EMPTY || aBoard[enPassant - toPawn] != EMPTY ||
+           aBoard[enPassant + toPawn] != pawn)
+        {
+            return false;
+        }
+    }
+
+    if(aBoard[4] != W_KING || aBoard[7] != W_ROOK)
+    {
+        castling &= ~CASTLE_W_KINGSIDE;
+    }
+    if(aBoard[4] != W_KING || aBoard[0] != W_ROOK)
+    {
+        castling &= ~CASTLE_W_QUEENSIDE;
+    }
+    if(aBoard[60] != B_KING || aBoard[63] != B_ROOK)
+    {
+        castling &= ~CASTLE_B_KINGSIDE;
+    }
+    if(aBoard[60] != B_KING || aBoard[56] != B_ROOK)
+    {
+        castling &= ~CASTLE_B_QUEENSIDE;
+    }
+
+    std::fill(std::begin(m_aBoard), std::end(m_aBoard), EMPTY);
+    std::fill(std::begin(m_aBitboards), std::end(m_aBitboards), 0);
+    for(int ii = 0; ii < BOARD_SIZE; ii++)
+    {
+        if(aBoard[ii] != EMPTY)
+        {
+            SetPiece(ii, aBoard[ii]);
+        }
+    }
+    m_sideToMove = sideToMove;
+    m_castling = castling;
+    m_enPassant = enPassant;
+    m_key = CalculateZobristKey(m_sideToMove);
+
+    return true;
 }
 
 eColor GetPieceColor(eChessPiece piece)
@@ -85,25 +281,97 @@ eChessPiece GetUncoloredPiece(eChessPiece piece)
     return piece < W_ROOK ? piece : eChessPiece(piece - NUM_PIECES);
 }
 
-uint64_t ChessBoard::CalculateZobristKey(
-    eColor sideToMove) const
+// XOR the keys of every piece on the board, visiting only the occupied
+// squares of each bitboard.
+static uint64_t PieceKeysBitboards(const eChessPiece *, const uint64_t * pBitboards)
 {
     uint64_t uZobristKey = 0;
 
-    eChessPiece piece = EMPTY;
-    eColor color      = BLACK;
-
-    for(unsigned int ii = 0; ii < sizeof(m_aBoard) / sizeof(m_aBoard[0]); ii++)
+    for(int ii = 0; ii < NUM_PIECE_TYPES; ii++)
     {
-        if(EMPTY != m_aBoard[ii])
-        {
-            color = GetPieceColor(m_aBoard[ii]);
-            piece = GetUncoloredPiece(m_aBoard[ii]);
+        // The keys of one piece are a stride of NUM_PIECE_TYPES apart.
+        const uint64_t * pKeys = &g_ZobristTable.aKeys[0][GetUncoloredPiece(eChessPiece(ii))][GetPieceColor(eChessPiece(ii))];
 
-            uZobristKey ^= m_aZobristTable[ii][piece][color];
+        uint64_t bitboard = pBitboards[ii];
+        while(bitboard != 0)
+        {
+            uZobristKey ^= pKeys[PopLowestBit(bitboard) * NUM_PIECE_TYPES];
         }
     }
 
+    return uZobristKey;
+}
+
+#ifdef CPU_X86
+
+static_assert(sizeof(eChessPiece) == sizeof(int32_t), "The gather reads the board as 32-bit integers.");
+
+// Gather the keys for four squares at a time straight from the mailbox,
+// masking out the empty squares.  The flattened table index of a piece p on
+// square sq is sq * 12 + 2 * uncolored(p) + color(p), which is sq * 12 + 2p
+// for black and sq * 12 + 2p - 11 for white.
+TARGET_AVX2 static uint64_t PieceKeysAVX2(const eChessPiece * pBoard, const uint64_t *)
+{
+    const long long * pKeys = reinterpret_cast<const long long *>(&g_ZobristTable.aKeys[0][0][0]);
+    const __m128i empty      = _mm_set1_epi32(EMPTY);
+    const __m128i lastBlack  = _mm_set1_epi32(B_PAWN);
+    const __m128i whiteBias  = _mm_set1_epi32(2 * NUM_PIECES - 1);
+    const __m128i squareStep = _mm_set1_epi32(4 * NUM_PIECE_TYPES);
+    __m128i squareBase = _mm_setr_epi32(0, NUM_PIECE_TYPES, 2 * NUM_PIECE_TYPES, 3 * NUM_PIECE_TYPES);
+    __m256i keys = _mm256_setzero_si256();
+
+    for(int ii = 0; ii < BOARD_SIZE; ii += 4)
+    {
+        __m128i pieces = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pBoard[ii]));
+        __m128i white  = _mm_cmpgt_epi32(pieces, lastBlack);
+        __m128i index  = _mm_sub_epi32(_mm_add_epi32(squareBase, _mm_add_epi32(pieces, pieces)), _mm_and_si128(white, whiteBias));
+        __m128i occupied = _mm_andnot_si128(_mm_cmpeq_epi32(pieces, empty), _mm_set1_epi32(-1));
+
+        keys = _mm256_xor_si256(keys, _mm256_mask_i32gather_epi64(_mm256_setzero_si256(), pKeys, index,
+                                                                    _mm256_cvtepi32_epi64(occupied), 8));
+        squareBase = _mm_add_epi32(squareBase, squareStep);
+    }
+
+    uint64_t aKeys[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(aKeys), keys);
+    return aKeys[0] ^ aKeys[1] ^ aKeys[2] ^ aKeys[3];
+}
+
+#endif  // CPU_X86
+
+typedef uint64_t (*PFN_PIECE_KEYS)(const eChessPiece * pBoard, const uint64_t * pBitboards);
+
+static PFN_PIECE_KEYS ChoosePieceKeys()
+{
+#ifdef CPU_X86
+    if(CpuHasAVX2())
+    {
+        return PieceKeysAVX2;
+    }
+#endif
+
+    return PieceKeysBitboards;
+}
+
+static inline uint64_t PieceKey(int pos, eChessPiece piece)
+{
+    return g_ZobristTable.aKeys[pos][GetUncoloredPiece(piece)][GetPieceColor(piece)];
+}
+
+uint64_t ChessBoard::CalculateZobristKey(
+    eColor sideToMove) const
+{
+    static const PFN_PIECE_KEYS pfnPieceKeys = ChoosePieceKeys();
+
+    uint64_t uZobristKey = pfnPieceKeys(m_aBoard, m_aBitboards);
+    assert(uZobristKey == PieceKeysBitboards(m_aBoard, m_aBitboards));
+
+    uZobristKey ^= g_ZobristTable.aCastling[m_castling];
+    if(m_enPassant != NO_SQUARE)
+    {
+        uZobristKey ^= g_ZobristTable.aEnPassant[m_enPassant % 8];
+    }
+
     if(BLACK == sideToMove)
     {
         uZobristKey ^= BLACK_TO_MOVE;
@@ -122,11 +390,13 @@ uint64_t ChessBoard::UpdateZobristKey(
 
     uint64_t newKey = oldKey;
 
-    int color = GetPieceColor(piece);
-    piece = GetUncoloredPiece(piece);
+    if(m_aBoard[newPos] != EMPTY)
+    {
+        newKey ^= PieceKey(newPos, m_aBoard[newPos]);   // remove captured piece from the key
+    }
 
-    newKey ^= m_aZobristTable[oldPos][piece][color];    // remove piece from the key
-    newKey ^= m_aZobristTable[newPos][piece][color];    // re-add piece to the key in new position
+    newKey ^= PieceKey(oldPos, piece);  // remove piece from the key
+    newKey ^= PieceKey(newPos, piece);  // re-add piece to the key in new position
 
     newKey ^= BLACK_TO_MOVE;    // apply or undo previous setting
 
@@ -135,7 +405,141 @@ uint64_t ChessBoard::UpdateZobristKey(
 
 void ChessBoard::MovePiece(int oldPos, int newPos)
 {
-    m_aBoard[newPos] = m_aBoard[oldPos];
-    m_aBoard[oldPos] = EMPTY;
+    eChessPiece piece = m_aBoard[oldPos];
+
+    ClearPiece(oldPos);
+    if(m_aBoard[newPos] != EMPTY)
+    {
+        ClearPiece(newPos);
+    }
+    SetPiece(newPos, piece);
+}
+
+// The castling rights that survive a move from or to each square.  Moving the
+// king loses both of its side's rights, and moving a rook, or capturing it,
+// loses the right on its side.
+static constexpr uint8_t CastlingMask(int pos)
+{
+    return static_cast<uint8_t>(pos == 4  ? CASTLE_ALL & ~(CASTLE_W_KINGSIDE | CASTLE_W_QUEENSIDE) :
+                                pos == 0  ? CASTLE_ALL & ~CASTLE_W_QUEENSIDE :
+                                pos == 7  ? CASTLE_ALL & ~CASTLE_W_KINGSIDE :
+                                pos == 60 ? CASTLE_ALL & ~(CASTLE_B_KINGSIDE | CASTLE_B_QUEENSIDE) :
+                                pos == 56 ? CASTLE_ALL & ~CASTLE_B_QUEENSIDE :
+                                pos == 63 ? CASTLE_ALL & ~CASTLE_B_KINGSIDE :
+                                            CASTLE_ALL);
+}
+
+// The rook's squares for a castling move, from the king's destination.
+static inline void CastlingRook(int kingTo, int & rookFrom, int & rookTo)
+{
+    bool fKingside = (kingTo % 8) == 6;
+    rookFrom = fKingside ? kingTo + 1 : kingTo - 2;
+    rookTo   = fKingside ? kingTo - 1 : kingTo + 1;
+}
+
+// The square of the pawn taken en passant is beside the destination, on the
+// rank behind it: for white, to - 8, and for black, to + 8.  The target squares
+// are on the third and sixth ranks, so both are to ^ 8.
+static inline int CapturePos(const Move & move)
+{
+    return move.kind == MOVE_EN_PASSANT ? (move.to ^ 8) : move.to;
 }
 
+void ChessBoard::MakeMove(const Move & move, UndoState & undo)
+{
+    assert(m_aBoard[move.from] != EMPTY && GetPieceColor(m_aBoard[move.from]) == m_sideToMove);
+
+    undo.move      = move;
+    undo.captured  = EMPTY;
+    undo.key       = m_key;
+    undo.castling  = m_castling;
+    undo.enPassant = static_cast<int8_t>(m_enPassant);
+
+    uint64_t key = m_key;
+
+    if(m_enPassant != NO_SQUARE)
+    {
+        key ^= g_ZobristTable.aEnPassant[m_enPassant % 8];
+        m_enPassant = NO_SQUARE;
+    }
+
+    int capturePos = CapturePos(move);
+    if(m_aBoard[capturePos] != EMPTY)
+    {
+        undo.captured = m_aBoard[capturePos];
+        key ^= PieceKey(capturePos, undo.captured);
+        ClearPiece(capturePos);
+    }
+
+    eChessPiece piece = m_aBoard[move.from];
+    key ^= PieceKey(move.from, piece);
+    ClearPiece(move.from);
+
+    if(move.kind == MOVE_PROMOTION)
+    {
+        piece = eChessPiece(move.promotion);
+    }
+    key ^= PieceKey(move.to, piece);
+    SetPiece(move.to, piece);
+
+    if(move.kind == MOVE_CASTLE)
+    {
+        int rookFrom;
+        int rookTo;
+        CastlingRook(move.to, rookFrom, rookTo);
+
+        eChessPiece rook = m_aBoard[rookFrom];
+        key ^= PieceKey(rookFrom, rook) ^ PieceKey(rookTo, rook);
+        ClearPiece(rookFrom);
+        SetPiece(rookTo, rook);
+    }
+    else if(move.kind == MOVE_DOUBLE_PUSH)
+    {
+        m_enPassant = (move.from + move.to) / 2;
+        key ^= g_ZobristTable.aEnPassant[m_enPassant % 8];
+    }
+
+    uint8_t castling = static_cast<uint8_t>(m_castling & CastlingMask(move.from) & CastlingMask(move.to));
+    key ^= g_ZobristTable.aCastling[m_castling] ^ g_ZobristTable.aCastling[castling];
+    m_castling = castling;
+
+    key ^= BLACK_TO_MOVE;
+    m_sideToMove = m_sideToMove == WHITE ? BLACK : WHITE;
+
+    m_key = key;
+}
+
+void ChessBoard::UnmakeMove(const UndoState & undo)
+{
+    const Move & move = undo.move;
+
+    m_sideToMove = m_sideToMove == WHITE ? BLACK : WHITE;
+
+    eChessPiece piece = m_aBoard[move.to];
+    ClearPiece(move.to);
+    if(move.kind == MOVE_PROMOTION)
+    {
+        piece = m_sideToMove == WHITE ? W_PAWN : B_PAWN;
+    }
+    SetPiece(move.from, piece);
+
+    if(move.kind == MOVE_CASTLE)
+    {
+        int rookFrom;
+        int rookTo;
+        CastlingRook(move.to, rookFrom, rookTo);
+
+        eChessPiece rook = m_aBoard[rookTo];
+        ClearPiece(rookTo);
+        SetPiece(rookFrom, rook);
+    }
+
+    if(undo.captured != EMPTY)
+    {
+        SetPiece(CapturePos(move), undo.captured);
+    }
+
+    m_key       = undo.key;
+    m_castling  = undo.castling;
+    m_enPassant = undo.enPassant;
+}
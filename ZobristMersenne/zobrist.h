@@ -7,25 +7,113 @@
 const int BOARD_SIZE = 8 * 8;   // size of chess board
 const int NUM_PIECES = 6;       // rook, knight, bishop, king, queen, pawn
 const int NUM_COLORS = 2;       // white, black
+const int NUM_PIECE_TYPES = NUM_PIECES * NUM_COLORS;    // one bitboard per colored piece
 
 enum eChessPiece { B_ROOK, B_KNIGHT, B_BISHOP, B_KING, B_QUEEN, B_PAWN,
                    W_ROOK, W_KNIGHT, W_BISHOP, W_KING, W_QUEEN, W_PAWN,
                    EMPTY };
 enum eColor { BLACK, WHITE };
 
+eColor GetPieceColor(eChessPiece piece);
+eChessPiece GetUncoloredPiece(eChessPiece piece);
+
+// Castling rights, as bits of a mask.
+enum eCastling { CASTLE_W_KINGSIDE = 1, CASTLE_W_QUEENSIDE = 2,
+                 CASTLE_B_KINGSIDE = 4, CASTLE_B_QUEENSIDE = 8,
+                 CASTLE_ALL = 15 };
+const int NUM_CASTLING_MASKS = 16;
+
+const int NO_SQUARE = -1;       // no en passant target
+const int MAX_PLY = 128;        // the deepest that a search goes
+
+// The Zobrist random numbers, generated at compile time and shared by all boards.
+// The castling keys are indexed by the whole mask of rights, so a change of any
+// number of rights is a single XOR of the old and new entries.
+struct ZobristTable
+{
+    uint64_t aKeys[BOARD_SIZE][NUM_PIECES][NUM_COLORS];
+    uint64_t aCastling[NUM_CASTLING_MASKS];
+    uint64_t aEnPassant[8];     // by file of the target square
+};
+
+extern const ZobristTable g_ZobristTable;
+
+// The seed of the MT19937-64 that fills the table.  Keys saved to disk are
+// only valid for a table generated from the same seed.
+const uint64_t ZOBRIST_SEED = 5489;
+
+// Use a constant instead of transposing the key depending on the side to play.
+// This is more efficient, since I can more easily undo operations (so I can
+// incrementally update the key).
+const uint64_t BLACK_TO_MOVE = 0x8913125CFB309AFC;  // Random number to XOR into black moves
+
+enum eMoveKind { MOVE_NORMAL,       // a quiet move or a capture
+                 MOVE_DOUBLE_PUSH,  // a pawn's first move of two squares
+                 MOVE_EN_PASSANT,
+                 MOVE_CASTLE,       // from and to are the king's squares
+                 MOVE_PROMOTION };  // promotion names the piece, with its color
+
+// A move is four bytes, so move lists stay small.  Captures are not marked, as
+// the captured piece is whatever is on the destination square.
+struct Move
+{
+    uint8_t from;
+    uint8_t to;
+    uint8_t kind;       // eMoveKind
+    uint8_t promotion;  // eChessPiece, for MOVE_PROMOTION
+};
+
+// The board is kept both as a piece per square (a mailbox), and as a bitboard
+// of squares per piece, indexed by eChessPiece.  The mailbox answers "what is on
+// this square", and the bitboards let the full key visit only occupied squares.
+//
+// Everything a move destroys, so that unmaking the move restores it rather than
+// recomputing it.
+struct UndoState
+{
+    Move        move;
+    eChessPiece captured;
+    uint64_t    key;
+    uint8_t     castling;
+    int8_t      enPassant;
+};
+
+// MakeMove and UnmakeMove keep the key up to date along with the board, in a
+// constant number of XORs for any kind of move.  The caller keeps the undo
+// state, usually on its own stack for each ply, so boards stay small enough to
+// copy for each search thread, and neither call allocates.
 class ChessBoard
 {
-    uint64_t m_aZobristTable[BOARD_SIZE][NUM_PIECES][NUM_COLORS];
     eChessPiece m_aBoard[BOARD_SIZE];
+    uint64_t m_aBitboards[NUM_PIECE_TYPES];
+    eColor m_sideToMove = WHITE;
+    uint8_t m_castling = CASTLE_ALL;    // eCastling mask
+    int m_enPassant = NO_SQUARE;        // square behind a pawn that just moved two squares
+    uint64_t m_key = 0;
 
-    void InitializeZobristTable();
     void PopulateChessBoard();
+    void SetPiece(int pos, eChessPiece piece);
+    void ClearPiece(int pos);
 
 public:
     ChessBoard();
+    bool SetFEN(const char * pszFEN);
     uint64_t CalculateZobristKey(eColor sideToMove) const;
+
+    // The key after moving a piece, for a quiet move or capture that doesn't
+    // change castling rights or en passant.  Call before MovePiece().
     uint64_t UpdateZobristKey(uint64_t oldKey, eChessPiece piece, int oldPos, int newPos) const;
     void MovePiece(int oldPos, int newPos);
+
+    void MakeMove(const Move & move, UndoState & undo);
+    void UnmakeMove(const UndoState & undo);
+
+    uint64_t Key() const { return m_key; }
+    eColor SideToMove() const { return m_sideToMove; }
+    int Castling() const { return m_castling; }
+    int EnPassant() const { return m_enPassant; }
+    eChessPiece PieceAt(int pos) const { return m_aBoard[pos]; }
+    uint64_t Bitboard(eChessPiece piece) const { return m_aBitboards[piece]; }
 };
 
 #endif
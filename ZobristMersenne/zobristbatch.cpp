@@ -0,0 +1,207 @@
+#include "PreCompile.h"
+#include "zobristbatch.h"
+#include "cpufeatures.h"
+
+// Boards are hashed in blocks of this many, which is the width of the widest
+// load, and the rows are padded to a multiple of it.
+const size_t BLOCK_BOARDS = 16;
+
+ZobristBatch::ZobristBatch(size_t cBoards) :
+    m_cBoards(cBoards),
+    m_cStride((cBoards + BLOCK_BOARDS - 1) / BLOCK_BOARDS * BLOCK_BOARDS),
+    m_aSquares(BOARD_SIZE * m_cStride, static_cast<int8_t>(EMPTY)),
+    m_aSideToMove(cBoards, static_cast<uint8_t>(WHITE)),
+    m_aCastling(cBoards, 0),
+    m_aEnPassant(cBoards, static_cast<int8_t>(NO_SQUARE))
+{
+}
+
+void ZobristBatch::SetBoard(size_t ii, const ChessBoard & board)
+{
+    assert(ii < m_cBoards);
+
+    for(int pos = 0; pos < BOARD_SIZE; pos++)
+    {
+        m_aSquares[pos * m_cStride + ii] = static_cast<int8_t>(board.PieceAt(pos));
+    }
+    m_aSideToMove[ii] = static_cast<uint8_t>(board.SideToMove());
+    m_aCastling[ii]   = static_cast<uint8_t>(board.Castling());
+    m_aEnPassant[ii]  = static_cast<int8_t>(board.EnPassant());
+}
+
+// The piece keys of one block of boards.  pSquares points at the first board
+// of the block in the row for square 0.
+static void BlockKeysScalar(const int8_t * pSquares, size_t cStride, uint64_t * pKeys)
+{
+    for(size_t jj = 0; jj < BLOCK_BOARDS; jj++)
+    {
+        uint64_t key = 0;
+        for(int pos = 0; pos < BOARD_SIZE; pos++)
+        {
+            eChessPiece piece = eChessPiece(pSquares[pos * cStride + jj]);
+            if(piece != EMPTY)
+            {
+                key ^= g_ZobristTable.aKeys[pos][GetUncoloredPiece(piece)][GetPieceColor(piece)];
+            }
+        }
+        pKeys[jj] = key;
+    }
+}
+
+#ifdef CPU_X86
+
+// The flattened table index is computed as in PieceKeysAVX2() in zobrist.cpp:
+// sq * 12 + 2p for black pieces, and sq * 12 + 2p - 11 for white pieces.  Each
+// square is four gathers of four keys, one per group of four boards.
+TARGET_AVX2 static void BlockKeysAVX2(const int8_t * pSquares, size_t cStride, uint64_t * pKeys)
+{
+    const long long * pTable = reinterpret_cast<const long long *>(&g_ZobristTable.aKeys[0][0][0]);
+    const __m256i empty     = _mm256_set1_epi32(EMPTY);
+    const __m256i lastBlack = _mm256_set1_epi32(B_PAWN);
+    const __m256i whiteBias = _mm256_set1_epi32(2 * NUM_PIECES - 1);
+    __m256i squareBase = _mm256_setzero_si256();
+    __m256i aKeys[4] = { _mm256_setzero_si256(), _mm256_setzero_si256(),
+                         _mm256_setzero_si256(), _mm256_setzero_si256() };
+
+    for(int pos = 0; pos < BOARD_SIZE; pos++)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pSquares[pos * cStride]));
+
+        for(int half = 0; half < 2; half++)
+        {
+            __m256i pieces   = _mm256_cvtepi8_epi32(half == 0 ? bytes : _mm_srli_si128(bytes, 8));
+            __m256i white    = _mm256_cmpgt_epi32(pieces, lastBlack);
+            __m256i index    = _mm256_sub_epi32(_mm256_add_epi32(squareBase, _mm256_add_epi32(pieces, pieces)),
+                                                _mm256_and_si256(white, whiteBias));
+            __m256i occupied = _mm256_xor_si256(_mm256_cmpeq_epi32(pieces, empty), _mm256_set1_epi32(-1));
+
+            aKeys[2 * half] = _mm256_xor_si256(aKeys[2 * half],
+                _mm256_mask_i32gather_epi64(_mm256_setzero_si256(), pTable, _mm256_castsi256_si128(index),
+                                            _mm256_cvtepi32_epi64(_mm256_castsi256_si128(occupied)), 8));
+            aKeys[2 * half + 1] = _mm256_xor_si256(aKeys[2 * half + 1],
+                _mm256_mask_i32gather_epi64(_mm256_setzero_si256(), pTable, _mm256_extracti128_si256(index, 1),
+                                            _mm256_cvtepi32_epi64(_mm256_extracti128_si256(occupied, 1)), 8));
+        }
+
+        squareBase = _mm256_add_epi32(squareBase, _mm256_set1_epi32(NUM_PIECE_TYPES));
+    }
+
+    for(int ii = 0; ii < 4; ii++)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&pKeys[4 * ii]), aKeys[ii]);
+    }
+}
+
+// The same, with a whole block per load and two gathers of eight keys.  The
+// zero-masked forms of the conversions avoid a false uninitialized warning
+// from gcc 12's headers for the unmasked forms.
+TARGET_AVX512 static void BlockKeysAVX512(const int8_t * pSquares, size_t cStride, uint64_t * pKeys)
+{
+    const long long * pTable = reinterpret_cast<const long long *>(&g_ZobristTable.aKeys[0][0][0]);
+    const __m512i empty     = _mm512_set1_epi32(EMPTY);
+    const __m512i lastBlack = _mm512_set1_epi32(B_PAWN);
+    const __m512i whiteBias = _mm512_set1_epi32(2 * NUM_PIECES - 1);
+    __m512i squareBase = _mm512_setzero_si512();
+    __m512i keysLow  = _mm512_setzero_si512();
+    __m512i keysHigh = _mm512_setzero_si512();
+
+    for(int pos = 0; pos < BOARD_SIZE; pos++)
+    {
+        __m128i bytes  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pSquares[pos * cStride]));
+        __m512i pieces = _mm512_maskz_cvtepi8_epi32(0xFFFF, bytes);
+        __mmask16 occupied = _mm512_cmpneq_epi32_mask(pieces, empty);
+        __mmask16 white    = _mm512_cmpgt_epi32_mask(pieces, lastBlack);
+        __m512i index = _mm512_add_epi32(squareBase, _mm512_add_epi32(pieces, pieces));
+        index = _mm512_mask_sub_epi32(index, white, index, whiteBias);
+
+        keysLow = _mm512_xor_si512(keysLow,
+            _mm512_mask_i32gather_epi64(_mm512_setzero_si512(), static_cast<__mmask8>(occupied),
+                                        _mm512_maskz_extracti64x4_epi64(0xFF, index, 0), pTable, 8));
+        keysHigh = _mm512_xor_si512(keysHigh,
+            _mm512_mask_i32gather_epi64(_mm512_setzero_si512(), static_cast<__mmask8>(occupied >> 8),
+                                        _mm512_maskz_extracti64x4_epi64(0xFF, index, 1), pTable, 8));
+
+        squareBase = _mm512_add_epi32(squareBase, _mm512_set1_epi32(NUM_PIECE_TYPES));
+    }
+
+    _mm512_storeu_si512(&pKeys[0], keysLow);
+    _mm512_storeu_si512(&pKeys[8], keysHigh);
+}
+
+#endif  // CPU_X86
+
+typedef void (*PFN_BLOCK_KEYS)(const int8_t * pSquares, size_t cStride, uint64_t * pKeys);
+
+static PFN_BLOCK_KEYS ChooseBlockKeys()
+{
+#ifdef CPU_X86
+    if(CpuHasAVX512F())
+    {
+        return BlockKeysAVX512;
+    }
+    if(CpuHasAVX2())
+    {
+        return BlockKeysAVX2;
+    }
+#endif
+
+    return BlockKeysScalar;
+}
+
+void ZobristBatch::CalculateKeysRange(uint64_t * pKeys, size_t first, size_t last) const
+{
+    static const PFN_BLOCK_KEYS pfnBlockKeys = ChooseBlockKeys();
+
+    assert(first % BLOCK_BOARDS == 0);
+
+    for(size_t block = first; block < last; block += BLOCK_BOARDS)
+    {
+        uint64_t aKeys[BLOCK_BOARDS];
+        pfnBlockKeys(&m_aSquares[block], m_cStride, aKeys);
+
+        size_t cKeys = std::min(BLOCK_BOARDS, last - block);
+        for(size_t jj = 0; jj < cKeys; jj++)
+        {
+            size_t ii = block + jj;
+            uint64_t key = aKeys[jj] ^ g_ZobristTable.aCastling[m_aCastling[ii]];
+            if(m_aEnPassant[ii] != NO_SQUARE)
+            {
+                key ^= g_ZobristTable.aEnPassant[m_aEnPassant[ii] % 8];
+            }
+            if(m_aSideToMove[ii] == BLACK)
+            {
+                key ^= BLACK_TO_MOVE;
+            }
+            pKeys[ii] = key;
+        }
+    }
+}
+
+void ZobristBatch::CalculateKeys(uint64_t * pKeys, int cThreads) const
+{
+    assert(cThreads >= 1);
+
+    // Give each thread a whole number of blocks.
+    size_t cBlocks = m_cStride / BLOCK_BOARDS;
+    size_t cBlocksPerThread = (cBlocks + cThreads - 1) / cThreads;
+
+    std::vector<std::thread> aThreads;
+    for(int ii = 1; ii < cThreads; ii++)
+    {
+        size_t first = std::min(m_cBoards, ii * cBlocksPerThread * BLOCK_BOARDS);
+        size_t last  = std::min(m_cBoards, first + cBlocksPerThread * BLOCK_BOARDS);
+        if(first < last)
+        {
+            aThreads.push_back(std::thread(&ZobristBatch::CalculateKeysRange, this, pKeys, first, last));
+        }
+    }
+
+    // This thread takes the first range.
+    CalculateKeysRange(pKeys, 0, std::min(m_cBoards, cBlocksPerThread * BLOCK_BOARDS));
+
+    for(auto & thread : aThreads)
+    {
+        thread.join();
+    }
+}
+
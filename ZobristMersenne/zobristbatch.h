@@ -0,0 +1,38 @@
+#ifndef ZOBRISTBATCH_H
+#define ZOBRISTBATCH_H
+
+#include "zobrist.h"
+
+// Many positions stored as a structure of arrays, for hashing in bulk (such as
+// when verifying a game database or building an opening book).
+//
+// Each square is a row holding that square's piece on every board, so one
+// vector load reads the same square of 8 or 16 consecutive boards, and each
+// board is only a byte per square.  The rows are padded to a multiple of 16
+// boards with empty squares, so the SIMD paths never need a scalar tail.
+class ZobristBatch
+{
+    size_t m_cBoards;
+    size_t m_cStride;                   // boards per row, including padding
+    std::vector<int8_t> m_aSquares;     // eChessPiece, BOARD_SIZE rows of m_cStride
+    std::vector<uint8_t> m_aSideToMove; // eColor
+    std::vector<uint8_t> m_aCastling;   // eCastling mask
+    std::vector<int8_t> m_aEnPassant;   // square, or NO_SQUARE
+
+public:
+    explicit ZobristBatch(size_t cBoards);
+
+    size_t Size() const { return m_cBoards; }
+    void SetBoard(size_t ii, const ChessBoard & board);
+
+    // Compute the key of every board into pKeys, which holds Size() keys,
+    // splitting the boards between cThreads threads.  The keys are the same
+    // as ChessBoard::CalculateZobristKey() for each board.
+    void CalculateKeys(uint64_t * pKeys, int cThreads = 1) const;
+
+private:
+    void CalculateKeysRange(uint64_t * pKeys, size_t first, size_t last) const;
+};
+
+#endif
+
@@ -0,0 +1,164 @@
+#ifndef ZOBRISTHASHER_H
+#define ZOBRISTHASHER_H
+
+#include "mersenne.h"
+#include "mersenne64.h"
+
+// A 128-bit key, for state spaces large enough that 64-bit keys would collide
+// too often.
+struct ZobristKey128
+{
+    uint64_t lo;
+    uint64_t hi;
+
+    ZobristKey128 & operator^=(const ZobristKey128 & other)
+    {
+        lo ^= other.lo;
+        hi ^= other.hi;
+        return *this;
+    }
+
+    bool operator==(const ZobristKey128 & other) const { return lo == other.lo && hi == other.hi; }
+    bool operator!=(const ZobristKey128 & other) const { return !(*this == other); }
+};
+
+// How to fill a table with random keys of each width.  Each width uses the
+// generator that produces it natively.
+template<typename KeyT>
+struct ZobristKeyTraits;
+
+template<>
+struct ZobristKeyTraits<uint32_t>
+{
+    static uint32_t Zero() { return 0; }
+    static void Fill(uint32_t * pKeys, size_t cKeys) { MersenneTwister rng; rng.Fill(pKeys, cKeys); }
+};
+
+template<>
+struct ZobristKeyTraits<uint64_t>
+{
+    static uint64_t Zero() { return 0; }
+    static void Fill(uint64_t * pKeys, size_t cKeys) { MersenneTwister64 rng; rng.Fill(pKeys, cKeys); }
+};
+
+template<>
+struct ZobristKeyTraits<ZobristKey128>
+{
+    static ZobristKey128 Zero() { return ZobristKey128{ 0, 0 }; }
+    static void Fill(ZobristKey128 * pKeys, size_t cKeys)
+    {
+        MersenneTwister64 rng;
+        for(size_t ii = 0; ii < cKeys; ii++)
+        {
+            pKeys[ii].lo = rng.Rand64();
+            pKeys[ii].hi = rng.Rand64();
+        }
+    }
+};
+
+// A feature present at a position, such as a stone on a point of a Go board,
+// a tile type on a map cell, or a component on an entity.
+struct ZobristFeature
+{
+    int pos;
+    int feature;
+};
+
+// Zobrist hashing for any state made of features at positions.  The table of
+// Positions * Features keys is generated on first use and then shared,
+// read-only, by every user of the same instantiation.  The key width is the
+// KeyT parameter: uint32_t, uint64_t or ZobristKey128.
+//
+// For chess, where the table is small and fixed, zobrist.h generates its
+// table at compile time instead.
+template<int Positions, int Features, typename KeyT = uint64_t>
+class ZobristHasher
+{
+    static_assert(Positions > 0 && Features > 0, "The table must not be empty.");
+
+    // A vector rather than an array, so that a large table isn't built on the stack.
+    static const std::vector<KeyT> & Table()
+    {
+        static const std::vector<KeyT> s_aKeys = GenerateTable();
+        return s_aKeys;
+    }
+
+    static std::vector<KeyT> GenerateTable()
+    {
+        std::vector<KeyT> aKeys(static_cast<size_t>(Positions) * Features);
+        ZobristKeyTraits<KeyT>::Fill(aKeys.data(), aKeys.size());
+        return aKeys;
+    }
+
+    static size_t Index(int pos, int feature)
+    {
+        assert(pos >= 0 && pos < Positions && feature >= 0 && feature < Features);
+        return static_cast<size_t>(pos) * Features + feature;
+    }
+
+public:
+    typedef KeyT Key;
+    enum { NO_FEATURE = -1 };
+
+    static Key KeyOf(int pos, int feature)
+    {
+        return Table()[Index(pos, feature)];
+    }
+
+    // The key of a whole state, from a range holding the feature at each
+    // position in order, or NO_FEATURE for an empty position.
+    template<typename Iterator>
+    static Key Full(Iterator first, Iterator last)
+    {
+        assert(std::distance(first, last) <= Positions);
+
+        Key key = ZobristKeyTraits<KeyT>::Zero();
+        int pos = 0;
+        for(; first != last; ++first, ++pos)
+        {
+            int feature = static_cast<int>(*first);
+            if(feature != NO_FEATURE)
+            {
+                key ^= KeyOf(pos, feature);
+            }
+        }
+
+        return key;
+    }
+
+    // Add a feature to the key, or remove it if it is already present.
+    static void Toggle(Key & key, int pos, int feature)
+    {
+        key ^= KeyOf(pos, feature);
+    }
+
+    // Toggle a batch of features.  Four independent accumulators keep the
+    // loads from waiting on a single chain of XORs.
+    static void ToggleMany(Key & key, const ZobristFeature * pFeatures, size_t cFeatures)
+    {
+        const Key * pTable = Table().data();
+        Key aKeys[4] = { ZobristKeyTraits<KeyT>::Zero(), ZobristKeyTraits<KeyT>::Zero(),
+                         ZobristKeyTraits<KeyT>::Zero(), ZobristKeyTraits<KeyT>::Zero() };
+
+        size_t ii = 0;
+        for(; ii + 4 <= cFeatures; ii += 4)
+        {
+            aKeys[0] ^= pTable[Index(pFeatures[ii].pos, pFeatures[ii].feature)];
+            aKeys[1] ^= pTable[Index(pFeatures[ii + 1].pos, pFeatures[ii + 1].feature)];
+            aKeys[2] ^= pTable[Index(pFeatures[ii + 2].pos, pFeatures[ii + 2].feature)];
+            aKeys[3] ^= pTable[Index(pFeatures[ii + 3].pos, pFeatures[ii + 3].feature)];
+        }
+        for(; ii < cFeatures; ii++)
+        {
+            aKeys[0] ^= pTable[Index(pFeatures[ii].pos, pFeatures[ii].feature)];
+        }
+
+        aKeys[0] ^= aKeys[1];
+        aKeys[2] ^= aKeys[3];
+        key ^= aKeys[0];
+        key ^= aKeys[2];
+    }
+};
+
+#endif
+
@@ -0,0 +1,181 @@
+// Perft benchmark for the incremental Zobrist key
+// Counts the positions reachable in a fixed number of moves, making and
+// unmaking every move, and checks the incremental key against a full key
+// calculation at every node.  The leaf counts are well known, so they also
+// check the move generator.
+//
+// It also runs a lazy SMP search with a shared transposition table, to show
+// how the key and table code scale across threads.
+//
+// Usage: ZobristPerft                  run the standard perft positions
+//        ZobristPerft depth            perft of the initial position
+//        ZobristPerft depth "fen"      perft of a FEN position
+//        ZobristPerft -smp [threads]   search scaling from 1 to threads (default 64)
+
+#include "PreCompile.h"
+#include "zobrist.h"
+#include "movegen.h"
+#include "transposition.h"
+#include "search.h"
+
+struct PerftStats
+{
+    uint64_t cNodes = 0;        // legal positions visited, below the root
+    uint64_t cKeyUpdates = 0;   // moves made, including those found to be illegal
+    uint64_t cMismatches = 0;   // nodes where the incremental key was wrong
+};
+
+static uint64_t Perft(ChessBoard & board, int depth, PerftStats & stats)
+{
+    Move aMoves[MAX_MOVES];
+    int cMoves = GenerateMoves(board, aMoves);
+
+    UndoState undo;
+    uint64_t cLeaves = 0;
+    for(int ii = 0; ii < cMoves; ii++)
+    {
+        board.MakeMove(aMoves[ii], undo);
+        stats.cKeyUpdates++;
+
+        if(!IsMoverInCheck(board))
+        {
+            stats.cNodes++;
+            if(board.Key() != board.CalculateZobristKey(board.SideToMove()))
+            {
+                stats.cMismatches++;
+            }
+
+            cLeaves += (depth > 1) ? Perft(board, depth - 1, stats) : 1;
+        }
+
+        board.UnmakeMove(undo);
+    }
+
+    return cLeaves;
+}
+
+// Run perft and report the throughput.  Returns whether the leaf count is
+// as expected (if known) and every key matched.
+static bool RunPerft(ChessBoard & board, const char * pszName, int depth, uint64_t cExpected)
+{
+    PerftStats stats;
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t cLeaves = Perft(board, depth, stats);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << pszName << ", depth " << depth << ": " << cLeaves << " leaves";
+    if(cExpected != 0)
+    {
+        std::cout << ((cLeaves == cExpected) ? " (correct)" : " (_incorrect_)");
+    }
+    std::cout << std::endl;
+    std::cout << "    " << static_cast<uint64_t>(stats.cNodes / elapsed.count()) << " nodes/s, "
+              << static_cast<uint64_t>(stats.cKeyUpdates / elapsed.count()) << " key updates/s, "
+              << stats.cMismatches << " key mismatches" << std::endl;
+
+    return (cExpected == 0 || cLeaves == cExpected) && stats.cMismatches == 0;
+}
+
+struct PerftPosition
+{
+    const char * pszName;
+    const char * pszFEN;
+    int depth;
+    uint64_t cLeaves;
+};
+
+// The usual perft test positions, which between them cover castling, en
+// passant, promotion, and checks that pin and discover.
+static const PerftPosition s_aPositions[] = {
+    { "Kiwipete",   "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, 4085603 },
+    { "Position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, 674624 },
+    { "Position 4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4, 422333 },
+    { "Position 5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4, 2103487 },
+    { "Position 6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594 },
+};
+
+// Search the same position for the same time with 1, 2, 4, ... threads, each
+// with a fresh table, and report the throughput and table behavior.
+static void RunSmpScaling(int cMaxThreads)
+{
+    const double seconds = 1.0;
+    const size_t cbTable = 64 * 1024 * 1024;
+
+    ChessBoard board;
+    board.SetFEN(s_aPositions[0].pszFEN);
+
+    std::cout << "Lazy SMP search of " << s_aPositions[0].pszName << " for " << seconds << " s per run" << std::endl;
+
+    double baseNodesPerSecond = 0;
+    for(int cThreads = 1; cThreads <= cMaxThreads; cThreads *= 2)
+    {
+        TranspositionTable table(cbTable);
+        SearchResult result = SearchLazySmp(board, table, cThreads, seconds);
+
+        double nodesPerSecond = result.cNodes / result.seconds;
+        if(cThreads == 1)
+        {
+            baseNodesPerSecond = nodesPerSecond;
+        }
+
+        std::cout << cThreads << " threads: " << static_cast<uint64_t>(nodesPerSecond) << " nodes/s ("
+                  << nodesPerSecond / baseNodesPerSecond << "x), depth " << result.depth << ", "
+                  << (100.0 * result.tt.cHits) / result.tt.cProbes << "% table hits" << std::endl;
+
+        // The counters cover the whole search, so misses per probe is an upper
+        // bound on the misses the probes themselves cause.
+        if(result.fCountersAvailable && result.cCacheReferences != 0)
+        {
+            std::cout << "    " << (100.0 * result.cCacheMisses) / result.cCacheReferences << "% cache miss rate, "
+                      << static_cast<double>(result.cCacheMisses) / result.tt.cProbes << " misses per probe" << std::endl;
+        }
+        else
+        {
+            std::cout << "    cache counters unavailable" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    if(argc > 1 && std::strcmp(argv[1], "-smp") == 0)
+    {
+        int cMaxThreads = (argc > 2) ? std::atoi(argv[2]) : 64;
+        if(cMaxThreads < 1)
+        {
+            std::cout << "Usage: ZobristPerft -smp [threads]" << std::endl;
+            return 1;
+        }
+
+        RunSmpScaling(cMaxThreads);
+        return 0;
+    }
+
+    if(argc > 1)
+    {
+        int depth = std::atoi(argv[1]);
+        ChessBoard board;
+        if(depth < 1 || depth >= MAX_PLY || (argc > 2 && !board.SetFEN(argv[2])))
+        {
+            std::cout << "Usage: ZobristPerft [depth [\"fen\"]]" << std::endl;
+            return 1;
+        }
+
+        return RunPerft(board, argc > 2 ? argv[2] : "Initial position", depth, 0) ? 0 : 1;
+    }
+
+    bool fPassed = true;
+
+    ChessBoard board;
+    fPassed = RunPerft(board, "Initial position", 5, 4865609) && fPassed;
+
+    for(const PerftPosition & position : s_aPositions)
+    {
+        board.SetFEN(position.pszFEN);
+        fPassed = RunPerft(board, position.pszName, position.depth, position.cLeaves) && fPassed;
+    }
+
+    return fPassed ? 0 : 1;
+}
+
@@ -0,0 +1,291 @@
+#include "PreCompile.h"
+#include "zobrist.h"
+#include "movegen.h"
+#include "bitops.h"
+
+// A plain bitboard move generator: precomputed attacks for the leapers, and
+// ray walks for the sliders.  It is written to be obviously correct rather
+// than fast, as perft uses it to exercise the key updates.
+
+enum eDirection { NORTH, SOUTH, EAST, WEST, NORTH_EAST, NORTH_WEST, SOUTH_EAST, SOUTH_WEST, NUM_DIRECTIONS };
+
+static const int s_aFileStep[NUM_DIRECTIONS] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+static const int s_aRankStep[NUM_DIRECTIONS] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+
+struct AttackTables
+{
+    uint64_t aKnight[BOARD_SIZE];
+    uint64_t aKing[BOARD_SIZE];
+    uint64_t aPawn[NUM_COLORS][BOARD_SIZE];                 // squares a pawn on the square attacks
+    uint64_t aRays[NUM_DIRECTIONS][BOARD_SIZE];             // squares to the edge of the board
+};
+
+static uint64_t SquareBit(int pos)
+{
+    return static_cast<uint64_t>(1) << pos;
+}
+
+// The bit for the square at an offset, or zero if that is off the board.
+static uint64_t OffsetBit(int pos, int fileStep, int rankStep)
+{
+    int file = pos % 8 + fileStep;
+    int rank = pos / 8 + rankStep;
+    return (file >= 0 && file < 8 && rank >= 0 && rank < 8) ? SquareBit(rank * 8 + file) : 0;
+}
+
+static AttackTables BuildAttackTables()
+{
+    static const int s_aKnightFile[8] = { 1, 2, 2, 1, -1, -2, -2, -1 };
+    static const int s_aKnightRank[8] = { 2, 1, -1, -2, -2, -1, 1, 2 };
+
+    AttackTables tables = {};
+
+    for(int pos = 0; pos < BOARD_SIZE; pos++)
+    {
+        for(int ii = 0; ii < 8; ii++)
+        {
+            tables.aKnight[pos] |= OffsetBit(pos, s_aKnightFile[ii], s_aKnightRank[ii]);
+        }
+
+        for(int dir = 0; dir < NUM_DIRECTIONS; dir++)
+        {
+            tables.aKing[pos] |= OffsetBit(pos, s_aFileStep[dir], s_aRankStep[dir]);
+
+            for(int distance = 1; distance < 8; distance++)
+            {
+                tables.aRays[dir][pos] |= OffsetBit(pos, s_aFileStep[dir] * distance, s_aRankStep[dir] * distance);
+            }
+        }
+
+        tables.aPawn[WHITE][pos] = OffsetBit(pos, -1, 1) | OffsetBit(pos, 1, 1);
+        tables.aPawn[BLACK][pos] = OffsetBit(pos, -1, -1) | OffsetBit(pos, 1, -1);
+    }
+
+    return tables;
+}
+
+static const AttackTables & Tables()
+{
+    static const AttackTables tables = BuildAttackTables();
+    return tables;
+}
+
+static eChessPiece ColoredPiece(eChessPiece uncolored, eColor color)
+{
+    return color == WHITE ? eChessPiece(uncolored + NUM_PIECES) : uncolored;
+}
+
+static uint64_t Pieces(const ChessBoard & board, eChessPiece uncolored, eColor color)
+{
+    return board.Bitboard(ColoredPiece(uncolored, color));
+}
+
+static uint64_t ColorOccupancy(const ChessBoard & board, eColor color)
+{
+    uint64_t occupancy = 0;
+    for(int ii = 0; ii < NUM_PIECES; ii++)
+    {
+        occupancy |= Pieces(board, eChessPiece(ii), color);
+    }
+    return occupancy;
+}
+
+// The squares a slider on pos reaches in a direction, up to and including the
+// first occupied square.  The directions that increase the square index find
+// the blocker with the lowest set bit, and the others with the highest.
+static uint64_t RayAttacks(int pos, int dir, uint64_t occupancy)
+{
+    uint64_t ray = Tables().aRays[dir][pos];
+    uint64_t blockers = ray & occupancy;
+    if(blockers != 0)
+    {
+        bool fIncreasing = (s_aRankStep[dir] > 0) || (s_aRankStep[dir] == 0 && s_aFileStep[dir] > 0);
+        int blocker = fIncreasing ? LowestBitIndex(blockers) : HighestBitIndex(blockers);
+        ray ^= Tables().aRays[dir][blocker];
+    }
+    return ray;
+}
+
+static uint64_t RookAttacks(int pos, uint64_t occupancy)
+{
+    return RayAttacks(pos, NORTH, occupancy) | RayAttacks(pos, SOUTH, occupancy) |
+           RayAttacks(pos, EAST, occupancy)  | RayAttacks(pos, WEST, occupancy);
+}
+
+static uint64_t BishopAttacks(int pos, uint64_t occupancy)
+{
+    return RayAttacks(pos, NORTH_EAST, occupancy) | RayAttacks(pos, NORTH_WEST, occupancy) |
+           RayAttacks(pos, SOUTH_EAST, occupancy) | RayAttacks(pos, SOUTH_WEST, occupancy);
+}
+
+bool IsSquareAttacked(const ChessBoard & board, int pos, eColor attacker)
+{
+    const AttackTables & tables = Tables();
+    eColor defender = attacker == WHITE ? BLACK : WHITE;
+    uint64_t occupancy = ColorOccupancy(board, WHITE) | ColorOccupancy(board, BLACK);
+
+    uint64_t queens = Pieces(board, B_QUEEN, attacker);
+
+    return (tables.aPawn[defender][pos] & Pieces(board, B_PAWN, attacker)) != 0 ||
+           (tables.aKnight[pos] & Pieces(board, B_KNIGHT, attacker)) != 0 ||
+           (tables.aKing[pos] & Pieces(board, B_KING, attacker)) != 0 ||
+           (RookAttacks(pos, occupancy) & (Pieces(board, B_ROOK, attacker) | queens)) != 0 ||
+           (BishopAttacks(pos, occupancy) & (Pieces(board, B_BISHOP, attacker) | queens)) != 0;
+}
+
+bool IsMoverInCheck(const ChessBoard & board)
+{
+    eColor mover = board.SideToMove() == WHITE ? BLACK : WHITE;
+    uint64_t king = Pieces(board, B_KING, mover);
+    return king != 0 && IsSquareAttacked(board, LowestBitIndex(king), board.SideToMove());
+}
+
+static Move MakeMoveStruct(int from, int to, eMoveKind kind, eChessPiece promotion = EMPTY)
+{
+    Move move = { static_cast<uint8_t>(from), static_cast<uint8_t>(to),
+                  static_cast<uint8_t>(kind), static_cast<uint8_t>(promotion) };
+    return move;
+}
+
+// Add a move from one square to each square of a bitboard.
+static int AddMoves(int from, uint64_t targets, Move * pMoves)
+{
+    int cMoves = 0;
+    while(targets != 0)
+    {
+        pMoves[cMoves++] = MakeMoveStruct(from, PopLowestBit(targets), MOVE_NORMAL);
+    }
+    return cMoves;
+}
+
+static int GeneratePawnMoves(const ChessBoard & board, uint64_t occupancy, uint64_t enemies, Move * pMoves)
+{
+    static const eChessPiece s_aPromotions[] = { B_QUEEN, B_ROOK, B_BISHOP, B_KNIGHT };
+
+    eColor color = board.SideToMove();
+    int forward   = color == WHITE ? 8 : -8;
+    int startRank = color == WHITE ? 1 : 6;
+    int lastRank  = color == WHITE ? 7 : 0;
+
+    if(board.EnPassant() != NO_SQUARE)
+    {
+        enemies |= SquareBit(board.EnPassant());
+    }
+
+    // SetFEN rejects pawns on the first and last ranks, where a push would
+    // leave the board.
+    int cMoves = 0;
+    uint64_t pawns = Pieces(board, B_PAWN, color);
+    assert((pawns & 0xFF000000000000FFull) == 0);
+    while(pawns != 0)
+    {
+        int from = PopLowestBit(pawns);
+
+        uint64_t targets = Tables().aPawn[color][from] & enemies;
+        int push = from + forward;
+        if((occupancy & SquareBit(push)) == 0)
+        {
+            targets |= SquareBit(push);
+            if(from / 8 == startRank && (occupancy & SquareBit(push + forward)) == 0)
+            {
+                pMoves[cMoves++] = MakeMoveStruct(from, push + forward, MOVE_DOUBLE_PUSH);
+            }
+        }
+
+        while(targets != 0)
+        {
+            int to = PopLowestBit(targets);
+            if(to / 8 == lastRank)
+            {
+                for(eChessPiece promotion : s_aPromotions)
+                {
+                    pMoves[cMoves++] = MakeMoveStruct(from, to, MOVE_PROMOTION, ColoredPiece(promotion, color));
+                }
+            }
+            else
+            {
+                pMoves[cMoves++] = MakeMoveStruct(from, to, to == board.EnPassant() ? MOVE_EN_PASSANT : MOVE_NORMAL);
+            }
+        }
+    }
+
+    return cMoves;
+}
+
+// Castling needs the right, empty squares between the king and rook, and the
+// king not to be in check or pass through or land on an attacked square.
+static int GenerateCastling(const ChessBoard & board, uint64_t occupancy, Move * pMoves)
+{
+    eColor color = board.SideToMove();
+    eColor enemy = color == WHITE ? BLACK : WHITE;
+    int king = color == WHITE ? 4 : 60;
+    int kingside  = color == WHITE ? CASTLE_W_KINGSIDE : CASTLE_B_KINGSIDE;
+    int queenside = color == WHITE ? CASTLE_W_QUEENSIDE : CASTLE_B_QUEENSIDE;
+
+    int cMoves = 0;
+    if((board.Castling() & (kingside | queenside)) == 0 || IsSquareAttacked(board, king, enemy))
+    {
+        return 0;
+    }
+
+    uint64_t kingsideGap = SquareBit(king + 1) | SquareBit(king + 2);
+    if((board.Castling() & kingside) && (occupancy & kingsideGap) == 0 &&
+       !IsSquareAttacked(board, king + 1, enemy) && !IsSquareAttacked(board, king + 2, enemy))
+    {
+        pMoves[cMoves++] = MakeMoveStruct(king, king + 2, MOVE_CASTLE);
+    }
+
+    uint64_t queensideGap = SquareBit(king - 1) | SquareBit(king - 2) | SquareBit(king - 3);
+    if((board.Castling() & queenside) && (occupancy & queensideGap) == 0 &&
+       !IsSquareAttacked(board, king - 1, enemy) && !IsSquareAttacked(board, king - 2, enemy))
+    {
+        pMoves[cMoves++] = MakeMoveStruct(king, king - 2, MOVE_CASTLE);
+    }
+
+    return cMoves;
+}
+
+int GenerateMoves(const ChessBoard & board, Move * pMoves)
+{
+    const AttackTables & tables = Tables();
+    eColor color = board.SideToMove();
+    uint64_t own = ColorOccupancy(board, color);
+    uint64_t enemies = ColorOccupancy(board, color == WHITE ? BLACK : WHITE);
+    uint64_t occupancy = own | enemies;
+
+    int cMoves = GeneratePawnMoves(board, occupancy, enemies, pMoves);
+
+    uint64_t knights = Pieces(board, B_KNIGHT, color);
+    while(knights != 0)
+    {
+        int from = PopLowestBit(knights);
+        cMoves += AddMoves(from, tables.aKnight[from] & ~own, pMoves + cMoves);
+    }
+
+    uint64_t diagonals = Pieces(board, B_BISHOP, color) | Pieces(board, B_QUEEN, color);
+    while(diagonals != 0)
+    {
+        int from = PopLowestBit(diagonals);
+        cMoves += AddMoves(from, BishopAttacks(from, occupancy) & ~own, pMoves + cMoves);
+    }
+
+    uint64_t straights = Pieces(board, B_ROOK, color) | Pieces(board, B_QUEEN, color);
+    while(straights != 0)
+    {
+        int from = PopLowestBit(straights);
+        cMoves += AddMoves(from, RookAttacks(from, occupancy) & ~own, pMoves + cMoves);
+    }
+
+    uint64_t kings = Pieces(board, B_KING, color);
+    while(kings != 0)
+    {
+        int from = PopLowestBit(kings);
+        cMoves += AddMoves(from, tables.aKing[from] & ~own, pMoves + cMoves);
+    }
+
+    cMoves += GenerateCastling(board, occupancy, pMoves + cMoves);
+
+    assert(cMoves <= MAX_MOVES);
+    return cMoves;
+}
+
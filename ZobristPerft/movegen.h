@@ -0,0 +1,18 @@
+#ifndef MOVEGEN_H
+#define MOVEGEN_H
+
+const int MAX_MOVES = 256;      // more than the legal moves of any position
+
+// Generate the pseudo-legal moves of the side to move: every move of the
+// rules except that some may leave the mover's own king in check.  Castling
+// is fully checked, as its legality can't be tested after the move.
+// Returns the number of moves written.
+int GenerateMoves(const ChessBoard & board, Move * pMoves);
+
+bool IsSquareAttacked(const ChessBoard & board, int pos, eColor attacker);
+
+// Whether the side that just moved left its king in check.
+bool IsMoverInCheck(const ChessBoard & board);
+
+#endif
+
@@ -0,0 +1,95 @@
+#include "PreCompile.h"
+#include "perfcounters.h"
+
+#ifdef __linux__
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// glibc has no wrapper for perf_event_open.
+static int OpenCounter(uint64_t config)
+{
+    perf_event_attr attr = {};
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = config;
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+static uint64_t ReadCounter(int fd)
+{
+    uint64_t count = 0;
+    return (read(fd, &count, sizeof(count)) == sizeof(count)) ? count : 0;
+}
+
+CacheCounters::CacheCounters()
+{
+    m_fdReferences = OpenCounter(PERF_COUNT_HW_CACHE_REFERENCES);
+    m_fdMisses = OpenCounter(PERF_COUNT_HW_CACHE_MISSES);
+}
+
+CacheCounters::~CacheCounters()
+{
+    if(m_fdReferences >= 0)
+    {
+        close(m_fdReferences);
+    }
+    if(m_fdMisses >= 0)
+    {
+        close(m_fdMisses);
+    }
+}
+
+void CacheCounters::Start()
+{
+    if(Available())
+    {
+        ioctl(m_fdReferences, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fdMisses, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fdReferences, PERF_EVENT_IOC_ENABLE, 0);
+        ioctl(m_fdMisses, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void CacheCounters::Stop(uint64_t & cReferences, uint64_t & cMisses)
+{
+    cReferences = 0;
+    cMisses = 0;
+
+    if(Available())
+    {
+        ioctl(m_fdReferences, PERF_EVENT_IOC_DISABLE, 0);
+        ioctl(m_fdMisses, PERF_EVENT_IOC_DISABLE, 0);
+        cReferences = ReadCounter(m_fdReferences);
+        cMisses = ReadCounter(m_fdMisses);
+    }
+}
+
+#else
+
+CacheCounters::CacheCounters()
+{
+}
+
+CacheCounters::~CacheCounters()
+{
+}
+
+void CacheCounters::Start()
+{
+}
+
+void CacheCounters::Stop(uint64_t & cReferences, uint64_t & cMisses)
+{
+    cReferences = 0;
+    cMisses = 0;
+}
+
+#endif
+
@@ -0,0 +1,27 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+// Hardware cache reference and miss counts for the calling thread, from
+// perf_event_open on Linux.  Elsewhere, or where the kernel refuses access
+// (see /proc/sys/kernel/perf_event_paranoid), the counters are unavailable
+// and read as zero.
+class CacheCounters
+{
+    int m_fdReferences = -1;
+    int m_fdMisses = -1;
+
+public:
+    CacheCounters();
+    ~CacheCounters();
+
+    CacheCounters(const CacheCounters &) = delete;
+    CacheCounters & operator=(const CacheCounters &) = delete;
+
+    bool Available() const { return m_fdReferences >= 0 && m_fdMisses >= 0; }
+
+    void Start();
+    void Stop(uint64_t & cReferences, uint64_t & cMisses);
+};
+
+#endif
+
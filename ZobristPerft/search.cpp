@@ -0,0 +1,266 @@
+#include "PreCompile.h"
+#include "zobrist.h"
+#include "mersenne.h"
+#include "transposition.h"
+#include "movegen.h"
+#include "bitops.h"
+#include "perfcounters.h"
+#include "search.h"
+
+static const int SCORE_INFINITE = 32000;
+static const int SCORE_MATE     = 31000;   // less the distance to mate, in plies
+
+// Mate scores are stored in the table as the distance from the stored
+// position rather than from the root, so they stay correct at any ply.
+static int ScoreToTable(int score, int ply)
+{
+    return score > SCORE_MATE - MAX_PLY ? score + ply : (score < -(SCORE_MATE - MAX_PLY) ? score - ply : score);
+}
+
+static int ScoreFromTable(int score, int ply)
+{
+    return score > SCORE_MATE - MAX_PLY ? score - ply : (score < -(SCORE_MATE - MAX_PLY) ? score + ply : score);
+}
+
+// Values in eChessPiece order: rook, knight, bishop, king, queen, pawn.
+static const int s_aPieceValues[NUM_PIECES] = { 500, 300, 300, 0, 900, 100 };
+
+struct SearchThread
+{
+    ChessBoard           board;
+    TranspositionTable * pTable;
+    MersenneTwister      rng;
+    bool                 fJitter;
+    TranspositionStats   ttStats;
+    uint64_t             cNodes = 0;
+    std::atomic<bool> *  pfStop;
+    bool                 fStopped = false;  // pfStop has been seen set
+    SearchResult         result;
+
+    SearchThread(const ChessBoard & root, TranspositionTable * pTable_, uint32_t seed, std::atomic<bool> * pfStop_)
+        : board(root), pTable(pTable_), rng(seed), fJitter(seed != 0), pfStop(pfStop_) {}
+};
+
+static int Evaluate(const ChessBoard & board)
+{
+    int score = 0;
+    for(int ii = 0; ii < NUM_PIECES; ii++)
+    {
+        score += s_aPieceValues[ii] * (CountBits(board.Bitboard(eChessPiece(ii + NUM_PIECES))) -
+                                       CountBits(board.Bitboard(eChessPiece(ii))));
+    }
+
+    return board.SideToMove() == WHITE ? score : -score;
+}
+
+// Moves are stored in the table as from, to and the promoted piece type, which
+// is enough to find the move again among the generated moves.
+static uint16_t EncodeMove(const Move & move)
+{
+    int promotion = (move.kind == MOVE_PROMOTION) ? GetUncoloredPiece(eChessPiece(move.promotion)) : 0;
+    return static_cast<uint16_t>(move.from | (move.to << 6) | (promotion << 12));
+}
+
+// Order the table's move first, then captures by the value of the victim,
+// then the rest.  Helper threads add a random term, so that they explore the
+// tree in a different order than the main thread.
+static void OrderMoves(SearchThread & thread, Move * pMoves, int cMoves, uint16_t ttMove)
+{
+    int aKeys[MAX_MOVES];
+    for(int ii = 0; ii < cMoves; ii++)
+    {
+        eChessPiece victim = thread.board.PieceAt(pMoves[ii].to);
+        int key = (EncodeMove(pMoves[ii]) == ttMove) ? 100000 : 0;
+        key += (victim != EMPTY) ? 1000 + s_aPieceValues[GetUncoloredPiece(victim)] : 0;
+        key += thread.fJitter ? static_cast<int>(thread.rng.Rand() & 0xff) : 0;
+        aKeys[ii] = key;
+    }
+
+    // Insertion sort, as the lists are short.
+    for(int ii = 1; ii < cMoves; ii++)
+    {
+        Move move = pMoves[ii];
+        int key = aKeys[ii];
+        int jj = ii - 1;
+        for(; jj >= 0 && aKeys[jj] < key; jj--)
+        {
+            pMoves[jj + 1] = pMoves[jj];
+            aKeys[jj + 1] = aKeys[jj];
+        }
+        pMoves[jj + 1] = move;
+        aKeys[jj + 1] = key;
+    }
+}
+
+static int Search(SearchThread & thread, int depth, int alpha, int beta, int ply)
+{
+    // Poll the shared flag only occasionally, then unwind without searching further.
+    if((thread.cNodes & 1023) == 0 && thread.pfStop->load(std::memory_order_relaxed))
+    {
+        thread.fStopped = true;
+    }
+    if(thread.fStopped)
+    {
+        return 0;
+    }
+    thread.cNodes++;
+
+    if(depth == 0 || ply >= MAX_PLY - 1)
+    {
+        return Evaluate(thread.board);
+    }
+
+    uint64_t key = thread.board.Key();
+    uint16_t ttMove = 0;
+    TranspositionData data;
+    if(thread.pTable->Probe(key, data, thread.ttStats))
+    {
+        ttMove = data.move;
+        int score = ScoreFromTable(data.score, ply);
+        if(data.depth >= depth && ply > 0)
+        {
+            if(data.bound == BOUND_EXACT ||
+               (data.bound == BOUND_LOWER && score >= beta) ||
+               (data.bound == BOUND_UPPER && score <= alpha))
+            {
+                return score;
+            }
+        }
+    }
+
+    Move aMoves[MAX_MOVES];
+    int cMoves = GenerateMoves(thread.board, aMoves);
+    OrderMoves(thread, aMoves, cMoves, ttMove);
+
+    int alphaOriginal = alpha;
+    int bestScore = -SCORE_INFINITE;
+    uint16_t bestMove = 0;
+    UndoState undo;
+    for(int ii = 0; ii < cMoves; ii++)
+    {
+        thread.board.MakeMove(aMoves[ii], undo);
+
+        // Start loading the child's bucket while the legality check runs.
+        thread.pTable->Prefetch(thread.board.Key());
+
+        if(IsMoverInCheck(thread.board))
+        {
+            thread.board.UnmakeMove(undo);
+            continue;
+        }
+
+        int score = -Search(thread, depth - 1, -beta, -alpha, ply + 1);
+        thread.board.UnmakeMove(undo);
+
+        if(thread.fStopped)
+        {
+            return 0;
+        }
+
+        if(score > bestScore)
+        {
+            bestScore = score;
+            bestMove = EncodeMove(aMoves[ii]);
+        }
+        if(score > alpha)
+        {
+            alpha = score;
+        }
+        if(alpha >= beta)
+        {
+            break;
+        }
+    }
+
+    if(bestScore == -SCORE_INFINITE)
+    {
+        // No legal moves: checkmate or stalemate.
+        uint64_t king = thread.board.Bitboard(thread.board.SideToMove() == WHITE ? W_KING : B_KING);
+        bool fInCheck = king != 0 && IsSquareAttacked(thread.board, LowestBitIndex(king),
+                                                       thread.board.SideToMove() == WHITE ? BLACK : WHITE);
+        return fInCheck ? -(SCORE_MATE - ply) : 0;
+    }
+
+    {
+        data.move  = bestMove;
+        data.score = static_cast<int16_t>(ScoreToTable(bestScore, ply));
+        data.depth = static_cast<uint8_t>(depth);
+        data.bound = bestScore <= alphaOriginal ? BOUND_UPPER : (bestScore >= beta ? BOUND_LOWER : BOUND_EXACT);
+        thread.pTable->Store(key, data, thread.ttStats);
+    }
+
+    return bestScore;
+}
+
+static void SearchThreadFunc(SearchThread * pThread, int threadIndex)
+{
+    CacheCounters counters;
+    counters.Start();
+
+    // Stagger the helpers' starting depths, so that they are usually one
+    // iteration ahead of or level with the main thread.
+    for(int depth = 1 + (threadIndex & 1); depth < MAX_PLY; depth++)
+    {
+        int score = Search(*pThread, depth, -SCORE_INFINITE, SCORE_INFINITE, 0);
+        if(pThread->fStopped)
+        {
+            break;
+        }
+
+        pThread->result.depth = depth;
+        pThread->result.score = score;
+    }
+
+    counters.Stop(pThread->result.cCacheReferences, pThread->result.cCacheMisses);
+    pThread->result.fCountersAvailable = counters.Available();
+}
+
+SearchResult SearchLazySmp(
+    const ChessBoard &   root,
+    TranspositionTable & table,
+    int                  cThreads,
+    double               seconds)
+{
+    assert(cThreads > 0);
+
+    std::atomic<bool> fStop(false);
+
+    std::vector<std::unique_ptr<SearchThread>> aThreads;
+    for(int ii = 0; ii < cThreads; ii++)
+    {
+        aThreads.push_back(std::unique_ptr<SearchThread>(new SearchThread(root, &table, static_cast<uint32_t>(ii), &fStop)));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> aWorkers;
+    for(int ii = 0; ii < cThreads; ii++)
+    {
+        aWorkers.push_back(std::thread(SearchThreadFunc, aThreads[ii].get(), ii));
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    fStop.store(true, std::memory_order_relaxed);
+
+    SearchResult result;
+    result.fCountersAvailable = true;
+    for(int ii = 0; ii < cThreads; ii++)
+    {
+        aWorkers[ii].join();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for(int ii = 0; ii < cThreads; ii++)
+    {
+        result.cNodes += aThreads[ii]->cNodes;
+        result.tt += aThreads[ii]->ttStats;
+        result.cCacheReferences += aThreads[ii]->result.cCacheReferences;
+        result.cCacheMisses += aThreads[ii]->result.cCacheMisses;
+        result.fCountersAvailable = result.fCountersAvailable && aThreads[ii]->result.fCountersAvailable;
+    }
+
+    result.depth = aThreads[0]->result.depth;
+    result.score = aThreads[0]->result.score;
+
+    return result;
+}
+
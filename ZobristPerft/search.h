@@ -0,0 +1,28 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+struct SearchResult
+{
+    uint64_t cNodes = 0;
+    double   seconds = 0;           // from starting the threads until they have all stopped
+    int      depth = 0;             // deepest iteration completed by the main thread
+    int      score = 0;             // score of that iteration, for the side to move
+    TranspositionStats tt;
+    bool     fCountersAvailable = false;
+    uint64_t cCacheReferences = 0;
+    uint64_t cCacheMisses = 0;
+};
+
+// A lazy SMP search: every thread runs the same iterative deepening
+// alpha-beta search from the root, sharing only the transposition table.
+// The threads split the work implicitly, as each one finds the results the
+// others have stored.  To keep them from walking the tree in lockstep, the
+// helper threads jitter their move order with their own MersenneTwister, and
+// start their iterations at staggered depths.
+//
+// The evaluation is material only, as the point is to drive the make/unmake,
+// key and table code the way a real search does, not to play well.
+SearchResult SearchLazySmp(const ChessBoard & root, TranspositionTable & table, int cThreads, double seconds);
+
+#endif
+